@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file image_processor_benchmark.cpp
+ * @brief Measures the per frame cost of producing image messages from a
+ * LidarScan, comparing the ImageProcessor against the previous per frame
+ * allocating implementation
+ */
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "../src/image_processor.h"
+
+using namespace ouster_ros;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct fill_random {
+    template <typename T>
+    void operator()(Eigen::Ref<ouster::img_t<T>> field, std::mt19937& gen) {
+        std::uniform_int_distribution<uint32_t> dist(0, 0xFFFF);
+        for (Eigen::Index i = 0; i < field.size(); ++i)
+            field.data()[i] = static_cast<T>(dist(gen));
+    }
+};
+
+ouster::LidarScan make_random_scan(const sensor::sensor_info& info) {
+    ouster::LidarScan scan(info.format.columns_per_frame,
+                           info.format.pixels_per_column,
+                           info.format.udp_profile_lidar);
+    std::mt19937 gen(42);
+    for (auto it = scan.begin(); it != scan.end(); ++it)
+        ouster::impl::visit_field(scan, it->first, fill_random(), gen);
+    return scan;
+}
+
+// the image pipeline as it was before buffers were preallocated, kept as a
+// reference point for the benchmark
+class LegacyImagePipeline {
+   public:
+    explicit LegacyImagePipeline(const sensor::sensor_info& info)
+        : info_(info) {
+        for (auto channel :
+             {sensor::ChanField::RANGE, sensor::ChanField::SIGNAL,
+              sensor::ChanField::REFLECTIVITY, sensor::ChanField::NEAR_IR,
+              sensor::ChanField::RANGE2, sensor::ChanField::SIGNAL2,
+              sensor::ChanField::REFLECTIVITY2}) {
+            images[channel].resize(info.format.pixels_per_column,
+                                   info.format.columns_per_frame);
+        }
+    }
+
+    void process(const ouster::LidarScan& ls) {
+        process_return(ls, 0);
+        if (get_n_returns(info_) == 2) process_return(ls, 1);
+    }
+
+   private:
+    void process_return(const ouster::LidarScan& ls, int return_index) {
+        using pixel_type = uint16_t;
+        const size_t pixel_value_max = std::numeric_limits<pixel_type>::max();
+        const bool first = return_index == 0;
+        auto range_channel =
+            first ? sensor::ChanField::RANGE : sensor::ChanField::RANGE2;
+        ouster::img_t<uint32_t> range = ls.field<uint32_t>(range_channel);
+        ouster::img_t<uint16_t> reflectivity = impl::get_or_fill_zero<uint16_t>(
+            impl::suitable_return(sensor::ChanField::REFLECTIVITY, !first), ls);
+        ouster::img_t<uint32_t> signal = impl::get_or_fill_zero<uint32_t>(
+            impl::suitable_return(sensor::ChanField::SIGNAL, !first), ls);
+        ouster::img_t<uint16_t> near_ir = impl::get_or_fill_zero<uint16_t>(
+            impl::suitable_return(sensor::ChanField::NEAR_IR, !first), ls);
+
+        size_t H = info_.format.pixels_per_column;
+        size_t W = info_.format.columns_per_frame;
+        const auto& px_offset = info_.format.pixel_shift_by_row;
+
+        auto& range_image =
+            images[impl::suitable_return(sensor::ChanField::RANGE, !first)];
+        ouster::img_t<float> signal_image_eigen(H, W);
+        ouster::img_t<float> reflec_image_eigen(H, W);
+        ouster::img_t<float> nearir_image_eigen(H, W);
+
+        for (size_t u = 0; u < H; u++) {
+            for (size_t v = 0; v < W; v++) {
+                const size_t vv = (v + W - px_offset[u]) % W;
+                const size_t idx = u * W + vv;
+                auto r = (range.data()[idx] + 0b10) >> 2;
+                range_image(u, v) = r > pixel_value_max ? 0 : r;
+                signal_image_eigen(u, v) = signal.data()[idx];
+                reflec_image_eigen(u, v) = reflectivity.data()[idx];
+                nearir_image_eigen(u, v) = near_ir.data()[idx];
+            }
+        }
+
+        signal_ae(signal_image_eigen, first);
+        reflec_ae(reflec_image_eigen, first);
+        nearir_buc(nearir_image_eigen);
+        nearir_ae(nearir_image_eigen, first);
+        nearir_image_eigen = nearir_image_eigen.sqrt();
+        signal_image_eigen = signal_image_eigen.sqrt();
+
+        images[impl::suitable_return(sensor::ChanField::SIGNAL, !first)] =
+            (signal_image_eigen * pixel_value_max).cast<pixel_type>();
+        images[impl::suitable_return(sensor::ChanField::REFLECTIVITY,
+                                     !first)] =
+            (reflec_image_eigen * pixel_value_max).cast<pixel_type>();
+        images[sensor::ChanField::NEAR_IR] =
+            (nearir_image_eigen * pixel_value_max).cast<pixel_type>();
+    }
+
+    sensor::sensor_info info_;
+    std::map<sensor::ChanField, ouster::img_t<uint16_t>> images;
+    viz::AutoExposure nearir_ae, signal_ae, reflec_ae;
+    viz::BeamUniformityCorrector nearir_buc;
+};
+
+template <typename Fn>
+double measure_ms_per_frame(Fn&& fn, int frames) {
+    fn();  // warm up
+    auto start = Clock::now();
+    for (int i = 0; i < frames; ++i) fn();
+    std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+    return elapsed.count() / frames;
+}
+
+void run(const std::string& name, sensor::lidar_mode mode,
+         sensor::UDPProfileLidar profile, int frames) {
+    auto info = sensor::default_sensor_info(mode);
+    info.format.udp_profile_lidar = profile;
+    auto scan = make_random_scan(info);
+
+    LegacyImagePipeline legacy(info);
+    auto legacy_ms =
+        measure_ms_per_frame([&]() { legacy.process(scan); }, frames);
+
+    size_t published = 0;
+    auto processor = ImageProcessor::create(
+        info, "os_lidar", [&published](ImageProcessor::OutputType msgs) {
+            published += msgs.size();
+        });
+    auto ts = ros::Time(1, 0);
+    auto current_ms = measure_ms_per_frame(
+        [&]() { processor(scan, 0, ts); }, frames);
+
+    std::cout << name << ": legacy " << legacy_ms << " ms/frame, current "
+              << current_ms << " ms/frame (" << published << " images)"
+              << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 200;
+
+    run("1024x10 single return", sensor::MODE_1024x10,
+        sensor::UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16, frames);
+    run("1024x10 dual return", sensor::MODE_1024x10,
+        sensor::UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL, frames);
+    run("2048x10 single return", sensor::MODE_2048x10,
+        sensor::UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16, frames);
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file packet_recorder_benchmark.cpp
+ * @brief Measures the cpu time and disk usage of recording raw sensor
+ * packets with the SegmentWriter, comparing it against recording the same
+ * PacketMsg stream with rosbag
+ */
+
+#include <rosbag/bag.h>
+#include <ros/time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <random>
+
+#include "ouster_ros/PacketMsg.h"
+#include "../src/segment_reader.h"
+#include "../src/segment_writer.h"
+
+using namespace ouster_ros;
+
+namespace {
+
+// lidar packet size of the RNG19_RFL8_SIG16_NIR16 profile at 1024 columns
+constexpr size_t lidar_packet_size = 24832;
+constexpr size_t imu_packet_size = 48;
+// a 1024x10 sensor sends 640 lidar packets and 100 imu packets per second
+constexpr int lidar_packets_per_imu_packet = 6;
+constexpr uint64_t lidar_packet_period_ns = 1000000000ull / 640;
+
+struct Result {
+    double cpu_s;
+    uint64_t disk_bytes;
+};
+
+double cpu_seconds() {
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+uint64_t disk_usage(const std::string& path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return 0;
+    return static_cast<uint64_t>(st.st_blocks) * 512;
+}
+
+// calls fn(type, timestamp, packet) for a packet stream lasting seconds
+template <typename Fn>
+void generate_packets(int seconds, Fn&& fn) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> dist(0, 255);
+    PacketMsg lidar, imu;
+    lidar.buf.resize(lidar_packet_size);
+    imu.buf.resize(imu_packet_size);
+    for (auto& b : lidar.buf) b = static_cast<uint8_t>(dist(gen));
+    for (auto& b : imu.buf) b = static_cast<uint8_t>(dist(gen));
+
+    const int packets = seconds * 640;
+    uint64_t ts = 1000000000ull;
+    for (int i = 0; i < packets; ++i, ts += lidar_packet_period_ns) {
+        lidar.buf[0] = static_cast<uint8_t>(i);
+        fn(segment::LIDAR_PACKET, ts, lidar);
+        if (i % lidar_packets_per_imu_packet == 0)
+            fn(segment::IMU_PACKET, ts, imu);
+    }
+}
+
+Result record_segments(const std::string& prefix, int seconds) {
+    SegmentWriterConfig config;
+    config.prefix = prefix;
+    std::vector<std::string> segments;
+    const double start = cpu_seconds();
+    {
+        SegmentWriter writer(config, std::string(4096, ' '));
+        generate_packets(seconds, [&](segment::PacketType type, uint64_t ts,
+                                      const PacketMsg& msg) {
+            writer.write(type, ts, msg.buf.data(), msg.buf.size());
+        });
+        writer.close();
+        segments = writer.segments();
+    }
+    Result result{cpu_seconds() - start, 0};
+    for (const auto& path : segments) result.disk_bytes += disk_usage(path);
+
+    // read back to make sure nothing was lost
+    size_t records = 0;
+    for (const auto& path : segments) {
+        SegmentReader reader(path);
+        SegmentRecord record;
+        while (reader.next(record)) ++records;
+    }
+    std::cout << "segments: read back " << records << " packets" << std::endl;
+    for (const auto& path : segments) std::remove(path.c_str());
+    return result;
+}
+
+Result record_bag(const std::string& path, int seconds) {
+    const double start = cpu_seconds();
+    {
+        rosbag::Bag bag(path, rosbag::bagmode::Write);
+        generate_packets(seconds, [&](segment::PacketType type, uint64_t ts,
+                                      const PacketMsg& msg) {
+            ros::Time stamp;
+            stamp.fromNSec(ts);
+            bag.write(type == segment::LIDAR_PACKET ? "/ouster/lidar_packets"
+                                                    : "/ouster/imu_packets",
+                      stamp, msg);
+        });
+    }
+    Result result{cpu_seconds() - start, disk_usage(path)};
+    std::remove(path.c_str());
+    return result;
+}
+
+void report(const std::string& name, const Result& result, int seconds) {
+    std::cout << name << ": " << result.cpu_s * 1000 / seconds
+              << " ms cpu per second of data, "
+              << result.disk_bytes / (1024.0 * 1024.0) << " MiB on disk"
+              << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ros::Time::init();
+    int seconds = argc > 1 ? std::atoi(argv[1]) : 30;
+    std::string dir = argc > 2 ? argv[2] : "/tmp";
+
+    const uint64_t payload =
+        static_cast<uint64_t>(seconds) * 640 *
+        (lidar_packet_size + imu_packet_size / lidar_packets_per_imu_packet);
+    std::cout << "recording " << seconds << " s of 1024x10 packets ("
+              << payload / (1024.0 * 1024.0) << " MiB of payload)" << std::endl;
+
+    report("segments", record_segments(dir + "/packet_recorder_benchmark",
+                                       seconds),
+           seconds);
+    report("rosbag", record_bag(dir + "/packet_recorder_benchmark.bag", seconds),
+           seconds);
+    return 0;
+}
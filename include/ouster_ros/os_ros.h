@@ -116,6 +116,47 @@ sensor_msgs::LaserScan lidar_scan_to_laser_scan_msg(
     const uint16_t ring, const std::vector<int>& pixel_shift_by_row,
     const int return_index);
 
+/**
+ * Initializes the fields of a LaserScan message that remain the same across
+ * frames: frame, angle window, timing, range limits and the size of ranges
+ * and intensities
+ * @param[out] msg the message to initialize
+ * @param[in] frame the parent frame of the laser scan message
+ * @param[in] lidar_mode lidar mode (width x frequency)
+ * @param[in] prod_line product line of the sensor used to set range_max,
+ * unknown product lines use a range_max of 120 m
+ */
+void init_laser_scan_msg(sensor_msgs::LaserScan& msg, const std::string& frame,
+                         const ouster::sensor::lidar_mode lidar_mode,
+                         const std::string& prod_line = {});
+
+/**
+ * Computes the source column within a staggered ring of each entry of a laser
+ * scan message
+ * @param[in] columns number of columns of the lidar scan
+ * @param[in] pixel_shift pixel shift of the ring
+ * @return vector of the source column of each entry
+ */
+std::vector<int> laser_scan_column_permutation(size_t columns,
+                                               int pixel_shift);
+
+/**
+ * Fills the ranges and intensities of a preallocated LaserScan message from a
+ * single ring without allocating, only the row of the selected ring is read
+ * @param[in] ls lidar scan object
+ * @param[in] timestamp value to set as the timestamp of the message
+ * @param[in] ring selected ring to be published
+ * @param[in] column_permutation as returned by laser_scan_column_permutation
+ * @param[in] return_index index of return desired starting at 0
+ * @param[out] msg message initialized with init_laser_scan_msg
+ */
+void lidar_scan_to_laser_scan_msg(const ouster::LidarScan& ls,
+                                  const ros::Time& timestamp,
+                                  const uint16_t ring,
+                                  const std::vector<int>& column_permutation,
+                                  const int return_index,
+                                  sensor_msgs::LaserScan& msg);
+
 namespace impl {
 sensor::ChanField suitable_return(sensor::ChanField input_field, bool second);
 
@@ -0,0 +1,212 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file auto_exposure.h
+ * @brief Auto exposure and beam uniformity correction for lidar images with
+ * a configurable update cadence
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "ouster/image_processing.h"
+
+namespace ouster_ros {
+
+/**
+ * @class HistogramAutoExposure scales an image to [0, 1] range based on its
+ * lower and upper percentiles, equivalent to ouster::viz::AutoExposure.
+ *
+ * Percentiles are estimated from a histogram with logarithmically spaced bins
+ * (64 per power of two, < 1% relative error) over a strided sample of the
+ * image, which takes linear time rather than the partial sorts required to
+ * find the exact values. The exposure parameters are damped and recomputed
+ * every update_every frames or, when update_period is set, at most once per
+ * update_period seconds. Frames in between only apply the current parameters.
+ */
+class HistogramAutoExposure {
+    using Clock = std::chrono::steady_clock;
+
+    // number of bits of the float mantissa used to subdivide each power of two
+    static constexpr int sub_bin_bits = 6;
+    static constexpr int bin_shift = 23 - sub_bin_bits;
+    // values below 2^-8 fall into the first bin, values above 2^40 into the last
+    static constexpr uint32_t min_exponent = 127 - 8;
+    static constexpr uint32_t max_exponent = 127 + 40;
+    static constexpr size_t bins_count = (max_exponent - min_exponent)
+                                         << sub_bin_bits;
+    static constexpr double damping = 0.9;
+    static constexpr int stride = 4;
+
+   public:
+    /**
+     * @param[in] lo_percentile fraction of darkest pixels mapped to zero.
+     * @param[in] hi_percentile fraction of brightest pixels mapped to one.
+     * @param[in] update_every number of frames between exposure updates.
+     * @param[in] update_period minimum time in seconds between exposure
+     * updates, when positive it takes precedence over update_every.
+     */
+    explicit HistogramAutoExposure(double lo_percentile = 0.1,
+                                   double hi_percentile = 0.1,
+                                   int update_every = 3,
+                                   double update_period = 0.0)
+        : lo_percentile_(lo_percentile),
+          hi_percentile_(hi_percentile),
+          update_every_(std::max(update_every, 1)),
+          update_period_(std::chrono::duration_cast<Clock::duration>(
+              std::chrono::duration<double>(update_period))),
+          histogram(bins_count, 0) {}
+
+    /**
+     * Scales the image in place.
+     * @param[in] update_state when false the exposure parameters are applied
+     * without being updated, use it for images that share the exposure of
+     * another image e.g. the second return.
+     */
+    void operator()(Eigen::Ref<ouster::img_t<float>> image,
+                    bool update_state = true) {
+        if (update_state && update_due()) update(image);
+        if (!initialized) return;
+
+        const float lo = static_cast<float>(lo_state);
+        const float range = static_cast<float>(hi_state - lo_state);
+        const float scale = range > 0 ? 1.0f / range : 1.0f;
+        image = ((image - lo) * scale).max(0.0f).min(1.0f);
+    }
+
+   private:
+    bool update_due() {
+        if (update_period_.count() > 0) {
+            auto now = Clock::now();
+            if (initialized && now - last_update < update_period_)
+                return false;
+            last_update = now;
+            return true;
+        }
+        bool due = counter == 0;
+        counter = (counter + 1) % update_every_;
+        return due;
+    }
+
+    static size_t bin_of(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const uint32_t min_bits = min_exponent << sub_bin_bits;
+        uint32_t key = bits >> bin_shift;
+        if (key < min_bits) return 0;
+        return std::min<size_t>(key - min_bits, bins_count - 1);
+    }
+
+    static float value_of_bin(size_t bin) {
+        // midpoint of the interval covered by the bin
+        uint32_t bits = static_cast<uint32_t>(
+                            (bin + (min_exponent << sub_bin_bits))
+                            << bin_shift) |
+                        (1u << (bin_shift - 1));
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    void update(const Eigen::Ref<ouster::img_t<float>>& image) {
+        std::fill(histogram.begin(), histogram.end(), 0);
+        size_t samples = 0;
+        const Eigen::Index cols = image.cols();
+        for (Eigen::Index i = 0; i < image.size(); i += stride) {
+            const float value = image(i / cols, i % cols);
+            if (value > 0) {
+                ++histogram[bin_of(value)];
+                ++samples;
+            }
+        }
+        if (samples == 0) return;
+
+        const size_t lo_rank = static_cast<size_t>(samples * lo_percentile_);
+        const size_t hi_rank =
+            samples - 1 -
+            std::min(static_cast<size_t>(samples * hi_percentile_),
+                     samples - 1);
+        float lo = 0, hi = 0;
+        size_t cumulative = 0;
+        bool lo_found = false;
+        for (size_t b = 0; b < bins_count; ++b) {
+            cumulative += histogram[b];
+            if (!lo_found && cumulative > lo_rank) {
+                lo = value_of_bin(b);
+                lo_found = true;
+            }
+            if (cumulative > hi_rank) {
+                hi = value_of_bin(b);
+                break;
+            }
+        }
+
+        if (!initialized) {
+            initialized = true;
+            lo_state = lo;
+            hi_state = hi;
+        }
+        lo_state = damping * lo_state + (1.0 - damping) * lo;
+        hi_state = damping * hi_state + (1.0 - damping) * hi;
+    }
+
+   private:
+    double lo_percentile_;
+    double hi_percentile_;
+    int update_every_;
+    Clock::duration update_period_;
+
+    std::vector<uint32_t> histogram;
+    int counter = 0;
+    Clock::time_point last_update;
+    bool initialized = false;
+    double lo_state = 0.0;
+    double hi_state = 1.0;
+};
+
+/**
+ * @class ThrottledBeamUniformityCorrector applies the correction computed by
+ * ouster::viz::BeamUniformityCorrector, updating it every update_every frames.
+ *
+ * The correction amounts to subtracting a per row offset, on update frames the
+ * offsets are recovered by comparing the image before and after correction;
+ * frames in between subtract the cached offsets.
+ */
+class ThrottledBeamUniformityCorrector {
+   public:
+    explicit ThrottledBeamUniformityCorrector(int update_every = 1)
+        : update_every_(std::max(update_every, 1)) {}
+
+    void operator()(Eigen::Ref<ouster::img_t<float>> image) {
+        const bool due = counter == 0;
+        counter = (counter + 1) % update_every_;
+
+        if (update_every_ == 1) {
+            buc(image);
+            return;
+        }
+
+        if (due || offsets.size() != image.rows()) {
+            before = image;
+            buc(image);
+            offsets = (before - image).rowwise().maxCoeff();
+            return;
+        }
+
+        image = (image.colwise() - offsets).max(0.0f);
+    }
+
+   private:
+    int update_every_;
+    int counter = 0;
+    ouster::viz::BeamUniformityCorrector buc;
+    ouster::img_t<float> before;
+    Eigen::Array<float, Eigen::Dynamic, 1> offsets;
+};
+
+}  // namespace ouster_ros
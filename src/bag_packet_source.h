@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file bag_packet_source.h
+ * @brief A PacketSource reading the sensor packets of bags recorded by
+ * record.launch
+ */
+
+#pragma once
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <ros/serialization.h>
+#include <std_msgs/String.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "packet_source.h"
+
+namespace ouster_ros {
+
+/**
+ * Reads the PacketMsg messages of the lidar and imu packets topics of a bag.
+ * Messages are not deserialized, their serialized form is read into a reused
+ * buffer and the packet bytes are handed out in place.
+ *
+ * The rosbag API doesn't expose where messages are stored within the file,
+ * the position of a packet is therefore its recording time; seeking to it
+ * resumes with the first packet recorded at that time.
+ */
+class BagPacketSource : public PacketSource {
+   public:
+    BagPacketSource(const std::string& bag_file,
+                    const std::string& lidar_packets_topic,
+                    const std::string& imu_packets_topic)
+        : lidar_topic(lidar_packets_topic), imu_topic(imu_packets_topic) {
+        bag.open(bag_file, rosbag::bagmode::Read);
+        rewind();
+    }
+
+    bool next(ReplayPacket& packet) override {
+        for (; it != view->end(); ++it) {
+            const rosbag::MessageInstance& m = *it;
+            const auto& topic = m.getTopic();
+            const bool lidar = topic == lidar_topic;
+            if (!lidar && topic != imu_topic) continue;
+
+            // a serialized PacketMsg holds the length of buf followed by
+            // its bytes
+            buffer.resize(m.size());
+            ros::serialization::OStream stream(buffer.data(), buffer.size());
+            m.write(stream);
+            uint32_t size = 0;
+            if (buffer.size() < sizeof(size)) continue;
+            std::memcpy(&size, buffer.data(), sizeof(size));
+            if (sizeof(size) + size > buffer.size()) continue;
+
+            packet.kind = lidar ? PacketKind::LIDAR : PacketKind::IMU;
+            packet.timestamp = m.getTime().toNSec();
+            packet.position = packet.timestamp;
+            packet.data = buffer.data() + sizeof(size);
+            packet.size = size;
+            ++it;
+            return true;
+        }
+        return false;
+    }
+
+    void rewind() override {
+        view = std::make_unique<rosbag::View>(bag, topic_query());
+        it = view->begin();
+    }
+
+    void seek(uint64_t position) override {
+        ros::Time start;
+        start.fromNSec(position);
+        view = std::make_unique<rosbag::View>(bag, topic_query(), start);
+        it = view->begin();
+    }
+
+    // the last sensor metadata recorded on the given topic
+    std::string read_metadata(const std::string& metadata_topic) {
+        std::string metadata;
+        rosbag::View metadata_view(bag, rosbag::TopicQuery(metadata_topic));
+        for (const auto& m : metadata_view) {
+            auto msg = m.instantiate<std_msgs::String>();
+            if (msg) metadata = msg->data;
+        }
+        return metadata;
+    }
+
+   private:
+    rosbag::TopicQuery topic_query() const {
+        return rosbag::TopicQuery(
+            std::vector<std::string>{lidar_topic, imu_topic});
+    }
+
+   private:
+    rosbag::Bag bag;
+    std::string lidar_topic;
+    std::string imu_topic;
+    std::unique_ptr<rosbag::View> view;
+    rosbag::View::iterator it;
+    std::vector<uint8_t> buffer;
+};
+
+}  // namespace ouster_ros
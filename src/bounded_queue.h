@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file bounded_queue.h
+ * @brief A thread safe queue of limited capacity with a configurable policy
+ * to apply when the queue is full
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace ouster_ros {
+
+/**
+ * Determines what happens when an item is pushed into a full queue.
+ */
+enum class QueuePolicy {
+    DROP_OLDEST,  // discard the item at the front of the queue
+    DROP_NEWEST,  // discard the item being pushed
+    BLOCK         // block the producer until space becomes available
+};
+
+inline bool is_queue_policy(const std::string& policy) {
+    return policy == "DROP_OLDEST" || policy == "DROP_NEWEST" ||
+           policy == "BLOCK";
+}
+
+inline QueuePolicy queue_policy_of_string(const std::string& policy) {
+    if (policy == "DROP_OLDEST") return QueuePolicy::DROP_OLDEST;
+    if (policy == "DROP_NEWEST") return QueuePolicy::DROP_NEWEST;
+    if (policy == "BLOCK") return QueuePolicy::BLOCK;
+    throw std::runtime_error("unsupported queue policy: " + policy);
+}
+
+/**
+ * @class BoundedQueue thread safe queue of limited capacity.
+ */
+template <typename T>
+class BoundedQueue {
+   public:
+    BoundedQueue(size_t capacity, QueuePolicy policy)
+        : capacity_(capacity), policy_(policy) {
+        if (capacity_ == 0)
+            throw std::invalid_argument("queue capacity can not be zero");
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    QueuePolicy policy() const { return policy_; }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+    /**
+     * Gets the total number of items discarded due to the queue being full.
+     */
+    size_t dropped_count() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped;
+    }
+
+    /**
+     * Pushes an item to the back of the queue applying the queue policy if the
+     * queue is full.
+     *
+     * @param[out] discarded receives the item that got discarded if any, which
+     * lets producers recycle resources held by items.
+     * @return false if an item had to be discarded or the queue was closed
+     * before the item could be pushed, true otherwise.
+     */
+    bool push(T item, T* discarded = nullptr) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (policy_ == QueuePolicy::BLOCK) {
+            not_full.wait(lock,
+                          [this] { return closed || items.size() < capacity_; });
+            if (closed) {
+                if (discarded) *discarded = std::move(item);
+                return false;
+            }
+        } else if (items.size() >= capacity_) {
+            ++dropped;
+            if (policy_ == QueuePolicy::DROP_NEWEST) {
+                if (discarded) *discarded = std::move(item);
+                return false;
+            }
+            if (discarded) *discarded = std::move(items.front());
+            items.pop_front();
+            items.push_back(std::move(item));
+            not_empty.notify_one();
+            return false;
+        }
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * Pops the item at the front of the queue, the method blocks until an item
+     * becomes available or the queue gets closed.
+     *
+     * @return false if the queue was closed and no more items are available.
+     */
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    /**
+     * Closes the queue, releasing any blocked producers and consumers. Items
+     * already in the queue can still be popped.
+     */
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+   private:
+    const size_t capacity_;
+    const QueuePolicy policy_;
+    std::deque<T> items;
+    size_t dropped = 0;
+    bool closed = false;
+    mutable std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+}  // namespace ouster_ros
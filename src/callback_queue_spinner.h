@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file callback_queue_spinner.h
+ * @brief A callback queue served by dedicated threads
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <ros/callback_queue.h>
+#include <ros/console.h>
+#include <ros/ros.h>
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ouster_ros {
+
+/**
+ * @class CallbackQueueSpinner a callback queue with its own threads, so that
+ * subscriptions assigned to it don't wait behind the callbacks of the shared
+ * queue of the nodelet manager.
+ *
+ * Callbacks of the same subscription still run one at a time, unless the
+ * subscription allows concurrent callbacks.
+ */
+class CallbackQueueSpinner {
+   public:
+    /**
+     * @param[in] name identifies the queue in log messages.
+     * @param[in] threads_count number of threads serving the queue.
+     * @param[in] priority SCHED_FIFO priority of the threads, 0 keeps the
+     * default scheduling; a higher priority needs the privileges to set it,
+     * without them the threads run at the default priority.
+     */
+    CallbackQueueSpinner(const std::string& name, int threads_count,
+                         int priority = 0)
+        : name(name), priority(priority) {
+        for (int i = 0; i < threads_count; ++i)
+            threads.emplace_back([this, i]() { run(i); });
+    }
+
+    ~CallbackQueueSpinner() { stop(); }
+
+    CallbackQueueSpinner(const CallbackQueueSpinner&) = delete;
+    CallbackQueueSpinner& operator=(const CallbackQueueSpinner&) = delete;
+
+    ros::CallbackQueue* queue() { return &queue_; }
+
+    /**
+     * Stops the threads once the callbacks in progress complete, callbacks
+     * still queued are not called.
+     */
+    void stop() {
+        running = false;
+        for (auto& thread : threads)
+            if (thread.joinable()) thread.join();
+    }
+
+   private:
+    void run(int index) {
+        // the outcome is the same for every thread, the first reports it
+        if (priority > 0) apply_priority(index == 0);
+        while (running) queue_.callAvailable(ros::WallDuration(0.1));
+    }
+
+    void apply_priority(bool report) {
+        sched_param param{};
+        param.sched_priority = priority;
+        const int error =
+            pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (!report) return;
+        if (error)
+            ROS_WARN_STREAM("could not raise the priority of the "
+                            << name << " callback threads: "
+                            << std::strerror(error));
+        else
+            ROS_INFO_STREAM(name << " callback threads run at SCHED_FIFO "
+                                    "priority "
+                                 << priority);
+    }
+
+   private:
+    const std::string name;
+    const int priority;
+    ros::CallbackQueue queue_;
+    std::atomic<bool> running = {true};
+    std::vector<std::thread> threads;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,243 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file camera_projection.h
+ * @brief Projects lidar points onto the image planes of cameras
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ouster_ros {
+
+enum class CameraModel { PINHOLE, EQUIDISTANT };
+
+inline CameraModel camera_model_of_string(const std::string& model) {
+    if (model == "pinhole") return CameraModel::PINHOLE;
+    if (model == "equidistant") return CameraModel::EQUIDISTANT;
+    throw std::runtime_error("unsupported camera model: " + model);
+}
+
+/**
+ * Intrinsics and extrinsics of a camera, the distortion coefficients follow
+ * the conventions of sensor_msgs/CameraInfo: k1, k2, p1, p2, k3 (plumb bob)
+ * for the pinhole model and k1, k2, k3, k4 for the equidistant model; missing
+ * coefficients are zero.
+ */
+struct CameraConfig {
+    std::string name;
+    std::string frame_id;
+    CameraModel model = CameraModel::PINHOLE;
+    int width = 0;
+    int height = 0;
+    double fx = 0.0;
+    double fy = 0.0;
+    double cx = 0.0;
+    double cy = 0.0;
+    std::vector<double> distortion;
+    // transform from the point cloud frame to the camera optical frame
+    Eigen::Matrix4d extrinsics = Eigen::Matrix4d::Identity();
+};
+
+/**
+ * @class CameraDepthBuffer a z-buffer of a camera image that several threads
+ * may fill at the same time.
+ *
+ * Each pixel holds the depth of the nearest point projected onto it along
+ * with the index of that point, packed into a single word so that a compare
+ * and swap keeps both consistent. Depths are positive, so the bits of their
+ * float representation order the same way as their values.
+ */
+class CameraDepthBuffer {
+    static constexpr uint64_t empty = UINT64_MAX;
+
+   public:
+    explicit CameraDepthBuffer(size_t pixel_count)
+        : size_(pixel_count), cells(new std::atomic<uint64_t>[pixel_count]) {
+        for (size_t i = 0; i < size_; ++i)
+            cells[i].store(empty, std::memory_order_relaxed);
+    }
+
+    size_t size() const { return size_; }
+
+    // keeps the point if it is nearer than the one the pixel holds
+    void insert(size_t pixel, float depth, uint32_t point_index) {
+        uint32_t depth_bits;
+        std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+        const uint64_t cell = (uint64_t{depth_bits} << 32) | point_index;
+        auto& target = cells[pixel];
+        uint64_t current = target.load(std::memory_order_relaxed);
+        while (cell < current &&
+               !target.compare_exchange_weak(current, cell,
+                                             std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * Hands the content of the pixels [begin, end) to fn as fn(pixel, depth,
+     * point_index) and empties them; an empty pixel has a depth of zero.
+     */
+    template <typename Fn>
+    void drain(size_t begin, size_t end, Fn&& fn) {
+        for (size_t pixel = begin; pixel < end; ++pixel) {
+            const uint64_t cell =
+                cells[pixel].exchange(empty, std::memory_order_relaxed);
+            if (cell == empty) {
+                fn(pixel, 0.0f, uint32_t{0});
+                continue;
+            }
+            const auto depth_bits = static_cast<uint32_t>(cell >> 32);
+            float depth;
+            std::memcpy(&depth, &depth_bits, sizeof(depth));
+            fn(pixel, depth, static_cast<uint32_t>(cell));
+        }
+    }
+
+   private:
+    size_t size_;
+    std::unique_ptr<std::atomic<uint64_t>[]> cells;
+};
+
+/**
+ * @class CameraProjector projects the points of a lidar scan into the depth
+ * buffers of a set of cameras.
+ *
+ * Points are computed from the range and the xyz lookup table of the sensor
+ * as they are projected, rows of the scan can be projected concurrently.
+ */
+class CameraProjector {
+    struct Camera {
+        CameraConfig config;
+        Eigen::Matrix3f rotation;
+        Eigen::Vector3f translation;
+        float k[5];  // distortion coefficients, zero padded
+        CameraDepthBuffer depth;
+    };
+
+   public:
+    using PointsF = Eigen::Array<float, Eigen::Dynamic, 3>;
+
+    /**
+     * @param[in] lut_direction, lut_offset the xyz lookup table of the
+     * sensor, in the frame the camera extrinsics are relative to.
+     * @param[in] min_depth points nearer to a camera are dropped.
+     */
+    CameraProjector(const PointsF& lut_direction, const PointsF& lut_offset,
+                    const std::vector<CameraConfig>& configs,
+                    float min_depth = 0.1f)
+        : lut_direction(lut_direction),
+          lut_offset(lut_offset),
+          min_depth(min_depth) {
+        for (const auto& config : configs) {
+            if (config.width <= 0 || config.height <= 0)
+                throw std::runtime_error("camera " + config.name +
+                                         " has an invalid image size");
+            if (config.distortion.size() > 5)
+                throw std::runtime_error("camera " + config.name +
+                                         " has too many distortion "
+                                         "coefficients");
+            auto camera = std::make_unique<Camera>(Camera{
+                config, config.extrinsics.topLeftCorner<3, 3>().cast<float>(),
+                config.extrinsics.topRightCorner<3, 1>().cast<float>(),
+                {},
+                CameraDepthBuffer(size_t(config.width) * config.height)});
+            std::copy(config.distortion.begin(), config.distortion.end(),
+                      camera->k);
+            cameras.push_back(std::move(camera));
+        }
+    }
+
+    size_t cameras_count() const { return cameras.size(); }
+
+    const CameraConfig& camera(size_t i) const { return cameras[i]->config; }
+
+    CameraDepthBuffer& depth_buffer(size_t i) { return cameras[i]->depth; }
+
+    /**
+     * Projects the points [begin, end) of a scan, given by their index in
+     * the row major range image, into the depth buffers of the cameras for
+     * which active(camera) holds.
+     */
+    template <typename ActiveFn>
+    void project(const uint32_t* range, size_t begin, size_t end,
+                 ActiveFn&& active) {
+        for (size_t i = begin; i < end; ++i) {
+            if (range[i] == 0) continue;
+            const Eigen::Vector3f p =
+                (lut_direction.row(i) * static_cast<float>(range[i]) +
+                 lut_offset.row(i))
+                    .matrix()
+                    .transpose();
+            for (size_t c = 0; c < cameras.size(); ++c) {
+                if (!active(c)) continue;
+                auto& cam = *cameras[c];
+                const Eigen::Vector3f q = cam.rotation * p + cam.translation;
+                if (q.z() < min_depth) continue;
+                float u, v;
+                if (!project_point(cam, q, u, v)) continue;
+                const int iu = static_cast<int>(std::floor(u));
+                const int iv = static_cast<int>(std::floor(v));
+                if (iu < 0 || iv < 0 || iu >= cam.config.width ||
+                    iv >= cam.config.height)
+                    continue;
+                cam.depth.insert(size_t(iv) * cam.config.width + iu, q.z(),
+                                 static_cast<uint32_t>(i));
+            }
+        }
+    }
+
+   private:
+    static bool project_point(const Camera& cam, const Eigen::Vector3f& q,
+                              float& u, float& v) {
+        const float x = q.x() / q.z();
+        const float y = q.y() / q.z();
+        const float* k = cam.k;
+        float xd, yd;
+        if (cam.config.model == CameraModel::PINHOLE) {
+            const float r2 = x * x + y * y;
+            const float radial =
+                1.0f + r2 * (k[0] + r2 * (k[1] + r2 * k[4]));
+            xd = x * radial + 2.0f * k[2] * x * y + k[3] * (r2 + 2.0f * x * x);
+            yd = y * radial + k[2] * (r2 + 2.0f * y * y) + 2.0f * k[3] * x * y;
+        } else {
+            const float r = std::sqrt(x * x + y * y);
+            if (r < 1e-8f) {
+                xd = x;
+                yd = y;
+            } else {
+                const float theta = std::atan(r);
+                const float t2 = theta * theta;
+                const float theta_d =
+                    theta *
+                    (1.0f + t2 * (k[0] + t2 * (k[1] + t2 * (k[2] + t2 * k[3]))));
+                xd = x * theta_d / r;
+                yd = y * theta_d / r;
+            }
+        }
+        u = static_cast<float>(cam.config.fx) * xd +
+            static_cast<float>(cam.config.cx);
+        v = static_cast<float>(cam.config.fy) * yd +
+            static_cast<float>(cam.config.cy);
+        return std::isfinite(u) && std::isfinite(v);
+    }
+
+   private:
+    PointsF lut_direction;
+    PointsF lut_offset;
+    float min_depth;
+    std::vector<std::unique_ptr<Camera>> cameras;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,316 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file camera_projection_processor.h
+ * @brief takes in a lidar scan object and produces sparse depth and intensity
+ * images in the image planes of a set of cameras
+ */
+
+#pragma once
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <ros/console.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+#include <xmlrpcpp/XmlRpcValue.h>
+
+#include "camera_projection.h"
+#include "lidar_packet_handler.h"
+#include "message_pool.h"
+#include "parallel_for.h"
+
+namespace ouster_ros {
+
+namespace sensor = ouster::sensor;
+
+struct CameraProjectionConfig {
+    std::vector<CameraConfig> cameras;
+    int threads = 4;
+    double min_depth = 0.1;  // meters
+
+    /**
+     * Reads the config from the parameters: camera_projection_threads,
+     * camera_projection_min_depth and camera_projection_cameras. The latter
+     * is a list with a dictionary per camera holding: name, frame_id
+     * (defaults to the name), model (pinhole or equidistant), width, height,
+     * K (the 3x3 camera matrix, row major), D (distortion coefficients) and
+     * extrinsics (the 4x4 transform from the point cloud frame to the camera
+     * optical frame, row major). Cameras that can't be read are reported
+     * and skipped, the list of cameras is empty when none can.
+     */
+    static CameraProjectionConfig from_parameters(const ros::NodeHandle& pnh) {
+        CameraProjectionConfig config;
+        config.threads = pnh.param("camera_projection_threads", config.threads);
+        config.min_depth =
+            pnh.param("camera_projection_min_depth", config.min_depth);
+
+        XmlRpc::XmlRpcValue cameras;
+        if (!pnh.getParam("camera_projection_cameras", cameras) ||
+            cameras.getType() != XmlRpc::XmlRpcValue::TypeArray ||
+            cameras.size() == 0) {
+            ROS_WARN("camera_projection_cameras must list at least one camera");
+            return config;
+        }
+        for (int i = 0; i < cameras.size(); ++i) {
+            try {
+                config.cameras.push_back(camera_of_xmlrpc(cameras[i]));
+            } catch (const std::runtime_error& e) {
+                ROS_WARN_STREAM("camera " << i << " skipped: " << e.what());
+            } catch (const XmlRpc::XmlRpcException& e) {
+                ROS_WARN_STREAM("camera " << i
+                                << " skipped: " << e.getMessage());
+            }
+        }
+        return config;
+    }
+
+   private:
+    static double to_double(XmlRpc::XmlRpcValue& value) {
+        if (value.getType() == XmlRpc::XmlRpcValue::TypeInt)
+            return static_cast<int>(value);
+        if (value.getType() == XmlRpc::XmlRpcValue::TypeDouble)
+            return static_cast<double>(value);
+        throw std::runtime_error("camera_projection_cameras: number expected");
+    }
+
+    static std::vector<double> to_doubles(XmlRpc::XmlRpcValue& value) {
+        if (value.getType() != XmlRpc::XmlRpcValue::TypeArray)
+            throw std::runtime_error(
+                "camera_projection_cameras: list expected");
+        std::vector<double> values;
+        for (int i = 0; i < value.size(); ++i)
+            values.push_back(to_double(value[i]));
+        return values;
+    }
+
+    static CameraConfig camera_of_xmlrpc(XmlRpc::XmlRpcValue& value) {
+        if (value.getType() != XmlRpc::XmlRpcValue::TypeStruct ||
+            !value.hasMember("name") || !value.hasMember("width") ||
+            !value.hasMember("height") || !value.hasMember("K") ||
+            !value.hasMember("extrinsics"))
+            throw std::runtime_error(
+                "camera_projection_cameras: each camera needs a name, width, "
+                "height, K and extrinsics");
+
+        CameraConfig camera;
+        camera.name = static_cast<std::string>(value["name"]);
+        camera.frame_id = value.hasMember("frame_id")
+                              ? static_cast<std::string>(value["frame_id"])
+                              : camera.name;
+        if (value.hasMember("model"))
+            camera.model =
+                camera_model_of_string(static_cast<std::string>(value["model"]));
+        camera.width = static_cast<int>(to_double(value["width"]));
+        camera.height = static_cast<int>(to_double(value["height"]));
+
+        auto K = to_doubles(value["K"]);
+        if (K.size() != 9)
+            throw std::runtime_error("camera " + camera.name +
+                                     ": K must hold 9 values");
+        camera.fx = K[0];
+        camera.cx = K[2];
+        camera.fy = K[4];
+        camera.cy = K[5];
+        if (value.hasMember("D")) camera.distortion = to_doubles(value["D"]);
+
+        auto T = to_doubles(value["extrinsics"]);
+        if (T.size() != 16)
+            throw std::runtime_error("camera " + camera.name +
+                                     ": extrinsics must hold 16 values");
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 4; ++c) camera.extrinsics(r, c) = T[r * 4 + c];
+        return camera;
+    }
+};
+
+/**
+ * @class CameraProjectionProcessor projects the points of the first return
+ * of every scan into the image plane of each configured camera and produces
+ * a sparse depth image (32FC1, distance along the optical axis in meters)
+ * and a sparse intensity image (mono16, the signal, or the reflectivity for
+ * profiles without signal) per camera; pixels no point projects onto are
+ * zero and the nearest point wins where several do.
+ *
+ * The projection is split by rows of the scan across a fixed set of threads
+ * that share lock free z-buffers, the images are then filled split by rows
+ * of the image. All buffers are allocated upfront.
+ */
+class CameraProjectionProcessor {
+   public:
+    struct CameraImages {
+        sensor_msgs::ImageConstPtr depth;
+        sensor_msgs::ImageConstPtr intensity;
+    };
+
+    using OutputType = std::vector<CameraImages>;
+    using PostProcessingFn = std::function<void(OutputType)>;
+
+   public:
+    CameraProjectionProcessor(const ouster::sensor::sensor_info& info,
+                              bool apply_lidar_to_sensor_transform,
+                              const CameraProjectionConfig& config,
+                              PostProcessingFn func,
+                              OutputActiveFn output_active_fn = {})
+        : W(info.format.columns_per_frame),
+          H(info.format.pixels_per_column),
+          projector(make_projector(info, apply_lidar_to_sensor_transform,
+                                   config)),
+          parallel_for(config.threads),
+          intensity(H, W),
+          camera_active(config.cameras.size(), 0),
+          output_msgs(config.cameras.size()),
+          post_processing_fn(func),
+          output_active_fn(output_active_fn) {
+        using namespace sensor_msgs::image_encodings;
+        for (const auto& camera : config.cameras) {
+            depth_pools.push_back(make_pool(camera, TYPE_32FC1, 4));
+            intensity_pools.push_back(make_pool(camera, MONO16, 2));
+        }
+    }
+
+   private:
+    static CameraProjector make_projector(
+        const ouster::sensor::sensor_info& info,
+        bool apply_lidar_to_sensor_transform,
+        const CameraProjectionConfig& config) {
+        ouster::mat4d additional_transform =
+            apply_lidar_to_sensor_transform ? info.lidar_to_sensor_transform
+                                            : ouster::mat4d::Identity();
+        auto xyz_lut = ouster::make_xyz_lut(
+            info.format.columns_per_frame, info.format.pixels_per_column,
+            ouster::sensor::range_unit, info.beam_to_lidar_transform,
+            additional_transform, info.beam_azimuth_angles,
+            info.beam_altitude_angles);
+        return CameraProjector(xyz_lut.direction.cast<float>(),
+                               xyz_lut.offset.cast<float>(), config.cameras,
+                               static_cast<float>(config.min_depth));
+    }
+
+    static std::unique_ptr<MessagePool<sensor_msgs::Image>> make_pool(
+        const CameraConfig& camera, const std::string& encoding,
+        size_t bytes_per_pixel) {
+        return std::make_unique<MessagePool<sensor_msgs::Image>>(
+            msg_pool_size,
+            [camera, encoding, bytes_per_pixel](sensor_msgs::Image& msg) {
+                msg.width = camera.width;
+                msg.height = camera.height;
+                msg.step = camera.width * bytes_per_pixel;
+                msg.encoding = encoding;
+                msg.data.resize(msg.height * msg.step);
+                msg.header.frame_id = camera.frame_id;
+            },
+            [name = camera.name](size_t count) {
+                ROS_WARN_STREAM_THROTTLE(
+                    10, "projection image message pool of camera "
+                            << name << " exhausted " << count << " times, "
+                            << "subscribers are holding on to messages for "
+                               "too long");
+            });
+    }
+
+    bool output_active(int camera) const {
+        return !output_active_fn || output_active_fn(camera);
+    }
+
+    void read_intensity(const ouster::LidarScan& lidar_scan) {
+        auto field = lidar_scan.field_type(sensor::ChanField::SIGNAL)
+                         ? sensor::ChanField::SIGNAL
+                         : sensor::ChanField::REFLECTIVITY;
+        if (!lidar_scan.field_type(field)) {
+            intensity.setZero();
+            return;
+        }
+        ouster::impl::visit_field(lidar_scan, field, impl::read_and_cast(),
+                                  intensity);
+    }
+
+    void process(const ouster::LidarScan& lidar_scan, uint64_t,
+                 const ros::Time& msg_ts) {
+        bool any_active = false;
+        for (size_t c = 0; c < camera_active.size(); ++c) {
+            camera_active[c] = output_active(static_cast<int>(c));
+            any_active |= camera_active[c] != 0;
+        }
+        if (!any_active) return;
+
+        read_intensity(lidar_scan);
+        auto range = lidar_scan.field<uint32_t>(sensor::ChanField::RANGE);
+        const uint32_t* range_data = range.data();
+        auto is_active = [this](size_t c) { return camera_active[c] != 0; };
+        parallel_for(H, [&](size_t begin, size_t end) {
+            projector.project(range_data, begin * W, end * W, is_active);
+        });
+
+        const uint16_t* intensity_data = intensity.data();
+        for (size_t c = 0; c < camera_active.size(); ++c) {
+            if (!camera_active[c]) continue;
+            // messages acquired from the pools are not referenced by any
+            // subscriber, every pixel of them is overwritten below
+            auto depth_msg = depth_pools[c]->acquire();
+            auto intensity_msg = intensity_pools[c]->acquire();
+            auto* depth_px = reinterpret_cast<float*>(depth_msg->data.data());
+            auto* intensity_px =
+                reinterpret_cast<uint16_t*>(intensity_msg->data.data());
+            const size_t width = depth_msg->width;
+            auto& depth_buffer = projector.depth_buffer(c);
+            parallel_for(depth_msg->height, [&](size_t begin, size_t end) {
+                depth_buffer.drain(
+                    begin * width, end * width,
+                    [&](size_t pixel, float depth, uint32_t point) {
+                        depth_px[pixel] = depth;
+                        intensity_px[pixel] =
+                            depth > 0.0f ? intensity_data[point] : 0;
+                    });
+            });
+            depth_msg->header.stamp = msg_ts;
+            intensity_msg->header.stamp = msg_ts;
+            output_msgs[c] = {depth_msg, intensity_msg};
+        }
+
+        post_processing_fn(output_msgs);
+
+        // don't hold on to published messages, so they could be recycled
+        for (auto& msgs : output_msgs) msgs = {};
+    }
+
+   public:
+    static LidarScanProcessor create(const ouster::sensor::sensor_info& info,
+                                     bool apply_lidar_to_sensor_transform,
+                                     const CameraProjectionConfig& config,
+                                     PostProcessingFn func,
+                                     OutputActiveFn output_active_fn = {}) {
+        auto handler = std::make_shared<CameraProjectionProcessor>(
+            info, apply_lidar_to_sensor_transform, config, func,
+            output_active_fn);
+
+        return [handler](const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
+                         const ros::Time& msg_ts) {
+            handler->process(lidar_scan, scan_ts, msg_ts);
+        };
+    }
+
+   private:
+    // number of preallocated messages per camera and image
+    static constexpr size_t msg_pool_size = 4;
+
+    const size_t W;
+    const size_t H;
+    CameraProjector projector;
+    ParallelFor parallel_for;
+    ouster::img_t<uint16_t> intensity;
+    std::vector<char> camera_active;
+    OutputType output_msgs;
+    std::vector<std::unique_ptr<MessagePool<sensor_msgs::Image>>> depth_pools;
+    std::vector<std::unique_ptr<MessagePool<sensor_msgs::Image>>>
+        intensity_pools;
+    PostProcessingFn post_processing_fn;
+    OutputActiveFn output_active_fn;
+};
+
+}  // namespace ouster_ros
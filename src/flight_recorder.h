@@ -0,0 +1,184 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file flight_recorder.h
+ * @brief Keeps the most recent raw sensor packets in preallocated memory so
+ * they can be dumped to disk after the fact
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "packet_source.h"
+
+namespace ouster_ros {
+
+/**
+ * @class PacketHistory a preallocated circular store of fixed size packets
+ * with a single writer that never waits.
+ *
+ * Packets are numbered in the order they are written, packet n occupies slot
+ * n % capacity. Every slot carries the number of the packet it holds plus
+ * one, which the writer clears before overwriting the slot and sets once the
+ * packet is complete; readers copy a slot and then check that the number is
+ * unchanged (a per slot sequence lock), so a packet that got overwritten
+ * while it was read is detected and reported as lost instead of returned
+ * torn.
+ */
+class PacketHistory {
+    struct Slot {
+        std::atomic<uint64_t> seq = {0};
+        uint64_t timestamp = 0;
+    };
+
+   public:
+    PacketHistory(size_t packet_size, size_t capacity)
+        : packet_size_(packet_size),
+          capacity_(capacity),
+          slots(new Slot[capacity]),
+          // value initialized so pages are committed up front rather than on
+          // the first write to each of them
+          data(packet_size * capacity, 0) {}
+
+    size_t packet_size() const { return packet_size_; }
+
+    size_t capacity() const { return capacity_; }
+
+    // number of the next packet to be written
+    uint64_t head() const { return head_.load(std::memory_order_acquire); }
+
+    void write(const uint8_t* packet, uint64_t timestamp) {
+        const uint64_t n = head_.load(std::memory_order_relaxed);
+        Slot& slot = slots[n % capacity_];
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(data.data() + (n % capacity_) * packet_size_, packet,
+                    packet_size_);
+        slot.timestamp = timestamp;
+        slot.seq.store(n + 1, std::memory_order_release);
+        head_.store(n + 1, std::memory_order_release);
+    }
+
+    /**
+     * Copies packet n into out, which must hold packet_size() bytes.
+     * @return false if the packet is no longer (or not yet) in the store.
+     */
+    bool read(uint64_t n, uint8_t* out, uint64_t& timestamp) const {
+        const Slot& slot = slots[n % capacity_];
+        if (slot.seq.load(std::memory_order_acquire) != n + 1) return false;
+        std::memcpy(out, data.data() + (n % capacity_) * packet_size_,
+                    packet_size_);
+        timestamp = slot.timestamp;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.seq.load(std::memory_order_relaxed) == n + 1;
+    }
+
+   private:
+    const size_t packet_size_;
+    const size_t capacity_;
+    std::unique_ptr<Slot[]> slots;
+    std::vector<uint8_t> data;
+    std::atomic<uint64_t> head_ = {0};
+};
+
+/**
+ * @class FlightRecorder holds the most recent lidar and imu packets.
+ *
+ * Recording a packet costs a copy into preallocated memory and is safe to do
+ * from the thread that receives packets while a dump runs on another thread;
+ * packets the receiving thread overwrites before the dump reaches them are
+ * counted as lost.
+ */
+class FlightRecorder {
+   public:
+    struct DumpStats {
+        size_t lidar_packets = 0;
+        size_t imu_packets = 0;
+        size_t lost_packets = 0;
+    };
+
+    FlightRecorder(size_t lidar_packet_size, size_t lidar_capacity,
+                   size_t imu_packet_size, size_t imu_capacity)
+        : lidar(lidar_packet_size, lidar_capacity),
+          imu(imu_packet_size, imu_capacity) {}
+
+    size_t lidar_capacity() const { return lidar.capacity(); }
+
+    size_t imu_capacity() const { return imu.capacity(); }
+
+    void record_lidar_packet(const uint8_t* packet, uint64_t timestamp) {
+        lidar.write(packet, timestamp);
+    }
+
+    void record_imu_packet(const uint8_t* packet, uint64_t timestamp) {
+        imu.write(packet, timestamp);
+    }
+
+    /**
+     * Hands the packets held at the time of the call to write in the order
+     * of their timestamps, as write(PacketKind, timestamp, data, size).
+     */
+    template <typename WriteFn>
+    DumpStats dump(WriteFn&& write) const {
+        DumpStats stats;
+        Cursor lidar_cursor(lidar), imu_cursor(imu);
+        lidar_cursor.advance(stats);
+        imu_cursor.advance(stats);
+        while (lidar_cursor.valid || imu_cursor.valid) {
+            const bool take_lidar =
+                lidar_cursor.valid &&
+                (!imu_cursor.valid ||
+                 lidar_cursor.timestamp <= imu_cursor.timestamp);
+            if (take_lidar) {
+                write(PacketKind::LIDAR, lidar_cursor.timestamp,
+                      lidar_cursor.buffer.data(), lidar.packet_size());
+                ++stats.lidar_packets;
+                lidar_cursor.advance(stats);
+            } else {
+                write(PacketKind::IMU, imu_cursor.timestamp,
+                      imu_cursor.buffer.data(), imu.packet_size());
+                ++stats.imu_packets;
+                imu_cursor.advance(stats);
+            }
+        }
+        return stats;
+    }
+
+   private:
+    // iterates over the packets a history held when the cursor was created
+    struct Cursor {
+        explicit Cursor(const PacketHistory& history)
+            : history(history),
+              end(history.head()),
+              next(end > history.capacity() ? end - history.capacity() : 0),
+              buffer(history.packet_size()) {}
+
+        // reads the next packet still available into the buffer
+        void advance(DumpStats& stats) {
+            valid = false;
+            while (next < end && !valid) {
+                valid = history.read(next++, buffer.data(), timestamp);
+                if (!valid) ++stats.lost_packets;
+            }
+        }
+
+        const PacketHistory& history;
+        const uint64_t end;
+        uint64_t next;
+        std::vector<uint8_t> buffer;
+        uint64_t timestamp = 0;
+        bool valid = false;
+    };
+
+   private:
+    PacketHistory lidar;
+    PacketHistory imu;
+};
+
+}  // namespace ouster_ros
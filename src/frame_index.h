@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file frame_index.h
+ * @brief An index of the frames of a packet recording that allows replaying
+ * the recording from any frame without reading the packets ahead of it
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lidar_packet_handler.h"
+#include "packet_source.h"
+
+namespace ouster_ros {
+
+/**
+ * A frame index file holds a FrameIndexHeader followed by one
+ * FrameIndexEntry per frame, in the order of the recording.
+ */
+namespace frame_index {
+
+constexpr char magic[8] = {'O', 'S', 'F', 'R', 'M', 'I', 'D', 'X'};
+constexpr uint32_t version = 1;
+constexpr const char* file_extension = ".frames";
+
+struct FrameIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint64_t entry_count;
+    uint64_t recording_size;  // size of the indexed recording in bytes
+};
+
+static_assert(sizeof(FrameIndexHeader) == 32, "unexpected index header size");
+
+}  // namespace frame_index
+
+struct FrameIndexEntry {
+    uint64_t position;          // PacketSource position of the first packet
+    uint64_t timestamp;         // recording time of the first packet
+    uint64_t sensor_timestamp;  // first column timestamp of the first packet
+    uint64_t prev_last_col_ts;  // LidarScanTimestampState of the frame
+    int32_t prev_last_col_idx;
+    uint32_t frame_id;
+
+    LidarScanTimestampState timestamp_state() const {
+        return {prev_last_col_idx, prev_last_col_ts};
+    }
+};
+
+static_assert(sizeof(FrameIndexEntry) == 40, "unexpected index entry size");
+
+/**
+ * @class FrameIndex maps the frames of a recording, by their number within
+ * the recording, their frame id or their sensor timestamp, to the position
+ * of their first packet along with the timestamp interpolation state needed
+ * to process the recording starting from that frame.
+ */
+class FrameIndex {
+   public:
+    size_t size() const { return entries.size(); }
+
+    const FrameIndexEntry& operator[](size_t frame) const {
+        return entries[frame];
+    }
+
+    uint64_t recording_size() const { return recording_size_; }
+
+    /**
+     * Finds the first frame of the recording with the given frame id.
+     * @return the number of the frame or -1 if there is none.
+     */
+    int64_t find_frame_id(uint32_t frame_id) const {
+        auto it = first_of_frame_id.find(frame_id);
+        return it == first_of_frame_id.end() ? -1 : it->second;
+    }
+
+    /**
+     * Finds the first frame whose sensor timestamp is not before the given
+     * one, sensor timestamps are assumed to increase through the recording.
+     * @return the number of the frame or -1 if there is none.
+     */
+    int64_t find_sensor_timestamp(uint64_t sensor_timestamp) const {
+        auto it = std::lower_bound(
+            entries.begin(), entries.end(), sensor_timestamp,
+            [](const FrameIndexEntry& e, uint64_t ts) {
+                return e.sensor_timestamp < ts;
+            });
+        return it == entries.end() ? -1 : it - entries.begin();
+    }
+
+    void save(const std::string& path) const {
+        frame_index::FrameIndexHeader header{};
+        std::memcpy(header.magic, frame_index::magic, sizeof(header.magic));
+        header.version = frame_index::version;
+        header.entry_size = sizeof(FrameIndexEntry);
+        header.entry_count = entries.size();
+        header.recording_size = recording_size_;
+
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ofs.write(reinterpret_cast<const char*>(entries.data()),
+                  entries.size() * sizeof(FrameIndexEntry));
+        if (!ofs) throw std::runtime_error("failed to write " + path);
+    }
+
+    static FrameIndex load(const std::string& path) {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs) throw std::runtime_error("failed to open " + path);
+        frame_index::FrameIndexHeader header;
+        ifs.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!ifs ||
+            std::memcmp(header.magic, frame_index::magic,
+                        sizeof(header.magic)) != 0 ||
+            header.version != frame_index::version ||
+            header.entry_size != sizeof(FrameIndexEntry))
+            throw std::runtime_error(path + " is not a frame index");
+
+        FrameIndex index;
+        index.recording_size_ = header.recording_size;
+        index.entries.resize(header.entry_count);
+        ifs.read(reinterpret_cast<char*>(index.entries.data()),
+                 index.entries.size() * sizeof(FrameIndexEntry));
+        if (!ifs) throw std::runtime_error(path + " is truncated");
+        index.update_lookup();
+        return index;
+    }
+
+   private:
+    friend class FrameIndexBuilder;
+
+    void update_lookup() {
+        first_of_frame_id.clear();
+        for (size_t i = 0; i < entries.size(); ++i)
+            first_of_frame_id.emplace(entries[i].frame_id, i);
+    }
+
+   private:
+    std::vector<FrameIndexEntry> entries;
+    uint64_t recording_size_ = 0;
+    std::unordered_map<uint32_t, int64_t> first_of_frame_id;
+};
+
+/**
+ * @class FrameIndexBuilder accumulates the lidar packets of a recording, in
+ * recording order, into a FrameIndex.
+ */
+class FrameIndexBuilder {
+   public:
+    /**
+     * @param[in] last_col_idx index of the last column of the packet
+     * that holds a timestamp, -1 if none does.
+     */
+    void add_lidar_packet(uint64_t position, uint64_t timestamp,
+                          uint32_t frame_id, uint64_t first_col_ts,
+                          int last_col_idx, uint64_t last_col_ts) {
+        if (!in_frame || frame_id != current_frame_id) {
+            if (in_frame && frame_last_col_idx >= 0)
+                prev_state = {frame_last_col_idx, frame_last_col_ts};
+            index.entries.push_back(
+                FrameIndexEntry{position, timestamp, first_col_ts,
+                                prev_state.last_col_ts,
+                                prev_state.last_col_idx, frame_id});
+            in_frame = true;
+            current_frame_id = frame_id;
+            frame_last_col_idx = -1;
+            frame_last_col_ts = 0;
+        }
+        if (last_col_idx > frame_last_col_idx) {
+            frame_last_col_idx = last_col_idx;
+            frame_last_col_ts = last_col_ts;
+        }
+    }
+
+    FrameIndex finish(uint64_t recording_size) {
+        index.recording_size_ = recording_size;
+        index.update_lookup();
+        return std::move(index);
+    }
+
+   private:
+    FrameIndex index;
+    bool in_frame = false;
+    uint32_t current_frame_id = 0;
+    int frame_last_col_idx = -1;
+    uint64_t frame_last_col_ts = 0;
+    LidarScanTimestampState prev_state;
+};
+
+/**
+ * Builds the frame index of a recording by reading all of its packets, the
+ * source is left at the end of the recording.
+ */
+inline FrameIndex build_frame_index(PacketSource& source,
+                                    const ouster::sensor::packet_format& pf,
+                                    uint64_t recording_size) {
+    FrameIndexBuilder builder;
+    ReplayPacket packet;
+    source.rewind();
+    while (source.next(packet)) {
+        if (packet.kind != PacketKind::LIDAR ||
+            packet.size != pf.lidar_packet_size)
+            continue;
+        // mirror ScanBatcher which only keeps the timestamps of valid columns
+        uint64_t first_col_ts = 0, last_col_ts = 0;
+        int last_col_idx = -1;
+        for (int icol = 0; icol < pf.columns_per_packet; ++icol) {
+            const uint8_t* col = pf.nth_col(icol, packet.data);
+            if (!(pf.col_status(col) & 0x01)) continue;
+            const uint64_t ts = pf.col_timestamp(col);
+            if (ts == 0) continue;
+            if (first_col_ts == 0) first_col_ts = ts;
+            const int idx = pf.col_measurement_id(col);
+            if (idx > last_col_idx) {
+                last_col_idx = idx;
+                last_col_ts = ts;
+            }
+        }
+        builder.add_lidar_packet(packet.position, packet.timestamp,
+                                 pf.frame_id(packet.data), first_col_ts,
+                                 last_col_idx, last_col_ts);
+    }
+    return builder.finish(recording_size);
+}
+
+}  // namespace ouster_ros
@@ -14,172 +14,510 @@
 #include "ouster_ros/os_ros.h"
 // clang-format on
 
+#include <ros/console.h>
 #include <sensor_msgs/image_encodings.h>
 
+#include <limits>
+#include <type_traits>
+
+#include "ouster_ros/ImageStack.h"
+
 #include "ouster/image_processing.h"
+#include "auto_exposure.h"
+#include "lidar_packet_handler.h"
+#include "message_pool.h"
 
 namespace ouster_ros {
 
 namespace sensor = ouster::sensor;
 namespace viz = ouster::viz;
 
+/**
+ * Controls how often the auto exposure and the beam uniformity correction of
+ * the images are updated, the corrections are applied on every frame, and the
+ * encoding of the images of each channel.
+ *
+ * Supported encodings are:
+ * - mono16: range in 4 mm units (up to ~262 m), other channels auto exposed.
+ * - 16UC1: the raw field values, range in mm (up to ~65 m, zero beyond),
+ *   other channels saturate at 65535.
+ * - mono8: auto exposed, not available for range.
+ * - 32FC1: range in meters, other channels hold the raw field values.
+ */
+struct ImageProcessorConfig {
+    int ae_update_every = 3;
+    double ae_update_period = 0.0;  // seconds, overrides ae_update_every
+    int buc_update_every = 1;
+    std::string range_encoding = sensor_msgs::image_encodings::MONO16;
+    std::string signal_encoding = sensor_msgs::image_encodings::MONO16;
+    std::string reflec_encoding = sensor_msgs::image_encodings::MONO16;
+    std::string nearir_encoding = sensor_msgs::image_encodings::MONO16;
+
+    /**
+     * Reads the config from the parameters: image_ae_update_every,
+     * image_ae_update_period, image_buc_update_every, range_image_encoding,
+     * signal_image_encoding, reflec_image_encoding and nearir_image_encoding.
+     */
+    static ImageProcessorConfig from_parameters(const ros::NodeHandle& pnh) {
+        ImageProcessorConfig config;
+        config.ae_update_every =
+            pnh.param("image_ae_update_every", config.ae_update_every);
+        config.ae_update_period =
+            pnh.param("image_ae_update_period", config.ae_update_period);
+        config.buc_update_every =
+            pnh.param("image_buc_update_every", config.buc_update_every);
+        config.range_encoding =
+            pnh.param("range_image_encoding", config.range_encoding);
+        config.signal_encoding =
+            pnh.param("signal_image_encoding", config.signal_encoding);
+        config.reflec_encoding =
+            pnh.param("reflec_image_encoding", config.reflec_encoding);
+        config.nearir_encoding =
+            pnh.param("nearir_image_encoding", config.nearir_encoding);
+        return config;
+    }
+};
+
 class ImageProcessor {
    public:
     using OutputType =
-        std::map<sensor::ChanField, std::shared_ptr<sensor_msgs::Image>>;
+        std::map<sensor::ChanField, sensor_msgs::ImageConstPtr>;
     using PostProcessingFn = std::function<void(OutputType)>;
+    using StackPostProcessingFn =
+        std::function<void(ouster_ros::ImageStackConstPtr)>;
+    // determines whether the image of a given channel has any subscribers
+    using ChannelActiveFn = std::function<bool(sensor::ChanField)>;
 
    public:
     ImageProcessor(const ouster::sensor::sensor_info& info,
-                   const std::string& frame_id, PostProcessingFn func)
-        : frame(frame_id), post_processing_fn(func), info_(info) {
+                   const std::string& frame_id, PostProcessingFn func,
+                   ChannelActiveFn active_fn = {},
+                   const ImageProcessorConfig& config = {})
+        : ImageProcessor(info, frame_id, active_fn, config) {
+        post_processing_fn = func;
         uint32_t H = info.format.pixels_per_column;
         uint32_t W = info.format.columns_per_frame;
 
-        image_msgs[sensor::ChanField::RANGE] =
-            std::make_shared<sensor_msgs::Image>();
-        image_msgs[sensor::ChanField::SIGNAL] =
-            std::make_shared<sensor_msgs::Image>();
-        image_msgs[sensor::ChanField::REFLECTIVITY] =
-            std::make_shared<sensor_msgs::Image>();
-        image_msgs[sensor::ChanField::NEAR_IR] =
-            std::make_shared<sensor_msgs::Image>();
+        for (auto channel : channels) {
+            auto encoding = channel_encodings[channel];
+            image_msg_pools[channel] =
+                std::make_unique<MessagePool<sensor_msgs::Image>>(
+                    msg_pool_size,
+                    [this, H, W, encoding](sensor_msgs::Image& msg) {
+                        init_image_msg(msg, H, W, frame, encoding);
+                    },
+                    [channel](size_t count) {
+                        ROS_WARN_STREAM_THROTTLE(
+                            10, "image message pool of channel "
+                                    << sensor::to_string(channel)
+                                    << " exhausted " << count << " times, "
+                                    << "subscribers are holding on to "
+                                       "messages for too long");
+                    });
+            image_msgs[channel] = nullptr;
+            output_msgs[channel] = nullptr;
+        }
+    }
+
+    /**
+     * Constructs a processor that publishes all images of a frame as a single
+     * ImageStack message.
+     */
+    ImageProcessor(const ouster::sensor::sensor_info& info,
+                   const std::string& frame_id, StackPostProcessingFn func,
+                   ChannelActiveFn active_fn = {},
+                   const ImageProcessorConfig& config = {})
+        : ImageProcessor(info, frame_id, active_fn, config) {
+        stack_post_processing_fn = func;
+        uint32_t H = info.format.pixels_per_column;
+        uint32_t W = info.format.columns_per_frame;
+        stack_msg_pool = std::make_unique<MessagePool<ouster_ros::ImageStack>>(
+            msg_pool_size,
+            [this, H, W](ouster_ros::ImageStack& msg) {
+                init_stack_msg(msg, H, W);
+            },
+            [](size_t count) {
+                ROS_WARN_STREAM_THROTTLE(
+                    10, "image stack message pool exhausted "
+                            << count << " times, subscribers are holding on "
+                            << "to messages for too long");
+            });
+    }
+
+   private:
+    ImageProcessor(const ouster::sensor::sensor_info& info,
+                   const std::string& frame_id, ChannelActiveFn active_fn,
+                   const ImageProcessorConfig& config)
+        : frame(frame_id),
+          channel_active_fn(active_fn),
+          info_(info),
+          nearir_ae(0.1, 0.1, config.ae_update_every, config.ae_update_period),
+          signal_ae(0.1, 0.1, config.ae_update_every, config.ae_update_period),
+          reflec_ae(0.1, 0.1, config.ae_update_every, config.ae_update_period),
+          nearir_buc(config.buc_update_every) {
+        uint32_t H = info.format.pixels_per_column;
+        uint32_t W = info.format.columns_per_frame;
+
+        channels = {sensor::ChanField::RANGE, sensor::ChanField::SIGNAL,
+                    sensor::ChanField::REFLECTIVITY, sensor::ChanField::NEAR_IR};
         if (get_n_returns(info) == 2) {
-            image_msgs[sensor::ChanField::RANGE2] =
-                std::make_shared<sensor_msgs::Image>();
-            image_msgs[sensor::ChanField::SIGNAL2] =
-                std::make_shared<sensor_msgs::Image>();
-            image_msgs[sensor::ChanField::REFLECTIVITY2] =
-                std::make_shared<sensor_msgs::Image>();
+            channels.push_back(sensor::ChanField::RANGE2);
+            channels.push_back(sensor::ChanField::SIGNAL2);
+            channels.push_back(sensor::ChanField::REFLECTIVITY2);
         }
+        for (auto channel : channels) channel_buffers[channel] = nullptr;
 
-        for (auto it = image_msgs.begin(); it != image_msgs.end(); ++it) {
-            init_image_msg(*it->second, H, W, frame);
+        const std::map<sensor::ChanField, std::string> encodings{
+            {sensor::ChanField::RANGE, config.range_encoding},
+            {sensor::ChanField::SIGNAL, config.signal_encoding},
+            {sensor::ChanField::REFLECTIVITY, config.reflec_encoding},
+            {sensor::ChanField::NEAR_IR, config.nearir_encoding}};
+        for (auto channel : channels) {
+            // both returns share the encoding of the channel
+            auto base = impl::suitable_return(channel, false);
+            channel_encodings[channel] =
+                parse_encoding(encodings.at(base), base);
         }
+
+        signal_image.resize(H, W);
+        reflec_image.resize(H, W);
+        nearir_image.resize(H, W);
     }
 
    private:
-    using pixel_type = uint16_t;
-    const size_t pixel_value_max = std::numeric_limits<pixel_type>::max();
+    enum class Encoding { MONO8, MONO16, RAW16, FLOAT32 };
+
+    static Encoding parse_encoding(const std::string& encoding,
+                                   sensor::ChanField channel) {
+        namespace enc = sensor_msgs::image_encodings;
+        if (encoding == enc::MONO16) return Encoding::MONO16;
+        if (encoding == enc::TYPE_16UC1) return Encoding::RAW16;
+        if (encoding == enc::TYPE_32FC1) return Encoding::FLOAT32;
+        if (encoding == enc::MONO8 && channel != sensor::ChanField::RANGE)
+            return Encoding::MONO8;
+        ROS_WARN_STREAM("unsupported encoding '"
+                        << encoding << "' of " << sensor::to_string(channel)
+                        << " image, supported encodings are: "
+                        << (channel == sensor::ChanField::RANGE ? ""
+                                                                : "mono8, ")
+                        << "mono16, 16UC1 and 32FC1; using mono16");
+        return Encoding::MONO16;
+    }
+
+    static const std::string& encoding_name(Encoding encoding) {
+        namespace enc = sensor_msgs::image_encodings;
+        switch (encoding) {
+            case Encoding::MONO8:
+                return enc::MONO8;
+            case Encoding::RAW16:
+                return enc::TYPE_16UC1;
+            case Encoding::FLOAT32:
+                return enc::TYPE_32FC1;
+            default:
+                return enc::MONO16;
+        }
+    }
+
+    static size_t bytes_per_pixel(Encoding encoding) {
+        switch (encoding) {
+            case Encoding::MONO8:
+                return sizeof(uint8_t);
+            case Encoding::FLOAT32:
+                return sizeof(float);
+            default:
+                return sizeof(uint16_t);
+        }
+    }
 
     static void init_image_msg(sensor_msgs::Image& msg, size_t H, size_t W,
-                               const std::string& frame) {
+                               const std::string& frame, Encoding encoding) {
         msg.width = W;
         msg.height = H;
-        msg.step = W * sizeof(pixel_type);
-        // TODO: allow choosing higher image encoding representation
-        msg.encoding = sensor_msgs::image_encodings::MONO16;
-        msg.data.resize(W * H * sizeof(pixel_type));
+        msg.step = W * bytes_per_pixel(encoding);
+        msg.encoding = encoding_name(encoding);
+        msg.data.resize(H * msg.step);
         msg.header.frame_id = frame;
     }
 
+    void init_stack_msg(ouster_ros::ImageStack& msg, size_t H,
+                        size_t W) const {
+        msg.header.frame_id = frame;
+        msg.height = H;
+        msg.width = W;
+        msg.channels.clear();
+        msg.encodings.clear();
+        msg.offsets.clear();
+        size_t offset = 0;
+        for (auto channel : channels) {
+            auto encoding = channel_encodings.at(channel);
+            msg.channels.push_back(sensor::to_string(channel));
+            msg.encodings.push_back(encoding_name(encoding));
+            msg.offsets.push_back(static_cast<uint32_t>(offset));
+            offset += W * H * bytes_per_pixel(encoding);
+        }
+        msg.data.resize(offset);
+    }
+
    private:
-    void process(const ouster::LidarScan& lidar_scan, uint64_t,
+    bool channel_active(sensor::ChanField channel) const {
+        return !channel_active_fn || channel_active_fn(channel);
+    }
+
+    void process(const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
                  const ros::Time& msg_ts) {
-        process_return(lidar_scan, 0);
-        if (get_n_returns(info_) == 2) process_return(lidar_scan, 1);
+        if (stack_post_processing_fn) {
+            process_stack(lidar_scan, scan_ts, msg_ts);
+            return;
+        }
+
+        // a message acquired from the pool is not referenced by any
+        // subscriber, so it is safe to overwrite its content; images of
+        // channels without subscribers are neither acquired nor processed
+        bool any_active = false;
+        for (auto it = image_msg_pools.begin(); it != image_msg_pools.end();
+             ++it) {
+            if (!channel_active(it->first)) continue;
+            auto& msg = image_msgs[it->first];
+            msg = it->second->acquire();
+            channel_buffers[it->first] = msg->data.data();
+            any_active = true;
+        }
+        if (!any_active) return;
+
+        process_returns(lidar_scan);
         for (auto it = image_msgs.begin(); it != image_msgs.end(); ++it) {
+            if (!it->second) continue;
             it->second->header.stamp = msg_ts;
+            output_msgs[it->first] = it->second;
+            it->second.reset();
+        }
+        if (post_processing_fn) post_processing_fn(output_msgs);
+
+        // don't hold on to published messages, so they could be recycled
+        for (auto it = output_msgs.begin(); it != output_msgs.end(); ++it)
+            it->second.reset();
+    }
+
+    void process_stack(const ouster::LidarScan& lidar_scan, uint64_t,
+                       const ros::Time& msg_ts) {
+        // the stack is either produced in full or not at all
+        bool any_active = std::any_of(
+            channels.begin(), channels.end(),
+            [this](sensor::ChanField c) { return channel_active(c); });
+        if (!any_active) return;
+
+        auto msg = stack_msg_pool->acquire();
+        for (size_t i = 0; i < channels.size(); ++i)
+            channel_buffers[channels[i]] = msg->data.data() + msg->offsets[i];
+
+        process_returns(lidar_scan);
+        msg->header.stamp = msg_ts;
+        stack_post_processing_fn(msg);
+    }
+
+    void process_returns(const ouster::LidarScan& lidar_scan) {
+        process_return(lidar_scan, 0);
+        if (get_n_returns(info_) == 2) process_return(lidar_scan, 1);
+        for (auto& it : channel_buffers) it.second = nullptr;
+    }
+
+    /**
+     * Destaggers an image of H rows by W columns applying op to every pixel.
+     * Each row is shifted by copying two contiguous segments instead of
+     * computing a modulo index per pixel, which leaves simple loops the
+     * compiler is able to vectorize.
+     */
+    template <typename T, typename U, typename Op>
+    static void destagger_rows(const T* src, size_t src_stride, U* dst,
+                               size_t H, size_t W,
+                               const std::vector<int>& px_offset, Op op) {
+        for (size_t u = 0; u < H; ++u) {
+            const int w = static_cast<int>(W);
+            const size_t s = static_cast<size_t>((px_offset[u] % w + w) % w);
+            const T* src_row = src + u * src_stride;
+            U* dst_row = dst + u * W;
+            for (size_t v = 0; v < W - s; ++v) dst_row[s + v] = op(src_row[v]);
+            for (size_t v = 0; v < s; ++v) dst_row[v] = op(src_row[W - s + v]);
+        }
+    }
+
+    struct destagger_to_float {
+        template <typename T>
+        void operator()(Eigen::Ref<const ouster::img_t<T>> field, float* dst,
+                        const std::vector<int>& px_offset) {
+            destagger_rows(field.data(), field.outerStride(), dst,
+                           field.rows(), field.cols(), px_offset,
+                           [](T x) { return static_cast<float>(x); });
+        }
+    };
+
+    struct destagger_to_uint16 {
+        template <typename T>
+        void operator()(Eigen::Ref<const ouster::img_t<T>> field,
+                        uint16_t* dst, const std::vector<int>& px_offset) {
+            destagger_rows(field.data(), field.outerStride(), dst,
+                           field.rows(), field.cols(), px_offset, [](T x) {
+                               return static_cast<uint16_t>(std::min<uint64_t>(
+                                   x, std::numeric_limits<uint16_t>::max()));
+                           });
+        }
+    };
+
+    // destaggers a field into float or uint16_t pixels, zeros if missing
+    template <typename U>
+    void destagger_field(const ouster::LidarScan& lidar_scan,
+                         sensor::ChanField field, U* dst) {
+        if (!lidar_scan.field_type(field)) {
+            const size_t H = info_.format.pixels_per_column;
+            const size_t W = info_.format.columns_per_frame;
+            std::fill(dst, dst + H * W, U{0});
+            return;
+        }
+        using Destagger =
+            std::conditional_t<std::is_same<U, float>::value,
+                               destagger_to_float, destagger_to_uint16>;
+        ouster::impl::visit_field(lidar_scan, field, Destagger(), dst,
+                                  info_.format.pixel_shift_by_row);
+    }
+
+    // stores an image of values normalized to [0, 1] with the given encoding
+    template <typename Expr>
+    void store_normalized(uint8_t* buf, Encoding encoding,
+                          const Expr& image) const {
+        const size_t H = info_.format.pixels_per_column;
+        const size_t W = info_.format.columns_per_frame;
+        if (encoding == Encoding::MONO8) {
+            Eigen::Map<ouster::img_t<uint8_t>>(buf, H, W) =
+                (image * 255.0f).template cast<uint8_t>();
+        } else {
+            Eigen::Map<ouster::img_t<uint16_t>>((uint16_t*)buf, H, W) =
+                (image * 65535.0f).template cast<uint16_t>();
         }
-        if (post_processing_fn) post_processing_fn(image_msgs);
     }
 
     void process_return(const ouster::LidarScan& lidar_scan, int return_index) {
         const bool first = return_index == 0;
 
-        // across supported lidar profiles range is always 32-bit
-        auto range_channel =
-            first ? sensor::ChanField::RANGE : sensor::ChanField::RANGE2;
-        ouster::img_t<uint32_t> range =
-            lidar_scan.field<uint32_t>(range_channel);
-
-        ouster::img_t<uint16_t> reflectivity = impl::get_or_fill_zero<uint16_t>(
-            impl::suitable_return(sensor::ChanField::REFLECTIVITY, !first),
-            lidar_scan);
-
-        ouster::img_t<uint32_t> signal = impl::get_or_fill_zero<uint32_t>(
-            impl::suitable_return(sensor::ChanField::SIGNAL, !first),
-            lidar_scan);
-
-        // TODO: note that near_ir will be processed twice for DUAL return
-        // sensor
-        ouster::img_t<uint16_t> near_ir = impl::get_or_fill_zero<uint16_t>(
-            impl::suitable_return(sensor::ChanField::NEAR_IR, !first),
-            lidar_scan);
-
-        uint32_t H = info_.format.pixels_per_column;
-        uint32_t W = info_.format.columns_per_frame;
-
-        // views into message data
-        auto range_image_map = Eigen::Map<ouster::img_t<pixel_type>>(
-            (pixel_type*)image_msgs[impl::suitable_return(
-                                        sensor::ChanField::RANGE, !first)]
-                ->data.data(),
-            H, W);
-        auto signal_image_map = Eigen::Map<ouster::img_t<pixel_type>>(
-            (pixel_type*)image_msgs[impl::suitable_return(
-                                        sensor::ChanField::SIGNAL, !first)]
-                ->data.data(),
-            H, W);
-        auto reflec_image_map = Eigen::Map<ouster::img_t<pixel_type>>(
-            (pixel_type*)
-                image_msgs[impl::suitable_return(
-                               sensor::ChanField::REFLECTIVITY, !first)]
-                    ->data.data(),
-            H, W);
-        auto nearir_image_map = Eigen::Map<ouster::img_t<pixel_type>>(
-            (pixel_type*)image_msgs[impl::suitable_return(
-                                        sensor::ChanField::NEAR_IR, !first)]
-                ->data.data(),
-            H, W);
-
-        const auto& px_offset = info_.format.pixel_shift_by_row;
-
-        ouster::img_t<float> signal_image_eigen(H, W);
-        ouster::img_t<float> reflec_image_eigen(H, W);
-        ouster::img_t<float> nearir_image_eigen(H, W);
-
-        const auto rg = range.data();
-        const auto sg = signal.data();
-        const auto rf = reflectivity.data();
-        const auto nr = near_ir.data();
-
-        // copy data out of Cloud message, with destaggering
-        for (size_t u = 0; u < H; u++) {
-            for (size_t v = 0; v < W; v++) {
-                const size_t vv = (v + W - px_offset[u]) % W;
-                const size_t idx = u * W + vv;
-                // TODO: re-examine this truncation later
-                // 16 bit img: use 4mm resolution and throw out returns > 260m
-                auto r = (rg[idx] + 0b10) >> 2;
-                range_image_map(u, v) = r > pixel_value_max ? 0 : r;
-                signal_image_eigen(u, v) = sg[idx];
-                reflec_image_eigen(u, v) = rf[idx];
-                nearir_image_eigen(u, v) = nr[idx];
+        // buffers of inactive channels are null and are skipped entirely
+        auto buffer = [this, first](sensor::ChanField field) {
+            return channel_buffers[impl::suitable_return(field, !first)];
+        };
+        auto range_buf = buffer(sensor::ChanField::RANGE);
+        auto signal_buf = buffer(sensor::ChanField::SIGNAL);
+        auto reflec_buf = buffer(sensor::ChanField::REFLECTIVITY);
+        // near_ir is shared by both returns, so only process it once
+        auto nearir_buf = first ? buffer(sensor::ChanField::NEAR_IR) : nullptr;
+
+        const size_t H = info_.format.pixels_per_column;
+        const size_t W = info_.format.columns_per_frame;
+
+        if (range_buf) {
+            // across supported lidar profiles range is always 32-bit
+            auto range_channel =
+                first ? sensor::ChanField::RANGE : sensor::ChanField::RANGE2;
+            auto range = lidar_scan.field<uint32_t>(range_channel);
+            if (channel_encodings[range_channel] == Encoding::FLOAT32) {
+                destagger_rows(range.data(), range.outerStride(),
+                               (float*)range_buf, H, W,
+                               info_.format.pixel_shift_by_row,
+                               [](uint32_t r) { return r * 0.001f; });
+            } else if (channel_encodings[range_channel] == Encoding::RAW16) {
+                const uint32_t max = std::numeric_limits<uint16_t>::max();
+                destagger_rows(range.data(), range.outerStride(),
+                               (uint16_t*)range_buf, H, W,
+                               info_.format.pixel_shift_by_row,
+                               [max](uint32_t r) {
+                                   // mm as is, returns beyond ~65 m are
+                                   // thrown out rather than saturated
+                                   return static_cast<uint16_t>(r > max ? 0
+                                                                        : r);
+                               });
+            } else {
+                const uint32_t max = std::numeric_limits<uint16_t>::max();
+                destagger_rows(range.data(), range.outerStride(),
+                               (uint16_t*)range_buf, H, W,
+                               info_.format.pixel_shift_by_row,
+                               [max](uint32_t r) {
+                                   // 16 bit img: use 4mm resolution and throw
+                                   // out returns > 260m, use 32FC1 for full
+                                   // precision
+                                   r = (r + 0b10) >> 2;
+                                   return static_cast<uint16_t>(r > max ? 0
+                                                                        : r);
+                               });
+            }
+        }
+
+        // 32FC1 and 16UC1 images receive the raw values during the destagger
+        // pass, the rest are destaggered into preallocated float images for
+        // auto exposure, then scaled straight into the messages
+        if (signal_buf) {
+            auto field =
+                impl::suitable_return(sensor::ChanField::SIGNAL, !first);
+            auto encoding = channel_encodings[field];
+            if (encoding == Encoding::FLOAT32) {
+                destagger_field(lidar_scan, field, (float*)signal_buf);
+            } else if (encoding == Encoding::RAW16) {
+                destagger_field(lidar_scan, field, (uint16_t*)signal_buf);
+            } else {
+                destagger_field(lidar_scan, field, signal_image.data());
+                signal_ae(signal_image, first);
+                store_normalized(signal_buf, encoding, signal_image.sqrt());
             }
         }
 
-        signal_ae(signal_image_eigen, first);
-        reflec_ae(reflec_image_eigen, first);
-        nearir_buc(nearir_image_eigen);
-        nearir_ae(nearir_image_eigen, first);
-        nearir_image_eigen = nearir_image_eigen.sqrt();
-        signal_image_eigen = signal_image_eigen.sqrt();
+        if (reflec_buf) {
+            auto field =
+                impl::suitable_return(sensor::ChanField::REFLECTIVITY, !first);
+            auto encoding = channel_encodings[field];
+            if (encoding == Encoding::FLOAT32) {
+                destagger_field(lidar_scan, field, (float*)reflec_buf);
+            } else if (encoding == Encoding::RAW16) {
+                destagger_field(lidar_scan, field, (uint16_t*)reflec_buf);
+            } else {
+                destagger_field(lidar_scan, field, reflec_image.data());
+                reflec_ae(reflec_image, first);
+                store_normalized(reflec_buf, encoding, reflec_image);
+            }
+        }
 
-        // copy data into image messages
-        signal_image_map =
-            (signal_image_eigen * pixel_value_max).cast<pixel_type>();
-        reflec_image_map =
-            (reflec_image_eigen * pixel_value_max).cast<pixel_type>();
-        nearir_image_map =
-            (nearir_image_eigen * pixel_value_max).cast<pixel_type>();
+        if (nearir_buf) {
+            auto field = sensor::ChanField::NEAR_IR;
+            auto encoding = channel_encodings[field];
+            if (encoding == Encoding::FLOAT32) {
+                destagger_field(lidar_scan, field, (float*)nearir_buf);
+            } else if (encoding == Encoding::RAW16) {
+                destagger_field(lidar_scan, field, (uint16_t*)nearir_buf);
+            } else {
+                destagger_field(lidar_scan, field, nearir_image.data());
+                nearir_buc(nearir_image);
+                nearir_ae(nearir_image, true);
+                store_normalized(nearir_buf, encoding, nearir_image.sqrt());
+            }
+        }
     }
 
    public:
     static LidarScanProcessor create(const ouster::sensor::sensor_info& info,
                                      const std::string& frame,
-                                     PostProcessingFn func) {
-        auto handler = std::make_shared<ImageProcessor>(info, frame, func);
+                                     PostProcessingFn func,
+                                     ChannelActiveFn active_fn = {},
+                                     const ImageProcessorConfig& config = {}) {
+        auto handler = std::make_shared<ImageProcessor>(info, frame, func,
+                                                        active_fn, config);
+        return [handler](const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
+                         const ros::Time& msg_ts) {
+            handler->process(lidar_scan, scan_ts, msg_ts);
+        };
+    }
+
+    static LidarScanProcessor create(const ouster::sensor::sensor_info& info,
+                                     const std::string& frame,
+                                     StackPostProcessingFn func,
+                                     ChannelActiveFn active_fn = {},
+                                     const ImageProcessorConfig& config = {}) {
+        auto handler = std::make_shared<ImageProcessor>(info, frame, func,
+                                                        active_fn, config);
         return [handler](const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
                          const ros::Time& msg_ts) {
             handler->process(lidar_scan, scan_ts, msg_ts);
@@ -187,13 +525,36 @@ class ImageProcessor {
     }
 
    private:
+    // number of preallocated messages per channel
+    static constexpr size_t msg_pool_size = 4;
+
     std::string frame;
-    OutputType image_msgs;
-    PostProcessingFn post_processing_fn;
+    ChannelActiveFn channel_active_fn;
     sensor::sensor_info info_;
+    std::vector<sensor::ChanField> channels;
+    std::map<sensor::ChanField, Encoding> channel_encodings;
+    // destination of the pixels of each channel during processing of a frame
+    std::map<sensor::ChanField, uint8_t*> channel_buffers;
+
+    // used when publishing separate images
+    std::map<sensor::ChanField,
+             std::unique_ptr<MessagePool<sensor_msgs::Image>>>
+        image_msg_pools;
+    std::map<sensor::ChanField, sensor_msgs::ImagePtr> image_msgs;
+    OutputType output_msgs;
+    PostProcessingFn post_processing_fn;
+
+    // used when publishing an image stack
+    std::unique_ptr<MessagePool<ouster_ros::ImageStack>> stack_msg_pool;
+    StackPostProcessingFn stack_post_processing_fn;
+
+    // working buffers, allocated once and reused across frames
+    ouster::img_t<float> signal_image;
+    ouster::img_t<float> reflec_image;
+    ouster::img_t<float> nearir_image;
 
-    viz::AutoExposure nearir_ae, signal_ae, reflec_ae;
-    viz::BeamUniformityCorrector nearir_buc;
+    HistogramAutoExposure nearir_ae, signal_ae, reflec_ae;
+    ThrottledBeamUniformityCorrector nearir_buc;
 };
 
 }  // namespace ouster_ros
\ No newline at end of file
@@ -14,25 +14,140 @@
 #include "ouster_ros/os_ros.h"
 // clang-format on
 
+#include <ros/console.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+
+#include "lidar_packet_handler.h"
+#include "message_pool.h"
+
 namespace ouster_ros {
 
+/**
+ * Selects the rings the laser scans are made of. By default the scan of each
+ * return is taken from a single ring, when a band is configured each column
+ * of the scan holds the nearest valid return across the rings of the band,
+ * optionally limited to returns within a height range in the sensor frame.
+ * Additional single ring scans of the first return may be produced in the
+ * same pass.
+ */
+struct LaserScanConfig {
+    int band_ring_min = -1;  // negative disables the ring range
+    int band_ring_max = -1;
+    double band_height_min = 0.0;  // meters, disabled unless min < max
+    double band_height_max = 0.0;
+    std::set<int> extra_rings;
+
+    bool band_enabled() const {
+        return band_ring_min >= 0 || band_height_min < band_height_max;
+    }
+
+    /**
+     * Reads the config from the parameters: scan_band_ring_min,
+     * scan_band_ring_max, scan_band_height_min, scan_band_height_max and
+     * scan_extra_rings (comma separated list of rings). Extra rings that are
+     * not numbers or not rings of the sensor are reported and skipped.
+     */
+    static LaserScanConfig from_parameters(
+        const ros::NodeHandle& pnh, const ouster::sensor::sensor_info& info) {
+        LaserScanConfig config;
+        config.band_ring_min =
+            pnh.param("scan_band_ring_min", config.band_ring_min);
+        config.band_ring_max =
+            pnh.param("scan_band_ring_max", config.band_ring_max);
+        config.band_height_min =
+            pnh.param("scan_band_height_min", config.band_height_min);
+        config.band_height_max =
+            pnh.param("scan_band_height_max", config.band_height_max);
+        auto rings = pnh.param("scan_extra_rings", std::string{});
+        if (rings.find_first_not_of(" ") != std::string::npos) {
+            const long H = static_cast<long>(info.format.pixels_per_column);
+            for (const auto& token : impl::parse_tokens(rings, ',')) {
+                char* end = nullptr;
+                errno = 0;
+                const long ring = std::strtol(token.c_str(), &end, 10);
+                if (end == token.c_str() || *end != '\0' || errno != 0 ||
+                    ring < 0 || ring >= H) {
+                    ROS_WARN_STREAM("scan_extra_rings: "
+                                    << token << " is not a ring between [0, "
+                                    << H << "), ignored");
+                    continue;
+                }
+                config.extra_rings.insert(static_cast<int>(ring));
+            }
+        }
+        return config;
+    }
+};
+
 class LaserScanProcessor {
    public:
-    using OutputType = std::vector<std::shared_ptr<sensor_msgs::LaserScan>>;
+    // one scan per return followed by one scan per extra ring
+    using OutputType = std::vector<sensor_msgs::LaserScanConstPtr>;
     using PostProcessingFn = std::function<void(OutputType)>;
 
    public:
     LaserScanProcessor(const ouster::sensor::sensor_info& info,
                        const std::string& frame_id, uint16_t ring,
-                       PostProcessingFn func)
+                       PostProcessingFn func, OutputActiveFn active_fn = {},
+                       const LaserScanConfig& config = {})
         : frame(frame_id),
           ld_mode(info.mode),
           ring_(ring),
           pixel_shift_by_row(info.format.pixel_shift_by_row),
-          scan_msgs(get_n_returns(info)),
-          post_processing_fn(func) {
-        for (size_t i = 0; i < scan_msgs.size(); ++i)
-            scan_msgs[i] = std::make_shared<sensor_msgs::LaserScan>();
+          n_returns(get_n_returns(info)),
+          extra_rings(config.extra_rings.begin(), config.extra_rings.end()),
+          scan_msgs(n_returns + extra_rings.size()),
+          post_processing_fn(func),
+          output_active_fn(active_fn) {
+        // fields that don't change across frames are only set once when
+        // a message is added to the pool
+        using LaserScanPool = MessagePool<sensor_msgs::LaserScan>;
+        auto prod_line = info.prod_line;
+        for (size_t i = 0; i < scan_msgs.size(); ++i) {
+            scan_msg_pools.push_back(std::make_unique<LaserScanPool>(
+                msg_pool_size,
+                [this, prod_line](sensor_msgs::LaserScan& msg) {
+                    init_laser_scan_msg(msg, frame, ld_mode, prod_line);
+                },
+                [i](size_t count) {
+                    ROS_WARN_STREAM_THROTTLE(
+                        10, "laser scan message pool of output "
+                                << i << " exhausted " << count
+                                << " times, subscribers are holding on to "
+                                   "messages for too long");
+                }));
+        }
+
+        // from_parameters only yields valid rings, others are a caller bug
+        const int H = static_cast<int>(info.format.pixels_per_column);
+        for (auto r : extra_rings) {
+            if (r < 0 || r >= H)
+                throw std::runtime_error(
+                    "scan ring " + std::to_string(r) +
+                    " is out of the range [0, " + std::to_string(H) + ")");
+        }
+
+        if (config.band_enabled()) {
+            band = true;
+            band_ring_min = 0;
+            band_ring_max = H - 1;
+            if (config.band_ring_min >= 0) {
+                band_ring_min = std::min(config.band_ring_min, H - 1);
+                band_ring_max = std::min(
+                    std::max(config.band_ring_max, band_ring_min), H - 1);
+            }
+            if (config.band_height_min < config.band_height_max) {
+                band_height_min = config.band_height_min;
+                band_height_max = config.band_height_max;
+                // only the z component in the sensor frame is needed
+                auto xyz_lut = ouster::make_xyz_lut(info);
+                lut_direction_z = xyz_lut.direction.col(2).cast<float>();
+                lut_offset_z = xyz_lut.offset.col(2).cast<float>();
+            }
+        }
 
         const auto fw = impl::parse_version(info.fw_rev);
         if (fw.major == 2 && fw.minor < 4) {
@@ -41,26 +156,128 @@ class LaserScanProcessor {
                            pixel_shift_by_row.begin(),
                            [](auto c) { return c - 31; });
         }
+
+        // precompute the column permutations of the rings in use
+        const size_t W = info.format.columns_per_frame;
+        column_permutations.resize(H);
+        auto add_ring = [this, W](int u) {
+            if (column_permutations[u].empty())
+                column_permutations[u] =
+                    laser_scan_column_permutation(W, pixel_shift_by_row[u]);
+        };
+        if (band) {
+            for (int u = band_ring_min; u <= band_ring_max; ++u) add_ring(u);
+            band_rows.resize(W);
+        } else {
+            add_ring(ring_);
+        }
+        for (auto r : extra_rings) add_ring(r);
     }
 
    private:
     void process(const ouster::LidarScan& lidar_scan, uint64_t,
                  const ros::Time& msg_ts) {
+        bool any_active = false;
         for (size_t i = 0; i < scan_msgs.size(); ++i) {
-            *scan_msgs[i] =
-                lidar_scan_to_laser_scan_msg(lidar_scan, msg_ts, frame, ld_mode,
-                                             ring_, pixel_shift_by_row, i);
+            if (output_active_fn && !output_active_fn(static_cast<int>(i)))
+                continue;
+            any_active = true;
+            auto scan_msg = scan_msg_pools[i]->acquire();
+            const int return_index = static_cast<int>(i);
+            if (return_index >= n_returns) {
+                const int ring = extra_rings[return_index - n_returns];
+                lidar_scan_to_laser_scan_msg(lidar_scan, msg_ts, ring,
+                                             column_permutations[ring], 0,
+                                             *scan_msg);
+            } else if (band) {
+                band_minimum(lidar_scan, msg_ts, return_index, *scan_msg);
+            } else {
+                lidar_scan_to_laser_scan_msg(lidar_scan, msg_ts, ring_,
+                                             column_permutations[ring_],
+                                             return_index, *scan_msg);
+            }
+            scan_msgs[i] = scan_msg;
         }
 
-        if (post_processing_fn) post_processing_fn(scan_msgs);
+        if (any_active && post_processing_fn) post_processing_fn(scan_msgs);
+
+        // don't hold on to published messages, so they could be recycled
+        for (auto& scan_msg : scan_msgs) scan_msg.reset();
+    }
+
+    struct read_band_intensities {
+        template <typename T>
+        void operator()(Eigen::Ref<const ouster::img_t<T>> field,
+                        const std::vector<int>& rows,
+                        const std::vector<std::vector<int>>& permutations,
+                        std::vector<float>& intensities) {
+            for (size_t i = 0; i < rows.size(); ++i) {
+                intensities[i] =
+                    rows[i] < 0 ? 0.0f
+                                : static_cast<float>(field(
+                                      rows[i], permutations[rows[i]][i]));
+            }
+        }
+    };
+
+    /**
+     * Fills the scan with the nearest valid return of each column across the
+     * rings of the band.
+     */
+    void band_minimum(const ouster::LidarScan& ls, const ros::Time& msg_ts,
+                      int return_index, sensor_msgs::LaserScan& msg) {
+        msg.header.stamp = msg_ts;
+        const auto range_channel = static_cast<sensor::ChanField>(
+            sensor::ChanField::RANGE + return_index);
+        const auto signal_channel = static_cast<sensor::ChanField>(
+            sensor::ChanField::SIGNAL + return_index);
+        auto range = ls.field<uint32_t>(range_channel);
+        const bool height_band = lut_direction_z.size() > 0;
+        const float range_min = msg.range_min;
+        const int W = static_cast<int>(ls.w);
+
+        std::fill(msg.ranges.begin(), msg.ranges.end(),
+                  std::numeric_limits<float>::infinity());
+        std::fill(band_rows.begin(), band_rows.end(), -1);
+        for (int u = band_ring_min; u <= band_ring_max; ++u) {
+            const auto& columns = column_permutations[u];
+            for (int i = 0; i < W; ++i) {
+                const uint32_t r = range(u, columns[i]);
+                const float r_m = r * ouster::sensor::range_unit;
+                if (r == 0 || r_m < range_min || r_m >= msg.ranges[i])
+                    continue;
+                if (height_band) {
+                    const int idx = u * W + columns[i];
+                    const float z =
+                        lut_direction_z[idx] * r + lut_offset_z[idx];
+                    if (z < band_height_min || z > band_height_max) continue;
+                }
+                msg.ranges[i] = r_m;
+                band_rows[i] = u;
+            }
+        }
+        // columns without a return in the band are reported as 0 same as
+        // single ring scans
+        for (int i = 0; i < W; ++i)
+            if (band_rows[i] < 0) msg.ranges[i] = 0.0f;
+
+        if (!ls.field_type(signal_channel)) {
+            std::fill(msg.intensities.begin(), msg.intensities.end(), 0.0f);
+            return;
+        }
+        ouster::impl::visit_field(ls, signal_channel, read_band_intensities(),
+                                  band_rows, column_permutations,
+                                  msg.intensities);
     }
 
    public:
     static LidarScanProcessor create(const ouster::sensor::sensor_info& info,
                                      const std::string& frame, uint16_t ring,
-                                     PostProcessingFn func) {
-        auto handler =
-            std::make_shared<LaserScanProcessor>(info, frame, ring, func);
+                                     PostProcessingFn func,
+                                     OutputActiveFn active_fn = {},
+                                     const LaserScanConfig& config = {}) {
+        auto handler = std::make_shared<LaserScanProcessor>(
+            info, frame, ring, func, active_fn, config);
 
         return [handler](const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
                          const ros::Time& msg_ts) {
@@ -69,12 +286,35 @@ class LaserScanProcessor {
     }
 
    private:
+    // number of preallocated messages per return
+    static constexpr size_t msg_pool_size = 4;
+
     std::string frame;
     sensor::lidar_mode ld_mode;
     uint16_t ring_;
     std::vector<int> pixel_shift_by_row;
+    int n_returns;
+    std::vector<int> extra_rings;
+
+    bool band = false;
+    int band_ring_min = 0;
+    int band_ring_max = 0;
+    float band_height_min = 0.0f;
+    float band_height_max = 0.0f;
+    // z components of the xyz lut in the sensor frame, set for height bands
+    Eigen::ArrayXf lut_direction_z;
+    Eigen::ArrayXf lut_offset_z;
+    // ring of the nearest return of each column of the band scan
+    std::vector<int> band_rows;
+
+    // source column of each scan entry by ring, only set for rings in use
+    std::vector<std::vector<int>> column_permutations;
+
     OutputType scan_msgs;
+    std::vector<std::unique_ptr<MessagePool<sensor_msgs::LaserScan>>>
+        scan_msg_pools;
     PostProcessingFn post_processing_fn;
+    OutputActiveFn output_active_fn;
 };
 
 }  // namespace ouster_ros
\ No newline at end of file
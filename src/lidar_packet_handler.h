@@ -57,9 +57,39 @@ namespace ouster_ros {
 
 namespace sensor = ouster::sensor;
 
+/**
+ * The state a LidarPacketHandler carries from one scan to the next to
+ * interpolate the timestamp of scans whose first columns are missing: the
+ * last column of the previous scan that holds a timestamp.
+ */
+struct LidarScanTimestampState {
+    int last_col_idx = -1;  // -1 when there is no previous scan
+    uint64_t last_col_ts = 0;
+};
+
 using LidarScanProcessor =
     std::function<void(const ouster::LidarScan&, uint64_t, const ros::Time&)>;
 
+// Receives every lidar packet before it is batched into a scan, for outputs
+// that can not wait for the scan to complete.
+using LidarPacketProcessor = std::function<void(const uint8_t*)>;
+
+// Queried by processors once per frame to determine whether the output with
+// the given return index currently has any subscribers; processors skip the
+// work of producing outputs that nobody listens to. An empty function marks
+// all outputs as active.
+using OutputActiveFn = std::function<bool(int)>;
+
+/**
+ * Makes an OutputActiveFn that checks the publisher of each return, publishers
+ * are referenced and must outlive the returned function.
+ */
+inline OutputActiveFn has_subscribers(const std::vector<ros::Publisher>& pubs) {
+    return [&pubs](int return_index) {
+        return pubs[return_index].getNumSubscribers() > 0;
+    };
+}
+
 class LidarPacketHandler {
     using LidarPacketAccumlator = std::function<bool(const uint8_t*)>;
 
@@ -69,10 +99,16 @@ class LidarPacketHandler {
     using HandlerType = std::function<void(const uint8_t*)>;
 
    public:
+    /**
+     * @param[in] initial_ts_state the timestamp interpolation state of the
+     * scan preceding the first packet, when processing starts in the middle
+     * of a recording.
+     */
     LidarPacketHandler(const ouster::sensor::sensor_info& info,
                        const std::vector<LidarScanProcessor>& handlers,
                        const std::string& timestamp_mode,
-                       int64_t ptp_utc_tai_offset)
+                       int64_t ptp_utc_tai_offset,
+                       const LidarScanTimestampState& initial_ts_state = {})
         : lidar_scan_handlers{handlers} {
         // initialize lidar_scan processor and buffer
         scan_batcher = std::make_unique<ouster::ScanBatcher>(info);
@@ -85,6 +121,17 @@ class LidarPacketHandler {
         compute_scan_ts = [this](const auto& ts_v) {
             return compute_scan_ts_0(ts_v);
         };
+        if (initial_ts_state.last_col_idx >= 0) {
+            last_scan_last_nonzero_idx = initial_ts_state.last_col_idx;
+            last_scan_last_nonzero_value =
+                timestamp_mode == "TIME_FROM_PTP_1588"
+                    ? impl::ts_safe_offset_add(initial_ts_state.last_col_ts,
+                                               ptp_utc_tai_offset)
+                    : initial_ts_state.last_col_ts;
+            compute_scan_ts = [this](const auto& ts_v) {
+                return compute_scan_ts_n(ts_v);
+            };
+        }
         const sensor::packet_format& pf = sensor::get_format(info);
 
         if (timestamp_mode == "TIME_FROM_ROS_TIME") {
@@ -120,10 +167,14 @@ class LidarPacketHandler {
     static HandlerType create_handler(
         const ouster::sensor::sensor_info& info,
         const std::vector<LidarScanProcessor>& handlers,
-        const std::string& timestamp_mode, int64_t ptp_utc_tai_offset) {
+        const std::string& timestamp_mode, int64_t ptp_utc_tai_offset,
+        const LidarScanTimestampState& initial_ts_state = {},
+        const std::vector<LidarPacketProcessor>& packet_handlers = {}) {
         auto handler = std::make_shared<LidarPacketHandler>(
-            info, handlers, timestamp_mode, ptp_utc_tai_offset);
-        return [handler](const uint8_t* lidar_buf) {
+            info, handlers, timestamp_mode, ptp_utc_tai_offset,
+            initial_ts_state);
+        return [handler, packet_handlers](const uint8_t* lidar_buf) {
+            for (const auto& h : packet_handlers) h(lidar_buf);
             if (handler->lidar_packet_accumlator(lidar_buf)) {
                 for (auto h : handler->lidar_scan_handlers) {
                     h(*handler->lidar_scan, handler->lidar_scan_estimated_ts,
@@ -0,0 +1,338 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file load_shedding.h
+ * @brief Degrades outputs step by step while processing can't keep up with
+ * the sensor
+ */
+
+#pragma once
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <ros/console.h>
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lidar_packet_handler.h"
+
+namespace ouster_ros {
+
+/**
+ * The ways outputs are degraded to shed load, in no particular order.
+ */
+enum class LoadSheddingStep {
+    IMAGES,            // stop producing images (and camera projections)
+    SECOND_RETURN,     // stop producing outputs of the second return
+    CLOUD_DECIMATION,  // produce point clouds of only every nth scan
+};
+
+inline bool is_load_shedding_step(const std::string& step) {
+    return step == "IMG" || step == "RETURN2" || step == "PCL";
+}
+
+inline LoadSheddingStep load_shedding_step_of_string(const std::string& step) {
+    if (step == "IMG") return LoadSheddingStep::IMAGES;
+    if (step == "RETURN2") return LoadSheddingStep::SECOND_RETURN;
+    if (step == "PCL") return LoadSheddingStep::CLOUD_DECIMATION;
+    throw std::runtime_error("unsupported load shedding step: " + step);
+}
+
+struct LoadSheddingConfig {
+    // steps in the order they are taken, they are undone in reverse order
+    std::vector<LoadSheddingStep> order = {LoadSheddingStep::IMAGES,
+                                           LoadSheddingStep::SECOND_RETURN,
+                                           LoadSheddingStep::CLOUD_DECIMATION};
+    // processing time as a fraction of the scan period above which a step is
+    // taken and below which the last step taken is undone
+    double shed_load = 0.9;
+    double restore_load = 0.6;
+    // scans to wait after a change for the load to reflect it
+    int hold_scans = 20;
+    int cloud_decimation = 2;
+
+    /**
+     * Reads the config from the parameters: load_shedding_order (steps
+     * separated by '|' out of IMG, RETURN2 and PCL), load_shedding_high,
+     * load_shedding_low, load_shedding_hold and load_shedding_decimation.
+     * Invalid values are reported and replaced by the defaults.
+     */
+    static LoadSheddingConfig from_parameters(const ros::NodeHandle& pnh) {
+        const LoadSheddingConfig defaults;
+        LoadSheddingConfig config;
+        auto order = pnh.param("load_shedding_order",
+                               std::string{"IMG|RETURN2|PCL"});
+        config.order.clear();
+        // tokens are kept in the order given, unlike impl::parse_tokens
+        size_t begin = 0;
+        while (begin <= order.size()) {
+            auto end = std::min(order.find('|', begin), order.size());
+            if (end > begin) {
+                const auto token = order.substr(begin, end - begin);
+                if (is_load_shedding_step(token))
+                    config.order.push_back(
+                        load_shedding_step_of_string(token));
+                else
+                    ROS_WARN_STREAM("unsupported load shedding step: "
+                                    << token << ", ignored");
+            }
+            begin = end + 1;
+        }
+        if (config.order.empty()) {
+            ROS_WARN("load_shedding_order has no valid step, using "
+                     "IMG|RETURN2|PCL");
+            config.order = defaults.order;
+        }
+        config.shed_load = pnh.param("load_shedding_high", config.shed_load);
+        config.restore_load =
+            pnh.param("load_shedding_low", config.restore_load);
+        if (!(config.restore_load < config.shed_load)) {
+            ROS_WARN_STREAM("load_shedding_low must be lower than "
+                            "load_shedding_high, using "
+                            << defaults.restore_load << " and "
+                            << defaults.shed_load);
+            config.shed_load = defaults.shed_load;
+            config.restore_load = defaults.restore_load;
+        }
+        config.hold_scans = pnh.param("load_shedding_hold", config.hold_scans);
+        config.hold_scans = std::max(config.hold_scans, 0);
+        config.cloud_decimation =
+            pnh.param("load_shedding_decimation", config.cloud_decimation);
+        if (config.cloud_decimation < 1) {
+            ROS_WARN("load_shedding_decimation must be at least 1, using 1");
+            config.cloud_decimation = 1;
+        }
+        return config;
+    }
+};
+
+/**
+ * @class LoadShedder measures how long the processing of each scan takes
+ * against the scan period and, when processing is over budget, takes the
+ * configured steps one at a time to lighten the load. Steps are undone in
+ * reverse order once the load drops below a lower threshold.
+ *
+ * The load is smoothed over a few scans, and after each change the shedder
+ * holds the level for a number of scans so the effect of the change shows in
+ * the load before the next one. The load a step saved is measured at the end
+ * of that hold, and the step is only undone once the load with the saving
+ * added back stays below the lower threshold; otherwise a step that saves
+ * more than the gap between the thresholds would be taken and undone over
+ * and over.
+ *
+ * Processors consult the shedder through their output active functions, from
+ * whichever threads process the scans.
+ */
+class LoadShedder {
+   public:
+    using LevelChangedFn = std::function<void(int)>;
+
+    /**
+     * @param[in] scan_period_s the period of the scans in seconds.
+     * @param[in] workers the number of threads processing scans concurrently,
+     * each has that many scan periods for the processing of a scan.
+     */
+    LoadShedder(const LoadSheddingConfig& config, double scan_period_s,
+                int n_returns, LevelChangedFn level_changed_fn = {},
+                int workers = 1)
+        : config(config),
+          scan_period_s(scan_period_s),
+          workers(std::max(workers, 1)),
+          n_returns(n_returns),
+          level_changed_fn(level_changed_fn) {
+        if (config.order.empty())
+            throw std::runtime_error("load shedding needs at least one step");
+        if (!(config.restore_load < config.shed_load))
+            throw std::runtime_error(
+                "load_shedding_low must be lower than load_shedding_high");
+        if (config.cloud_decimation < 1)
+            throw std::runtime_error("load_shedding_decimation must be >= 1");
+    }
+
+    // the number of steps currently taken, 0 when no output is degraded
+    int level() const { return level_; }
+
+    double load() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return load_;
+    }
+
+    bool images_active() const { return !taken(LoadSheddingStep::IMAGES); }
+
+    bool image_active(sensor::ChanField channel) const {
+        if (!images_active()) return false;
+        return return_active(channel == sensor::ChanField::RANGE2 ||
+                                     channel == sensor::ChanField::SIGNAL2 ||
+                                     channel == sensor::ChanField::REFLECTIVITY2
+                                 ? 1
+                                 : 0);
+    }
+
+    /**
+     * Whether outputs of the given return are produced; indices past the
+     * returns of the sensor (the extra rings of laser scans) always are.
+     */
+    bool return_active(int return_index) const {
+        return return_index != 1 || n_returns < 2 ||
+               !taken(LoadSheddingStep::SECOND_RETURN);
+    }
+
+    /**
+     * Decimated clouds are kept for every nth frame id of the sensor, which
+     * holds however the scans are spread over the processing threads. Outside
+     * of a wrapped processor the count of processed scans stands in for it.
+     */
+    bool cloud_active(int return_index) const {
+        if (!return_active(return_index)) return false;
+        if (!taken(LoadSheddingStep::CLOUD_DECIMATION)) return true;
+        const uint64_t scan = current_frame_id >= 0
+                                  ? static_cast<uint64_t>(current_frame_id)
+                                  : scan_count.load();
+        return scan % config.cloud_decimation == 0;
+    }
+
+    /**
+     * Makes a processor that runs the given processors and measures the time
+     * they take, the shedder must outlive the returned processor.
+     */
+    LidarScanProcessor wrap(std::vector<LidarScanProcessor> processors) {
+        return [this, processors](const ouster::LidarScan& lidar_scan,
+                                  uint64_t scan_ts, const ros::Time& msg_ts) {
+            auto start = std::chrono::steady_clock::now();
+            current_frame_id = lidar_scan.frame_id;
+            for (const auto& processor : processors)
+                processor(lidar_scan, scan_ts, msg_ts);
+            current_frame_id = -1;
+            scan_processed(std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count());
+        };
+    }
+
+    /**
+     * Makes a processor that runs the given processors and measures the time
+     * they take against a single scan period. Meant for the processors that
+     * run one scan at a time in scan order beside parallel workers, whose
+     * time wrap() measures; the shedder acts on the higher of both loads.
+     */
+    LidarScanProcessor wrap_ordered(
+        std::vector<LidarScanProcessor> processors) {
+        return [this, processors](const ouster::LidarScan& lidar_scan,
+                                  uint64_t scan_ts, const ros::Time& msg_ts) {
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& processor : processors)
+                processor(lidar_scan, scan_ts, msg_ts);
+            ordered_scan_processed(std::chrono::duration<double>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count());
+        };
+    }
+
+    /**
+     * Updates the load of the ordered processors with their processing time
+     * in seconds of a scan, steps are only taken or undone by scan_processed.
+     */
+    void ordered_scan_processed(double processing_time_s) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const double scan_load = processing_time_s / scan_period_s;
+        ordered_load = ++ordered_count == 1
+                           ? scan_load
+                           : ordered_load +
+                                 smoothing * (scan_load - ordered_load);
+    }
+
+    /**
+     * Updates the load with the processing time in seconds of a scan and
+     * takes or undoes a step as needed.
+     */
+    void scan_processed(double processing_time_s) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const double scan_load = processing_time_s / (scan_period_s * workers);
+        worker_load = ++scan_count == 1
+                          ? scan_load
+                          : worker_load + smoothing * (scan_load - worker_load);
+        load_ = std::max(worker_load, ordered_load);
+        if (hold > 0) {
+            --hold;
+            return;
+        }
+        if (!savings.empty() && savings.back() < 0.0)
+            savings.back() = std::max(load_before.back() - load_, 0.0);
+
+        const int max_level = static_cast<int>(config.order.size());
+        int new_level = level_;
+        if (load_ > config.shed_load && level_ < max_level) {
+            ++new_level;
+            load_before.push_back(load_);
+            savings.push_back(-1.0);  // known once the hold ends
+        } else if (level_ > 0 &&
+                   load_ + savings.back() < config.restore_load) {
+            --new_level;
+            load_before.pop_back();
+            savings.pop_back();
+        }
+        if (new_level == level_) return;
+
+        if (new_level > level_)
+            ROS_WARN_STREAM("processing takes " << load_ * 100.0
+                                                << "% of the scan period, "
+                                                   "load shedding level "
+                                                << new_level);
+        else
+            ROS_INFO_STREAM("processing takes " << load_ * 100.0
+                                                << "% of the scan period, "
+                                                   "load shedding level "
+                                                << new_level);
+        level_ = new_level;
+        hold = config.hold_scans;
+        if (level_changed_fn) level_changed_fn(level_);
+    }
+
+   private:
+    bool taken(LoadSheddingStep step) const {
+        const int level = level_;
+        for (int i = 0; i < level; ++i)
+            if (config.order[i] == step) return true;
+        return false;
+    }
+
+   private:
+    // weight of the latest scan in the smoothed load
+    static constexpr double smoothing = 0.2;
+    // frame id of the scan the wrapped processors of this thread run over
+    static inline thread_local int64_t current_frame_id = -1;
+
+    const LoadSheddingConfig config;
+    const double scan_period_s;
+    const int workers;
+    const int n_returns;
+    LevelChangedFn level_changed_fn;
+
+    mutable std::mutex mutex;
+    std::atomic<int> level_ = {0};
+    // the higher of the load of the workers and the ordered processors
+    double load_ = 0.0;
+    double worker_load = 0.0;
+    double ordered_load = 0.0;
+    uint64_t ordered_count = 0;
+    int hold = 0;
+    // per step taken, the load just before it and the load it saved
+    std::vector<double> load_before;
+    std::vector<double> savings;
+    std::atomic<uint64_t> scan_count = {0};
+};
+
+}  // namespace ouster_ros
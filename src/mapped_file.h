@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file mapped_file.h
+ * @brief Read only memory mapping of a whole file
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace ouster_ros {
+
+/**
+ * @class MappedFile maps a file read only into memory for the lifetime of the
+ * object, pages are loaded on demand by the kernel which also takes care of
+ * read ahead, so no data is copied into user space buffers.
+ */
+class MappedFile {
+   public:
+    explicit MappedFile(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw_error("failed to open file " + path);
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) throw_error("failed to stat file " + path);
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) return;
+
+        void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) throw_error("failed to map file " + path);
+        data_ = static_cast<const uint8_t*>(addr);
+        ::madvise(addr, size_, MADV_SEQUENTIAL);
+    }
+
+    ~MappedFile() { release(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+
+    size_t size() const { return size_; }
+
+   private:
+    void throw_error(const std::string& what) {
+        std::string error = what + ": " + std::strerror(errno);
+        release();
+        throw std::runtime_error(error);
+    }
+
+    void release() {
+        if (data_) ::munmap(const_cast<uint8_t*>(data_), size_);
+        if (fd >= 0) ::close(fd);
+        data_ = nullptr;
+        fd = -1;
+    }
+
+    int fd = -1;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+}  // namespace ouster_ros
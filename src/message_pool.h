@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file message_pool.h
+ * @brief A pool of preallocated messages that are handed out as shared
+ * pointers and recycled once all references to them are dropped
+ */
+
+#pragma once
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ouster_ros {
+
+/**
+ * @class MessagePool a pool of preallocated messages of type MsgT.
+ *
+ * Messages acquired from the pool are returned as boost::shared_ptr objects
+ * which makes them suitable for publishing through ros::Publisher as a
+ * ConstPtr, this allows nodelets within the same manager to receive the
+ * message without any copy or serialization. A message is returned back to
+ * the pool only when the last reference to it is released, thus it is never
+ * modified while a subscriber is still holding it.
+ *
+ * @remarks
+ *  When the pool is exhausted the acquire() method falls back to allocating
+ *  a new message which is not recycled, these occurances are counted and can
+ *  be queried through exhausted_count().
+ */
+template <typename MsgT>
+class MessagePool {
+   public:
+    using Ptr = boost::shared_ptr<MsgT>;
+    using InitFn = std::function<void(MsgT&)>;
+    using ExhaustedFn = std::function<void(size_t exhausted_count)>;
+
+   private:
+    // the pool state is held separately so that messages still referenced
+    // by subscribers can outlive the pool itself
+    struct State {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<MsgT>> free_msgs;
+
+        void release(MsgT* msg) {
+            std::lock_guard<std::mutex> lock(mutex);
+            free_msgs.emplace_back(msg);
+        }
+    };
+
+   public:
+    /**
+     * @param[in] capacity number of messages to preallocate.
+     * @param[in] init_fn optional function applied once to every message
+     * allocated by the pool, use it to size message buffers upfront.
+     * @param[in] on_exhausted optional function invoked every time the pool
+     * is found empty, receives the total number of such occurances.
+     */
+    explicit MessagePool(size_t capacity, InitFn init_fn = {},
+                         ExhaustedFn on_exhausted = {})
+        : state(std::make_shared<State>()),
+          init_fn_(init_fn),
+          on_exhausted_(on_exhausted),
+          capacity_(capacity) {
+        state->free_msgs.reserve(capacity);
+        for (size_t i = 0; i < capacity; ++i) {
+            auto msg = std::make_unique<MsgT>();
+            if (init_fn_) init_fn_(*msg);
+            state->free_msgs.push_back(std::move(msg));
+        }
+    }
+
+    MessagePool(const MessagePool&) = delete;
+    MessagePool& operator=(const MessagePool&) = delete;
+
+    /**
+     * Gets the number of messages preallocated by the pool.
+     */
+    size_t capacity() const { return capacity_; }
+
+    /**
+     * Gets the number of messages currently available for reuse.
+     */
+    size_t available() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->free_msgs.size();
+    }
+
+    /**
+     * Gets the number of times acquire() found the pool empty and had to
+     * allocate a new message.
+     */
+    size_t exhausted_count() const { return exhausted_count_; }
+
+    /**
+     * Acquires a message from the pool. Note that a recycled message retains
+     * whatever content it had when it was last released.
+     */
+    Ptr acquire() {
+        std::unique_ptr<MsgT> msg;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->free_msgs.empty()) {
+                msg = std::move(state->free_msgs.back());
+                state->free_msgs.pop_back();
+            }
+        }
+
+        if (!msg) {
+            auto count = ++exhausted_count_;
+            if (on_exhausted_) on_exhausted_(count);
+            auto new_msg = boost::make_shared<MsgT>();
+            if (init_fn_) init_fn_(*new_msg);
+            return new_msg;
+        }
+
+        std::weak_ptr<State> weak_state = state;
+        return Ptr(msg.release(), [weak_state](MsgT* m) {
+            if (auto s = weak_state.lock())
+                s->release(m);
+            else
+                delete m;
+        });
+    }
+
+   private:
+    std::shared_ptr<State> state;
+    InitFn init_fn_;
+    ExhaustedFn on_exhausted_;
+    size_t capacity_;
+    std::atomic<size_t> exhausted_count_ = {0};
+};
+
+}  // namespace ouster_ros
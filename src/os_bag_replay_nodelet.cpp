@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file os_bag_replay_nodelet.cpp
+ * @brief A nodelet that reads the packets of a bag recorded by record.launch
+ * and hands them straight to the processing pipeline of os_driver, skipping
+ * rosbag play and the pub/sub hop
+ */
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <pluginlib/class_list_macros.h>
+
+#include "bag_packet_source.h"
+#include "os_packet_replay_nodelet.h"
+
+namespace sensor = ouster::sensor;
+
+namespace ouster_ros {
+
+class OusterBagReplay : public OusterPacketReplay {
+   protected:
+    std::unique_ptr<PacketSource> open_recording(
+        const ros::NodeHandle& pnh) override {
+        auto bag_file = pnh.param("bag_file", std::string{});
+        if (!is_arg_set(bag_file)) {
+            NODELET_ERROR("Must specify a bag file to replay");
+            throw std::runtime_error("bag_file not specified");
+        }
+        // by default read the topics os_node would have published
+        auto& nh = getNodeHandle();
+        auto lidar_topic = pnh.param("lidar_packets_topic",
+                                     nh.resolveName("lidar_packets"));
+        auto imu_topic =
+            pnh.param("imu_packets_topic", nh.resolveName("imu_packets"));
+        auto metadata_topic =
+            pnh.param("metadata_topic", nh.resolveName("metadata"));
+
+        NODELET_INFO_STREAM("Opening bag file " << bag_file);
+        recording_file = bag_file;
+        auto source = std::make_unique<BagPacketSource>(bag_file, lidar_topic,
+                                                        imu_topic);
+        if (is_arg_set(pnh.param("metadata", std::string{}))) {
+            load_metadata_file(pnh);
+        } else {
+            cached_metadata = source->read_metadata(metadata_topic);
+            if (cached_metadata.empty()) {
+                NODELET_ERROR_STREAM("no metadata recorded on "
+                                     << metadata_topic
+                                     << ", specify a metadata file instead");
+                throw std::runtime_error("metadata not found in bag");
+            }
+            info = sensor::parse_metadata(cached_metadata);
+        }
+        return source;
+    }
+};
+
+}  // namespace ouster_ros
+
+PLUGINLIB_EXPORT_CLASS(ouster_ros::OusterBagReplay, nodelet::Nodelet)
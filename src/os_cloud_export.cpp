@@ -0,0 +1,356 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file os_cloud_export.cpp
+ * @brief A command line tool that converts the packets of a bag or a pcap
+ * recording into one point cloud file per frame, composing and writing the
+ * point clouds of consecutive frames in parallel
+ */
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+
+#include "bag_packet_source.h"
+#include "bounded_queue.h"
+#include "lidar_packet_handler.h"
+#include "pcap_packet_source.h"
+#include "point_cloud_file_writer.h"
+#include "point_cloud_processor_factory.h"
+
+namespace sensor = ouster::sensor;
+namespace fs = std::filesystem;
+
+using namespace ouster_ros;
+
+namespace {
+
+const char* usage =
+    "usage: cloud_export [options] <recording.bag|recording.pcap> <out_dir>\n"
+    "\n"
+    "Writes the point cloud of every frame of the recording to out_dir as\n"
+    "<frame>.<format> (dual return profiles add <frame>_2.<format> for the\n"
+    "second return) along with timestamps.csv listing the frame timestamps.\n"
+    "\n"
+    "options:\n"
+    "  --metadata <file>          sensor metadata, required for pcap files\n"
+    "  --format <pcd|ply>         output file format (pcd)\n"
+    "  --point-type <type>        original, native, xyz, xyzi or xyzir\n"
+    "                             (original)\n"
+    "  --point-cloud-frame <f>    sensor or lidar (sensor)\n"
+    "  --timestamp-mode <mode>    TIME_FROM_INTERNAL_OSC or\n"
+    "                             TIME_FROM_PTP_1588 (TIME_FROM_INTERNAL_OSC)\n"
+    "  --ptp-utc-tai-offset <s>   offset applied to PTP timestamps (-37.0)\n"
+    "  --threads <n>              number of worker threads (all cores)\n"
+    "  --lidar-port <port>        pcap only: lidar packets port (any)\n"
+    "  --lidar-packets-topic <t>  bag only: (/ouster/lidar_packets)\n"
+    "  --metadata-topic <t>       bag only: (/ouster/metadata)\n";
+
+struct Options {
+    std::string recording;
+    std::string out_dir;
+    std::string metadata;
+    std::string format = "pcd";
+    std::string point_type = "original";
+    std::string point_cloud_frame = "sensor";
+    std::string timestamp_mode = "TIME_FROM_INTERNAL_OSC";
+    double ptp_utc_tai_offset = -37.0;
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    int lidar_port = 0;
+    std::string lidar_packets_topic = "/ouster/lidar_packets";
+    std::string metadata_topic = "/ouster/metadata";
+};
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+    std::map<std::string, std::string> values;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc)
+            throw std::runtime_error("missing value of option " + arg);
+        values[arg] = argv[++i];
+    }
+    if (positional.size() != 2)
+        throw std::runtime_error("expected a recording and an output folder");
+    options.recording = positional[0];
+    options.out_dir = positional[1];
+
+    for (const auto& it : values) {
+        const auto& key = it.first;
+        const auto& value = it.second;
+        if (key == "--metadata") options.metadata = value;
+        else if (key == "--format") options.format = value;
+        else if (key == "--point-type") options.point_type = value;
+        else if (key == "--point-cloud-frame") options.point_cloud_frame = value;
+        else if (key == "--timestamp-mode") options.timestamp_mode = value;
+        else if (key == "--ptp-utc-tai-offset")
+            options.ptp_utc_tai_offset = std::stod(value);
+        else if (key == "--threads") options.threads = std::stoi(value);
+        else if (key == "--lidar-port") options.lidar_port = std::stoi(value);
+        else if (key == "--lidar-packets-topic")
+            options.lidar_packets_topic = value;
+        else if (key == "--metadata-topic") options.metadata_topic = value;
+        else
+            throw std::runtime_error("unknown option " + key);
+    }
+
+    if (options.threads < 1) options.threads = 1;
+    if (options.point_cloud_frame != "sensor" &&
+        options.point_cloud_frame != "lidar")
+        throw std::runtime_error("point cloud frame must be sensor or lidar");
+    // frame timestamps derived from the time of reception would reflect how
+    // fast the recording is read rather than when frames were captured
+    if (options.timestamp_mode == "TIME_FROM_ROS_TIME")
+        throw std::runtime_error(
+            "TIME_FROM_ROS_TIME is not supported when exporting recordings");
+    return options;
+}
+
+bool has_extension(const std::string& path, const std::string& extension) {
+    return fs::path(path).extension() == extension;
+}
+
+std::string read_text_file(const std::string& path) {
+    std::ifstream ifs(path);
+    if (!ifs) throw std::runtime_error("failed to open " + path);
+    return std::string{std::istreambuf_iterator<char>(ifs),
+                       std::istreambuf_iterator<char>()};
+}
+
+/**
+ * @class ScanExporter composes and writes the point clouds of completed
+ * scans on a pool of workers.
+ *
+ * Scans are batched and timestamped sequentially by the caller, so the
+ * interpolation of missing column timestamps sees every frame in order; the
+ * workers only receive self contained copies of complete scans. Each worker
+ * owns a point cloud processor of the same composition the driver publishes
+ * with, together with its own file writer. Scan copies are recycled through
+ * a free list that bounds the memory in use and blocks the caller whenever
+ * the workers fall behind.
+ */
+class ScanExporter {
+    struct Job {
+        size_t frame;
+        uint64_t scan_ts;
+        ros::Time msg_ts;
+        std::unique_ptr<ouster::LidarScan> scan;
+    };
+
+    struct Worker {
+        explicit Worker(CloudFileFormat format) : writer(format) {}
+        LidarScanProcessor processor;
+        PointCloudFileWriter writer;
+        size_t frame = 0;
+        std::thread thread;
+    };
+
+   public:
+    ScanExporter(const sensor::sensor_info& info, const Options& options)
+        : out_dir(options.out_dir),
+          format(cloud_file_format_of_string(options.format)),
+          jobs(2 * options.threads, QueuePolicy::BLOCK),
+          free_scans(3 * options.threads, QueuePolicy::BLOCK) {
+        for (size_t i = 0; i < free_scans.capacity(); ++i) {
+            free_scans.push(std::make_unique<ouster::LidarScan>(
+                info.format.columns_per_frame, info.format.pixels_per_column,
+                info.format.udp_profile_lidar));
+        }
+
+        const bool sensor_frame = options.point_cloud_frame == "sensor";
+        const auto frame_id = sensor_frame ? "os_sensor" : "os_lidar";
+        for (int i = 0; i < options.threads; ++i) {
+            workers.push_back(std::make_unique<Worker>(format));
+            auto& worker = *workers.back();
+            worker.processor =
+                PointCloudProcessorFactory::create_point_cloud_processor(
+                    options.point_type, info, frame_id, sensor_frame,
+                    [this, &worker](PointCloudProcessor_OutputType msgs) {
+                        write_clouds(worker, msgs);
+                    });
+            worker.thread = std::thread([this, &worker]() { run(worker); });
+        }
+    }
+
+    ~ScanExporter() { finish(); }
+
+    /**
+     * Hands a copy of the scan to the workers, blocks while all scan copies
+     * are in use.
+     * @return false once a worker failed to write a file.
+     */
+    bool submit(const ouster::LidarScan& ls, uint64_t scan_ts,
+                const ros::Time& msg_ts) {
+        if (failed) return false;
+        std::unique_ptr<ouster::LidarScan> scan;
+        if (!free_scans.pop(scan)) return false;
+        *scan = ls;
+        jobs.push(Job{submitted++, scan_ts, msg_ts, std::move(scan)});
+        return true;
+    }
+
+    /**
+     * Waits for the workers to write every submitted scan.
+     * @return false if a worker failed to write a file.
+     */
+    bool finish() {
+        jobs.close();
+        for (auto& worker : workers)
+            if (worker->thread.joinable()) worker->thread.join();
+        return !failed;
+    }
+
+    size_t frames_written() const { return written; }
+
+   private:
+    void run(Worker& worker) {
+        Job job;
+        while (jobs.pop(job)) {
+            if (!failed) {
+                worker.frame = job.frame;
+                try {
+                    worker.processor(*job.scan, job.scan_ts, job.msg_ts);
+                    ++written;
+                } catch (const std::exception& e) {
+                    std::cerr << "frame " << job.frame << ": " << e.what()
+                              << std::endl;
+                    failed = true;
+                }
+            }
+            free_scans.push(std::move(job.scan));
+        }
+    }
+
+    void write_clouds(Worker& worker,
+                      const PointCloudProcessor_OutputType& msgs) {
+        for (size_t i = 0; i < msgs.size(); ++i) {
+            if (!msgs[i]) continue;
+            char name[32];
+            if (i == 0)
+                std::snprintf(name, sizeof(name), "%06zu", worker.frame);
+            else
+                std::snprintf(name, sizeof(name), "%06zu_%zu", worker.frame,
+                              i + 1);
+            worker.writer.write(*msgs[i], (fs::path(out_dir) / name).string() +
+                                              file_extension(format));
+        }
+    }
+
+   private:
+    std::string out_dir;
+    CloudFileFormat format;
+    BoundedQueue<Job> jobs;
+    BoundedQueue<std::unique_ptr<ouster::LidarScan>> free_scans;
+    std::vector<std::unique_ptr<Worker>> workers;
+    size_t submitted = 0;
+    std::atomic<size_t> written = {0};
+    std::atomic<bool> failed = {false};
+};
+
+int export_clouds(const Options& options) {
+    std::unique_ptr<PacketSource> source;
+    std::string metadata;
+    if (!options.metadata.empty()) metadata = read_text_file(options.metadata);
+
+    if (has_extension(options.recording, ".bag")) {
+        auto bag_source = std::make_unique<BagPacketSource>(
+            options.recording, options.lidar_packets_topic, std::string{});
+        if (metadata.empty())
+            metadata = bag_source->read_metadata(options.metadata_topic);
+        if (metadata.empty())
+            throw std::runtime_error("no metadata recorded on " +
+                                     options.metadata_topic +
+                                     ", specify a metadata file instead");
+        source = std::move(bag_source);
+    } else if (metadata.empty()) {
+        throw std::runtime_error("a metadata file is required for pcap files");
+    }
+
+    const auto info = sensor::parse_metadata(metadata);
+    const auto& pf = sensor::get_format(info);
+    if (!source) {
+        source = std::make_unique<PcapPacketSource>(options.recording, pf,
+                                                    options.lidar_port, 0);
+    }
+
+    fs::create_directories(options.out_dir);
+    std::ofstream timestamps(fs::path(options.out_dir) / "timestamps.csv");
+    timestamps << "frame,timestamp_ns\n";
+
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    size_t scans = 0, frames = 0, lidar_packets = 0, skipped_packets = 0;
+    bool exporting = true;
+    {
+        ScanExporter exporter(info, options);
+        // batching and timestamping of scans happens on this thread in the
+        // order of the recording, only complete scans go to the workers
+        auto lidar_packet_handler = LidarPacketHandler::create_handler(
+            info,
+            {[&](const ouster::LidarScan& ls, uint64_t scan_ts,
+                 const ros::Time& msg_ts) {
+                timestamps << scans++ << ',' << scan_ts << '\n';
+                exporting = exporter.submit(ls, scan_ts, msg_ts);
+            }},
+            options.timestamp_mode,
+            static_cast<int64_t>(options.ptp_utc_tai_offset * 1e+9));
+
+        ReplayPacket packet;
+        while (exporting && source->next(packet)) {
+            if (packet.kind != PacketKind::LIDAR ||
+                packet.size != pf.lidar_packet_size) {
+                ++skipped_packets;
+                continue;
+            }
+            lidar_packet_handler(packet.data);
+            ++lidar_packets;
+        }
+        exporting = exporter.finish() && exporting;
+        frames = exporter.frames_written();
+    }
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    std::cout << "exported " << frames << " frames from " << lidar_packets
+              << " lidar packets in " << elapsed.count() << " s ("
+              << frames / std::max(elapsed.count(), 1e-9)
+              << " frames/s), skipped " << skipped_packets << " packets"
+              << std::endl;
+    return exporting ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ros::Time::init();
+    Options options;
+    try {
+        options = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n\n" << usage;
+        return 2;
+    }
+
+    try {
+        return export_clouds(options);
+    } catch (const std::exception& e) {
+        std::cerr << "export failed: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -20,13 +20,20 @@
 #include <sensor_msgs/Imu.h>
 #include <sensor_msgs/PointCloud2.h>
 
+#include <atomic>
+#include <chrono>
+
 #include "ouster_ros/PacketMsg.h"
+#include "callback_queue_spinner.h"
 #include "os_transforms_broadcaster.h"
 #include "imu_packet_handler.h"
 #include "lidar_packet_handler.h"
 #include "point_cloud_processor.h"
 #include "laser_scan_processor.h"
 #include "point_cloud_processor_factory.h"
+#include "publishing_stage.h"
+#include "scan_deadline.h"
+#include "scan_processing_stage.h"
 
 namespace ouster_ros {
 
@@ -37,6 +44,12 @@ class OusterCloud : public nodelet::Nodelet {
    public:
     OusterCloud() : tf_bcast(getName()) {}
 
+    ~OusterCloud() override {
+        // no packet callback may run past this point on the dedicated queues
+        imu_packet_sub.shutdown();
+        lidar_packet_sub.shutdown();
+    }
+
    private:
     virtual void onInit() override {
         create_metadata_subscriber();
@@ -78,7 +91,9 @@ class OusterCloud : public nodelet::Nodelet {
             timer_ = getNodeHandle().createTimer(
                 ros::Duration(1.0 / dynamic_transforms_rate),
                 [this, info](const ros::TimerEvent&) {
-                    tf_bcast.broadcast_transforms(info, last_msg_ts);
+                    ros::Time last_ts;
+                    last_ts.fromNSec(last_msg_ts);
+                    tf_bcast.broadcast_transforms(info, last_ts);
                 });
         }
 
@@ -93,46 +108,98 @@ class OusterCloud : public nodelet::Nodelet {
         auto timestamp_mode = pnh.param("timestamp_mode", std::string{});
         double ptp_utc_tai_offset = pnh.param("ptp_utc_tai_offset", -37.0);
 
+        // in offline mode packets and messages are queued without bound
+        // instead of being dropped when the processing falls behind
+        const bool offline_mode = pnh.param("offline_mode", false);
+        const int packets_queue_size = offline_mode ? 0 : 100;
+        const int queue_size = offline_mode ? 0 : 10;
+
         auto& nh = getNodeHandle();
 
+        publishing_stage = PublishingStage::create_from_parameters(pnh);
+
         if (impl::check_token(tokens, "IMU")) {
-            imu_pub = nh.advertise<sensor_msgs::Imu>("imu", 100);
+            imu_pub =
+                nh.advertise<sensor_msgs::Imu>("imu", offline_mode ? 0 : 100);
             imu_packet_handler = ImuPacketHandler::create_handler(
                 info, tf_bcast.imu_frame_id(), timestamp_mode,
                 static_cast<int64_t>(ptp_utc_tai_offset * 1e+9));
-            imu_packet_sub = nh.subscribe<PacketMsg>(
-                "imu_packets", 100, [this](const PacketMsg::ConstPtr msg) {
-                    auto imu_msg = imu_packet_handler(msg->buf.data());
-                    if (imu_msg.header.stamp > last_msg_ts)
-                        last_msg_ts = imu_msg.header.stamp;
+            imu_packet_sub.shutdown();  // before its queue is replaced
+            imu_spinner =
+                create_spinner("imu", pnh.param("imu_callback_threads", 1),
+                               pnh.param("imu_thread_priority", 0));
+            imu_latency_report_period =
+                pnh.param("imu_latency_report_period", 0.0);
+            // the message event carries the receipt time of the packet
+            ros::SubscribeOptions imu_ops;
+            imu_ops.initByFullCallbackType<
+                const ros::MessageEvent<PacketMsg const>&>(
+                "imu_packets", packets_queue_size,
+                [this](const ros::MessageEvent<PacketMsg const>& event) {
+                    auto imu_msg =
+                        imu_packet_handler(event.getConstMessage()->buf.data());
+                    update_last_msg_ts(imu_msg.header.stamp);
                     imu_pub.publish(imu_msg);
+                    record_imu_latency(event.getReceiptTime());
                 });
+            imu_packet_sub =
+                node_handle_for(imu_spinner.get()).subscribe(imu_ops);
         }
 
         int num_returns = get_n_returns(info);
 
         std::vector<LidarScanProcessor> processors;
+        // processors of outputs named after their proc_mask flag, late scans
+        // may skip them when a scan deadline is set
+        scan_deadline = ScanDeadline::create_from_parameters(pnh);
+        auto add_processor = [&](const std::string& output,
+                                 LidarScanProcessor processor) {
+            processors.push_back(scan_deadline
+                                     ? scan_deadline->guard(output, processor)
+                                     : processor);
+        };
         if (impl::check_token(tokens, "PCL")) {
             lidar_pubs.resize(num_returns);
             for (int i = 0; i < num_returns; ++i) {
                 lidar_pubs[i] = nh.advertise<sensor_msgs::PointCloud2>(
-                    topic_for_return("points", i), 10);
+                    topic_for_return("points", i), queue_size);
             }
 
             auto point_type = pnh.param("point_type", std::string{"original"});
-            processors.push_back(
-                PointCloudProcessorFactory::create_point_cloud_processor(point_type,
-                    info, tf_bcast.point_cloud_frame_id(),
-                    tf_bcast.apply_lidar_to_sensor_transform(),
-                    [this](PointCloudProcessor_OutputType msgs) {
-                        for (size_t i = 0; i < msgs.size(); ++i) {
-                            if (msgs[i]->header.stamp > last_msg_ts)
-                                last_msg_ts = msgs[i]->header.stamp;
-                            lidar_pubs[i].publish(*msgs[i]);
-                        }
-                    }
-                )
-            );
+            auto wire_format = pnh.param("point_cloud_wire_format", false);
+            if (wire_format) {
+                NODELET_INFO("OusterCloud: composing point clouds directly "
+                             "into their serialized form");
+                add_processor("PCL",
+                    PointCloudProcessorFactory::create_serialized_point_cloud_processor(
+                        point_type, info, tf_bcast.point_cloud_frame_id(),
+                        tf_bcast.apply_lidar_to_sensor_transform(),
+                        [this](PointCloudProcessor_SerializedOutputType msgs) {
+                            for (size_t i = 0; i < msgs.size(); ++i) {
+                                if (!msgs[i]) continue;
+                                update_last_msg_ts(msgs[i]->stamp);
+                                publishing_stage->publish(lidar_pubs[i], msgs[i]);
+                            }
+                        },
+                        has_subscribers(lidar_pubs)
+                    )
+                );
+            } else {
+                add_processor("PCL",
+                    PointCloudProcessorFactory::create_point_cloud_processor(point_type,
+                        info, tf_bcast.point_cloud_frame_id(),
+                        tf_bcast.apply_lidar_to_sensor_transform(),
+                        [this](PointCloudProcessor_OutputType msgs) {
+                            for (size_t i = 0; i < msgs.size(); ++i) {
+                                if (!msgs[i]) continue;
+                                update_last_msg_ts(msgs[i]->header.stamp);
+                                publishing_stage->publish(lidar_pubs[i], msgs[i]);
+                            }
+                        },
+                        has_subscribers(lidar_pubs)
+                    )
+                );
+            }
 
             // warn about profile incompatibility
             if (PointCloudProcessorFactory::point_type_requires_intensity(point_type) &&
@@ -143,10 +210,15 @@ class OusterCloud : public nodelet::Nodelet {
         }
 
         if (impl::check_token(tokens, "SCAN")) {
+            auto scan_config = LaserScanConfig::from_parameters(pnh, info);
             scan_pubs.resize(num_returns);
             for (int i = 0; i < num_returns; ++i) {
                 scan_pubs[i] = nh.advertise<sensor_msgs::LaserScan>(
-                    topic_for_return("scan", i), 10);
+                    topic_for_return("scan", i), queue_size);
+            }
+            for (auto ring : scan_config.extra_rings) {
+                scan_pubs.push_back(nh.advertise<sensor_msgs::LaserScan>(
+                    "scan_ring_" + std::to_string(ring), queue_size));
             }
 
             // TODO: avoid this duplication in os_cloud_node
@@ -160,28 +232,87 @@ class OusterCloud : public nodelet::Nodelet {
                     "ring value clamped to: " << scan_ring);
             }
 
-            processors.push_back(LaserScanProcessor::create(
+            add_processor("SCAN", LaserScanProcessor::create(
                 info, tf_bcast.lidar_frame_id(), scan_ring,
                 [this](LaserScanProcessor::OutputType msgs) {
                     for (size_t i = 0; i < msgs.size(); ++i) {
-                        if (msgs[i]->header.stamp > last_msg_ts)
-                            last_msg_ts = msgs[i]->header.stamp;
-                        scan_pubs[i].publish(*msgs[i]);
+                        if (!msgs[i]) continue;
+                        update_last_msg_ts(msgs[i]->header.stamp);
+                        publishing_stage->publish(scan_pubs[i], msgs[i]);
                     }
-                }));
+                },
+                has_subscribers(scan_pubs), scan_config));
         }
 
         if (impl::check_token(tokens, "PCL") || impl::check_token(tokens, "SCAN")) {
+            // scans are processed by the scan processing stage when enabled
+            scan_processing_stage = ScanProcessingStage::create_from_parameters(
+                pnh, info, processors);
+            if (scan_processing_stage)
+                processors = {scan_processing_stage->submitter()};
+
             lidar_packet_handler = LidarPacketHandler::create_handler(
                 info, processors, timestamp_mode,
                 static_cast<int64_t>(ptp_utc_tai_offset * 1e+9));
-            lidar_packet_sub = nh.subscribe<PacketMsg>(
-                "lidar_packets", 100, [this](const PacketMsg::ConstPtr msg) {
-                    lidar_packet_handler(msg->buf.data());
-                });
+            lidar_packet_sub.shutdown();  // before its queue is replaced
+            lidar_spinner = create_spinner(
+                "lidar", pnh.param("lidar_callback_threads", 1), 0);
+            lidar_packet_sub =
+                node_handle_for(lidar_spinner.get())
+                    .subscribe<PacketMsg>(
+                        "lidar_packets", packets_queue_size,
+                        [this](const PacketMsg::ConstPtr msg) {
+                            lidar_packet_handler(msg->buf.data());
+                        });
         }
     }
 
+    // packets are served by the shared queue of the nodelet manager when
+    // threads_count is zero, in which case no spinner is created
+    static std::unique_ptr<CallbackQueueSpinner> create_spinner(
+        const std::string& name, int threads_count, int priority) {
+        if (threads_count <= 0) return nullptr;
+        return std::make_unique<CallbackQueueSpinner>(name, threads_count,
+                                                      priority);
+    }
+
+    ros::NodeHandle node_handle_for(CallbackQueueSpinner* spinner) {
+        ros::NodeHandle nh(getNodeHandle());
+        if (spinner) nh.setCallbackQueue(spinner->queue());
+        return nh;
+    }
+
+    // the ros time is shared with the transforms broadcast timer
+    void update_last_msg_ts(const ros::Time& ts) {
+        const uint64_t ts_ns = ts.toNSec();
+        uint64_t last = last_msg_ts.load();
+        while (ts_ns > last &&
+               !last_msg_ts.compare_exchange_weak(last, ts_ns)) {
+        }
+    }
+
+    // reports the time imu packets take from their receipt to the
+    // publishing of their imu message, called from the imu callback only
+    void record_imu_latency(const ros::Time& receipt_time) {
+        if (imu_latency_report_period <= 0.0) return;
+        const double latency_ms =
+            (ros::Time::now() - receipt_time).toSec() * 1e3;
+        ++imu_latency.count;
+        imu_latency.total_ms += latency_ms;
+        imu_latency.max_ms = std::max(imu_latency.max_ms, latency_ms);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - imu_latency.last_report <
+            std::chrono::duration<double>(imu_latency_report_period))
+            return;
+        NODELET_INFO_STREAM("imu latency: mean "
+                            << imu_latency.total_ms / imu_latency.count
+                            << " ms, max " << imu_latency.max_ms << " ms over "
+                            << imu_latency.count << " packets");
+        imu_latency = ImuLatencyStats{};
+        imu_latency.last_report = now;
+    }
+
    private:
     ros::Subscriber metadata_sub;
     ros::Subscriber imu_packet_sub;
@@ -189,6 +320,9 @@ class OusterCloud : public nodelet::Nodelet {
     ros::Subscriber lidar_packet_sub;
     std::vector<ros::Publisher> lidar_pubs;
     std::vector<ros::Publisher> scan_pubs;
+    std::unique_ptr<PublishingStage> publishing_stage;
+    std::unique_ptr<ScanDeadline> scan_deadline;
+    std::unique_ptr<ScanProcessingStage> scan_processing_stage;
 
     OusterTransformsBroadcaster tf_bcast;
 
@@ -196,7 +330,21 @@ class OusterCloud : public nodelet::Nodelet {
     LidarPacketHandler::HandlerType lidar_packet_handler;
 
     ros::Timer timer_;
-    ros::Time last_msg_ts;
+    std::atomic<uint64_t> last_msg_ts = {0};
+
+    struct ImuLatencyStats {
+        size_t count = 0;
+        double total_ms = 0.0;
+        double max_ms = 0.0;
+        std::chrono::steady_clock::time_point last_report =
+            std::chrono::steady_clock::now();
+    };
+    double imu_latency_report_period = 0.0;
+    ImuLatencyStats imu_latency;
+
+    // the dedicated queues of the packet subscriptions
+    std::unique_ptr<CallbackQueueSpinner> imu_spinner;
+    std::unique_ptr<CallbackQueueSpinner> lidar_spinner;
 };
 
 }  // namespace ouster_ros
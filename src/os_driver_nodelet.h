@@ -0,0 +1,522 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file os_driver_nodelet.h
+ * @brief This node combines the capabilities of os_sensor, os_cloud and os_img
+ * into a single ROS nodelet
+ */
+
+#pragma once
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <std_msgs/UInt8.h>
+
+#include "ouster_ros/GetScanAtTime.h"
+#include "os_sensor_nodelet.h"
+#include "os_transforms_broadcaster.h"
+#include "imu_packet_handler.h"
+#include "lidar_packet_handler.h"
+#include "point_cloud_processor.h"
+#include "laser_scan_processor.h"
+#include "image_processor.h"
+#include "load_shedding.h"
+#include "camera_projection_processor.h"
+#include "sector_ranges_processor.h"
+#include "point_cloud_processor_factory.h"
+#include "publishing_stage.h"
+#include "scan_deadline.h"
+#include "scan_history.h"
+#include "scan_processing_stage.h"
+
+namespace sensor = ouster::sensor;
+
+namespace ouster_ros {
+
+class OusterDriver : public OusterSensor {
+   public:
+    OusterDriver() : tf_bcast(getName()) {}
+    ~OusterDriver() override {
+        NODELET_DEBUG("OusterDriver::~OusterDriver() called");
+        halt();
+    }
+
+   protected:
+    virtual void on_metadata_updated(const sensor::sensor_info& info) override {
+        OusterSensor::on_metadata_updated(info);
+
+        // for OusterDriver we are going to always assume static broadcast
+        // at least for now
+        tf_bcast.parse_parameters(getPrivateNodeHandle());
+        tf_bcast.broadcast_transforms(info);
+    }
+
+    virtual void create_publishers() override {
+        auto& pnh = getPrivateNodeHandle();
+        auto proc_mask =
+            pnh.param("proc_mask", std::string{"IMU|IMG|PCL|SCAN"});
+        auto tokens = impl::parse_tokens(proc_mask, '|');
+
+        auto timestamp_mode = pnh.param("timestamp_mode", std::string{});
+        double ptp_utc_tai_offset = pnh.param("ptp_utc_tai_offset", -37.0);
+
+        // in offline mode publishers hold messages for slow subscribers
+        // instead of dropping them
+        const bool offline_mode = pnh.param("offline_mode", false);
+        const int queue_size = offline_mode ? 0 : 10;
+
+        auto& nh = getNodeHandle();
+
+        publishing_stage = PublishingStage::create_from_parameters(pnh);
+
+        if (impl::check_token(tokens, "IMU")) {
+            imu_pub =
+                nh.advertise<sensor_msgs::Imu>("imu", offline_mode ? 0 : 100);
+            imu_packet_handler = ImuPacketHandler::create_handler(
+                info, tf_bcast.imu_frame_id(), timestamp_mode,
+                static_cast<int64_t>(ptp_utc_tai_offset * 1e+9));
+        }
+
+        int num_returns = get_n_returns(info);
+
+        // consecutive scans are processed concurrently by that many workers
+        const int scan_workers = std::max(pnh.param("scan_workers", 1), 1);
+
+        create_load_shedder(scan_workers);
+
+        // each worker gets its own instance of the processors, except for the
+        // frame ordered ones that carry state from one scan to the next; they
+        // run once per scan, in scan order
+        std::vector<std::vector<LidarScanProcessor>> worker_processors(
+            scan_workers);
+        std::vector<LidarScanProcessor> ordered_processors;
+        // processors of outputs named after their proc_mask flag, late scans
+        // may skip them when a scan deadline is set
+        scan_deadline = ScanDeadline::create_from_parameters(pnh);
+        auto add_processor = [&](const std::string& output,
+                                 std::function<LidarScanProcessor()> create,
+                                 bool frame_ordered = false) {
+            auto guarded = [&]() {
+                auto processor = create();
+                return scan_deadline ? scan_deadline->guard(output, processor)
+                                     : processor;
+            };
+            if (frame_ordered && scan_workers > 1) {
+                ordered_processors.push_back(guarded());
+                return;
+            }
+            for (auto& processors : worker_processors)
+                processors.push_back(guarded());
+        };
+        if (impl::check_token(tokens, "PCL")) {
+            lidar_pubs.resize(num_returns);
+            for (int i = 0; i < num_returns; ++i) {
+                lidar_pubs[i] = nh.advertise<sensor_msgs::PointCloud2>(
+                    topic_for_return("points", i), queue_size);
+            }
+
+            auto point_type = pnh.param("point_type", std::string{"original"});
+            auto wire_format = pnh.param("point_cloud_wire_format", false);
+            if (wire_format) {
+                NODELET_INFO("OusterDriver: composing point clouds directly "
+                             "into their serialized form");
+                add_processor("PCL", [&]() { return
+                    PointCloudProcessorFactory::create_serialized_point_cloud_processor(
+                        point_type, info, tf_bcast.point_cloud_frame_id(),
+                        tf_bcast.apply_lidar_to_sensor_transform(),
+                        [this](PointCloudProcessor_SerializedOutputType msgs) {
+                            for (size_t i = 0; i < msgs.size(); ++i)
+                                if (msgs[i])
+                                    publishing_stage->publish(lidar_pubs[i], msgs[i]);
+                        },
+                        [this](int i) { return cloud_active(i); }
+                    ); }
+                );
+            } else {
+                add_processor("PCL", [&]() { return
+                    PointCloudProcessorFactory::create_point_cloud_processor(point_type, info,
+                        tf_bcast.point_cloud_frame_id(), tf_bcast.apply_lidar_to_sensor_transform(),
+                        [this](PointCloudProcessor_OutputType msgs) {
+                            for (size_t i = 0; i < msgs.size(); ++i)
+                                if (msgs[i])
+                                    publishing_stage->publish(lidar_pubs[i], msgs[i]);
+                        },
+                        [this](int i) { return cloud_active(i); }
+                    ); }
+                );
+            }
+
+            // warn about profile incompatibility
+            if (PointCloudProcessorFactory::point_type_requires_intensity(point_type) &&
+                info.format.udp_profile_lidar == UDPProfileLidar::PROFILE_RNG15_RFL8_NIR8) {
+                NODELET_WARN_STREAM(
+                    "selected point type '" << point_type << "' is not compatible with the current udp profile: RNG15_RFL8_NIR8");
+            }
+        }
+
+        if (impl::check_token(tokens, "SCAN")) {
+            auto scan_config = LaserScanConfig::from_parameters(pnh, info);
+            scan_pubs.resize(num_returns);
+            for (int i = 0; i < num_returns; ++i) {
+                scan_pubs[i] = nh.advertise<sensor_msgs::LaserScan>(
+                    topic_for_return("scan", i), queue_size);
+            }
+            for (auto ring : scan_config.extra_rings) {
+                scan_pubs.push_back(nh.advertise<sensor_msgs::LaserScan>(
+                    "scan_ring_" + std::to_string(ring), queue_size));
+            }
+
+            // TODO: avoid duplication in os_cloud_node
+            int beams_count = static_cast<int>(get_beams_count(info));
+            int scan_ring = pnh.param("scan_ring", 0);
+            scan_ring = std::min(std::max(scan_ring, 0), beams_count - 1);
+            if (scan_ring != pnh.param("scan_ring", 0)) {
+                NODELET_WARN_STREAM(
+                    "scan ring is set to a value that exceeds available range"
+                    "please choose a value between [0, " << beams_count <<
+                    "], ring value clamped to: " << scan_ring);
+            }
+
+            add_processor("SCAN", [&]() { return LaserScanProcessor::create(
+                info, tf_bcast.lidar_frame_id(), scan_ring,
+                [this](LaserScanProcessor::OutputType msgs) {
+                    for (size_t i = 0; i < msgs.size(); ++i) {
+                        if (msgs[i])
+                            publishing_stage->publish(scan_pubs[i], msgs[i]);
+                    }
+                },
+                [this](int i) {
+                    return (!load_shedder || load_shedder->return_active(i)) &&
+                           scan_pubs[i].getNumSubscribers() > 0;
+                },
+                scan_config); });
+        }
+
+        if (impl::check_token(tokens, "IMG")) {
+            const std::map<sensor::ChanField, std::string>
+                channel_field_topic_map_1{
+                    {sensor::ChanField::RANGE, "range_image"},
+                    {sensor::ChanField::SIGNAL, "signal_image"},
+                    {sensor::ChanField::REFLECTIVITY, "reflec_image"},
+                    {sensor::ChanField::NEAR_IR, "nearir_image"}};
+
+            const std::map<sensor::ChanField, std::string>
+                channel_field_topic_map_2{
+                    {sensor::ChanField::RANGE, "range_image"},
+                    {sensor::ChanField::SIGNAL, "signal_image"},
+                    {sensor::ChanField::REFLECTIVITY, "reflec_image"},
+                    {sensor::ChanField::NEAR_IR, "nearir_image"},
+                    {sensor::ChanField::RANGE2, "range_image2"},
+                    {sensor::ChanField::SIGNAL2, "signal_image2"},
+                    {sensor::ChanField::REFLECTIVITY2, "reflec_image2"}};
+
+            auto image_config = ImageProcessorConfig::from_parameters(pnh);
+            if (pnh.param("image_stack", false)) {
+                NODELET_INFO("OusterDriver: publishing images as a stack");
+                image_stack_pub =
+                    nh.advertise<ouster_ros::ImageStack>("image_stack",
+                                                         queue_size);
+                add_processor("IMG", [&]() { return ImageProcessor::create(
+                    info, tf_bcast.point_cloud_frame_id(),
+                    [this](ouster_ros::ImageStackConstPtr msg) {
+                        publishing_stage->publish(image_stack_pub, msg);
+                    },
+                    [this](sensor::ChanField channel) {
+                        return (!load_shedder ||
+                                load_shedder->image_active(channel)) &&
+                               image_stack_pub.getNumSubscribers() > 0;
+                    },
+                    image_config); }, true);
+            } else {
+                auto which_map = num_returns == 1 ? &channel_field_topic_map_1
+                                                  : &channel_field_topic_map_2;
+                for (auto it = which_map->begin(); it != which_map->end(); ++it) {
+                    image_pubs[it->first] =
+                        nh.advertise<sensor_msgs::Image>(it->second, queue_size);
+                }
+
+                add_processor("IMG", [&]() { return ImageProcessor::create(
+                    info, tf_bcast.point_cloud_frame_id(),
+                    [this](ImageProcessor::OutputType msgs) {
+                        for (auto it = msgs.begin(); it != msgs.end(); ++it) {
+                            if (it->second)
+                                publishing_stage->publish(image_pubs[it->first],
+                                                          it->second);
+                        }
+                    },
+                    [this](sensor::ChanField channel) {
+                        return (!load_shedder ||
+                                load_shedder->image_active(channel)) &&
+                               image_pubs[channel].getNumSubscribers() > 0;
+                    },
+                    image_config); }, true);
+            }
+        }
+
+        if (impl::check_token(tokens, "PROJ")) {
+            auto projection_config =
+                CameraProjectionConfig::from_parameters(pnh);
+            if (projection_config.cameras.empty()) {
+                NODELET_WARN("OusterDriver: no camera to project points "
+                             "into, PROJ output disabled");
+            } else {
+                for (const auto& camera : projection_config.cameras) {
+                    const auto ns = "camera_projection/" + camera.name + "/";
+                    projection_pubs.push_back(
+                        {nh.advertise<sensor_msgs::Image>(ns + "depth",
+                                                          queue_size),
+                         nh.advertise<sensor_msgs::Image>(ns + "intensity",
+                                                          queue_size)});
+                }
+                NODELET_INFO_STREAM("OusterDriver: projecting points into "
+                                    << projection_config.cameras.size()
+                                    << " camera images");
+                add_processor("PROJ", [&]() { return CameraProjectionProcessor::create(
+                    info, tf_bcast.apply_lidar_to_sensor_transform(),
+                    projection_config,
+                    [this](CameraProjectionProcessor::OutputType msgs) {
+                        for (size_t i = 0; i < msgs.size(); ++i) {
+                            if (!msgs[i].depth) continue;
+                            publishing_stage->publish(
+                                projection_pubs[i].first, msgs[i].depth);
+                            publishing_stage->publish(
+                                projection_pubs[i].second, msgs[i].intensity);
+                        }
+                    },
+                    [this](int camera) {
+                        if (load_shedder && !load_shedder->images_active())
+                            return false;
+                        const auto& pubs = projection_pubs[camera];
+                        return pubs.first.getNumSubscribers() > 0 ||
+                               pubs.second.getNumSubscribers() > 0;
+                    }); });
+            }
+        }
+
+        std::vector<LidarPacketProcessor> packet_processors;
+        if (impl::check_token(tokens, "SECTOR")) {
+            // published directly, queuing would only add to their latency
+            sector_ranges_pub = nh.advertise<ouster_ros::SectorRanges>(
+                "sector_ranges", queue_size);
+            packet_processors.push_back(SectorRangesProcessor::create(
+                info, tf_bcast.point_cloud_frame_id(),
+                tf_bcast.apply_lidar_to_sensor_transform(),
+                sector_ranges_config_from_parameters(pnh), timestamp_mode,
+                static_cast<int64_t>(ptp_utc_tai_offset * 1e+9),
+                [this](SectorRangesProcessor::OutputType msg) {
+                    sector_ranges_pub.publish(msg);
+                }));
+        }
+
+        const int scan_history_size = pnh.param("scan_history_size", 0);
+        if (scan_history_size > 0) {
+            auto history = create_scan_history(scan_history_size);
+            if (scan_workers > 1)
+                ordered_processors.push_back(history);
+            else
+                worker_processors[0].push_back(history);
+        }
+
+        if (load_shedder) {
+            for (auto& processors : worker_processors)
+                if (!processors.empty())
+                    processors = {load_shedder->wrap(processors)};
+            if (!ordered_processors.empty())
+                ordered_processors = {
+                    load_shedder->wrap_ordered(ordered_processors)};
+        }
+
+        // scans are processed by the scan processing stage when enabled,
+        // which several workers always need
+        scan_processing_stage = ScanProcessingStage::create_from_parameters(
+            pnh, info, worker_processors, ordered_processors);
+        auto processors = worker_processors[0];
+        if (scan_processing_stage)
+            processors = {scan_processing_stage->submitter()};
+        if (scan_processing_stage && scan_workers > 1)
+            NODELET_INFO_STREAM("OusterDriver: processing scans on "
+                                << scan_workers << " worker threads");
+
+        if (processors.empty() && packet_processors.empty()) return;
+        create_lidar_packet_handler = [this, processors, timestamp_mode,
+                                       ptp_utc_tai_offset,
+                                       packet_processors]() {
+            return LidarPacketHandler::create_handler(
+                info, processors, timestamp_mode,
+                static_cast<int64_t>(ptp_utc_tai_offset * 1e+9),
+                initial_scan_ts_state, packet_processors);
+        };
+        lidar_packet_handler = create_lidar_packet_handler();
+    }
+
+    // drops the scan being assembled and starts over from
+    // initial_scan_ts_state, as when the replay of a recording starts over;
+    // must be called from the thread that handles the lidar packets
+    void reset_lidar_packet_handler() {
+        if (create_lidar_packet_handler)
+            lidar_packet_handler = create_lidar_packet_handler();
+    }
+
+    // degrades outputs while processing can't keep up with the sensor when
+    // load_shedding is set, the current level is published on change; with
+    // several workers each has as many scan periods per scan, while the
+    // frame ordered processors are timed against a single scan period
+    void create_load_shedder(int scan_workers) {
+        auto& pnh = getPrivateNodeHandle();
+        if (!pnh.param("load_shedding", false)) return;
+        if (pnh.param("offline_mode", false)) {
+            NODELET_INFO("offline mode: load shedding disabled");
+            return;
+        }
+        load_shedding_pub = getNodeHandle().advertise<std_msgs::UInt8>(
+            "load_shedding_level", 1, true);
+        auto publish_level = [this](int level) {
+            std_msgs::UInt8 msg;
+            msg.data = static_cast<uint8_t>(level);
+            load_shedding_pub.publish(msg);
+        };
+        load_shedder = std::make_unique<LoadShedder>(
+            LoadSheddingConfig::from_parameters(pnh),
+            1.0 / sensor::frequency_of_lidar_mode(info.mode),
+            get_n_returns(info), publish_level, scan_workers);
+        publish_level(0);
+        NODELET_INFO("OusterDriver: load shedding enabled");
+    }
+
+    bool cloud_active(int return_index) const {
+        return (!load_shedder || load_shedder->cloud_active(return_index)) &&
+               lidar_pubs[return_index].getNumSubscribers() > 0;
+    }
+
+    // keeps the last size scans and serves the columns covering a time
+    // through get_scan_at_time
+    LidarScanProcessor create_scan_history(size_t size) {
+        NODELET_INFO_STREAM("OusterDriver: keeping a history of the last "
+                            << size << " scans");
+        scan_history = std::make_shared<ScanHistory>(info, size);
+        ouster::mat4d additional_transform =
+            tf_bcast.apply_lidar_to_sensor_transform()
+                ? info.lidar_to_sensor_transform
+                : ouster::mat4d::Identity();
+        auto xyz_lut = ouster::make_xyz_lut(
+            info.format.columns_per_frame, info.format.pixels_per_column,
+            ouster::sensor::range_unit, info.beam_to_lidar_transform,
+            additional_transform, info.beam_azimuth_angles,
+            info.beam_altitude_angles);
+        history_lut_direction = xyz_lut.direction.cast<float>();
+        history_lut_offset = xyz_lut.offset.cast<float>();
+        get_scan_at_time_srv =
+            getNodeHandle()
+                .advertiseService<GetScanAtTime::Request,
+                                  GetScanAtTime::Response>(
+                    "get_scan_at_time", [this](GetScanAtTime::Request& req,
+                                               GetScanAtTime::Response& res) {
+                        const uint64_t ts = req.stamp.toNSec();
+                        const uint64_t window = static_cast<uint64_t>(
+                            std::max<int64_t>(req.window.toNSec(), 0));
+                        auto match =
+                            window == 0
+                                ? scan_history->find(ts)
+                                : scan_history->find(
+                                      ts - std::min(ts, window), ts + window);
+                        if (!match.scan) return false;
+                        res.scan_stamp.fromNSec(match.scan_ts);
+                        res.first_column = match.first_col;
+                        res.last_column = match.last_col;
+                        res.first_column_stamp.fromNSec(match.first_col_ts);
+                        res.last_column_stamp.fromNSec(match.last_col_ts);
+                        scan_columns_to_cloud(match, history_lut_direction,
+                                              history_lut_offset, res.cloud);
+                        res.cloud.header.stamp = res.scan_stamp;
+                        res.cloud.header.frame_id =
+                            tf_bcast.point_cloud_frame_id();
+                        return true;
+                    });
+        NODELET_INFO("get_scan_at_time service created");
+
+        return [this](const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
+                      const ros::Time& msg_ts) {
+            if (!scan_history->add(lidar_scan, msg_ts.toNSec(), scan_ts))
+                NODELET_WARN_THROTTLE(
+                    10, "scan history dropped a scan, all buffers are held");
+        };
+    }
+
+    virtual void on_lidar_packet_msg(const uint8_t* raw_lidar_packet) override {
+        if (lidar_packet_handler) lidar_packet_handler(raw_lidar_packet);
+    }
+
+    virtual void on_imu_packet_msg(const uint8_t* raw_imu_packet) override {
+        if (imu_packet_handler)
+            imu_pub.publish(imu_packet_handler(raw_imu_packet));
+    }
+
+    // blocks until the messages produced so far were handed to publishers
+    void flush_publishing() {
+        if (scan_processing_stage) scan_processing_stage->flush();
+        if (publishing_stage) publishing_stage->flush();
+    }
+
+    bool has_output_subscribers() const {
+        auto subscribed = [](const ros::Publisher& pub) {
+            return pub.getNumSubscribers() > 0;
+        };
+        return subscribed(imu_pub) || subscribed(image_stack_pub) ||
+               subscribed(sector_ranges_pub) ||
+               std::any_of(lidar_pubs.begin(), lidar_pubs.end(), subscribed) ||
+               std::any_of(scan_pubs.begin(), scan_pubs.end(), subscribed) ||
+               std::any_of(projection_pubs.begin(), projection_pubs.end(),
+                           [&](const auto& pubs) {
+                               return subscribed(pubs.first) ||
+                                      subscribed(pubs.second);
+                           }) ||
+               std::any_of(image_pubs.begin(), image_pubs.end(),
+                           [&](const auto& it) { return subscribed(it.second); });
+    }
+
+   protected:
+    // timestamp interpolation state of the scan preceding the first packet,
+    // must be set before create_publishers() to take effect
+    LidarScanTimestampState initial_scan_ts_state;
+
+    // the most recent scans when scan_history_size is set, scans taken from
+    // it are shared and stay valid for as long as they are held
+    std::shared_ptr<ScanHistory> scan_history;
+
+   private:
+    ros::Publisher imu_pub;
+    std::vector<ros::Publisher> lidar_pubs;
+    std::vector<ros::Publisher> scan_pubs;
+    std::map<sensor::ChanField, ros::Publisher> image_pubs;
+    ros::Publisher image_stack_pub;
+    ros::Publisher sector_ranges_pub;
+    // depth and intensity image publishers of each projection camera
+    std::vector<std::pair<ros::Publisher, ros::Publisher>> projection_pubs;
+    ros::ServiceServer get_scan_at_time_srv;
+    // xyz lookup table of the clouds returned by get_scan_at_time
+    ouster::PointsF history_lut_direction;
+    ouster::PointsF history_lut_offset;
+    std::unique_ptr<PublishingStage> publishing_stage;
+    std::unique_ptr<ScanDeadline> scan_deadline;
+    ros::Publisher load_shedding_pub;
+    std::unique_ptr<LoadShedder> load_shedder;
+    // declared after publishing_stage and scan_deadline, its thread may
+    // still run processors while it drains the queue on destruction
+    std::unique_ptr<ScanProcessingStage> scan_processing_stage;
+
+    OusterTransformsBroadcaster tf_bcast;
+
+    ImuPacketHandler::HandlerType imu_packet_handler;
+    std::function<LidarPacketHandler::HandlerType()>
+        create_lidar_packet_handler;
+    LidarPacketHandler::HandlerType lidar_packet_handler;
+};
+
+}  // namespace ouster_ros
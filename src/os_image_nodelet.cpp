@@ -6,9 +6,11 @@
  * @brief A nodelet to decode range, near ir and signal images from ouster
  * point cloud
  *
- * Publishes ~/range_image, ~/nearir_image, and ~/signal_image.  Please bear
- * in mind that there is rounding/clamping to display 8 bit images. For computer
- * vision applications, use higher bit depth values in /os_cloud_node/points
+ * Publishes ~/range_image, ~/nearir_image, and ~/signal_image, or a single
+ * ~/image_stack when the image_stack parameter is set.  Please bear
+ * in mind that images are auto exposed for display by default. For computer
+ * vision applications, choose the 32FC1 encoding through the
+ * <channel>_image_encoding parameters to get range in meters and raw values.
  */
 
 // prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
@@ -23,6 +25,9 @@
 
 #include "lidar_packet_handler.h"
 #include "image_processor.h"
+#include "publishing_stage.h"
+#include "scan_deadline.h"
+#include "scan_processing_stage.h"
 
 namespace ouster_ros {
 
@@ -77,28 +82,71 @@ class OusterImage : public nodelet::Nodelet {
         auto which_map = n_returns == 1 ? &channel_field_topic_map_1
                                         : &channel_field_topic_map_2;
 
-        auto& nh = getNodeHandle();
+        // in offline mode packets and images are queued without bound
+        // instead of being dropped when the processing falls behind
+        const bool offline_mode = pnh.param("offline_mode", false);
+        const int queue_size = offline_mode ? 0 : 100;
 
-        for (auto it = which_map->begin(); it != which_map->end(); ++it) {
-            image_pubs[it->first] =
-                nh.advertise<sensor_msgs::Image>(it->second, 100);
-        }
+        auto& nh = getNodeHandle();
 
-        std::vector<LidarScanProcessor> processors {
-            ImageProcessor::create(
+        publishing_stage = PublishingStage::create_from_parameters(pnh);
+
+        auto image_config = ImageProcessorConfig::from_parameters(pnh);
+        std::vector<LidarScanProcessor> processors;
+        // processors of outputs named after their proc_mask flag, late scans
+        // may skip them when a scan deadline is set
+        scan_deadline = ScanDeadline::create_from_parameters(pnh);
+        auto add_processor = [&](const std::string& output,
+                                 LidarScanProcessor processor) {
+            processors.push_back(scan_deadline
+                                     ? scan_deadline->guard(output, processor)
+                                     : processor);
+        };
+        if (pnh.param("image_stack", false)) {
+            NODELET_INFO("OusterImage: publishing images as a stack");
+            image_stack_pub =
+                nh.advertise<ouster_ros::ImageStack>("image_stack", queue_size);
+            add_processor("IMG", ImageProcessor::create(
+                info, "os_lidar", /*TODO: tf_bcast.point_cloud_frame_id()*/
+                [this](ouster_ros::ImageStackConstPtr msg) {
+                    publishing_stage->publish(image_stack_pub, msg);
+                },
+                [this](sensor::ChanField) {
+                    return image_stack_pub.getNumSubscribers() > 0;
+                },
+                image_config));
+        } else {
+            for (auto it = which_map->begin(); it != which_map->end(); ++it) {
+                image_pubs[it->first] =
+                    nh.advertise<sensor_msgs::Image>(it->second, queue_size);
+            }
+
+            add_processor("IMG", ImageProcessor::create(
                 info, "os_lidar", /*TODO: tf_bcast.point_cloud_frame_id()*/
                 [this](ImageProcessor::OutputType msgs) {
                     for (auto it = msgs.begin(); it != msgs.end(); ++it) {
-                        image_pubs[it->first].publish(*it->second);
+                        if (it->second)
+                            publishing_stage->publish(image_pubs[it->first],
+                                                      it->second);
                     }
-                })
-        };
+                },
+                [this](sensor::ChanField channel) {
+                    return image_pubs[channel].getNumSubscribers() > 0;
+                },
+                image_config));
+        }
+
+        // scans are processed by the scan processing stage when enabled
+        scan_processing_stage =
+            ScanProcessingStage::create_from_parameters(pnh, info, processors);
+        if (scan_processing_stage)
+            processors = {scan_processing_stage->submitter()};
 
         lidar_packet_handler = LidarPacketHandler::create_handler(
             info, processors, timestamp_mode,
             static_cast<int64_t>(ptp_utc_tai_offset * 1e+9));
         lidar_packet_sub = nh.subscribe<PacketMsg>(
-                "lidar_packets", 100,
+                "lidar_packets", queue_size,
                 [this](const PacketMsg::ConstPtr msg) {
                     lidar_packet_handler(msg->buf.data());
                 });
@@ -110,6 +158,10 @@ class OusterImage : public nodelet::Nodelet {
 
     ros::Subscriber lidar_packet_sub;
     std::map<sensor::ChanField, ros::Publisher> image_pubs;
+    ros::Publisher image_stack_pub;
+    std::unique_ptr<PublishingStage> publishing_stage;
+    std::unique_ptr<ScanDeadline> scan_deadline;
+    std::unique_ptr<ScanProcessingStage> scan_processing_stage;
 
     LidarPacketHandler::HandlerType lidar_packet_handler;
 };
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file os_packet_recorder_nodelet.cpp
+ * @brief A nodelet that records the raw lidar and imu packets into memory
+ * mapped segment files
+ *
+ * Loaded into the same manager as os_node or os_driver the packets are
+ * received without copy or serialization and written straight into the
+ * mapped segments.
+ */
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <ros/ros.h>
+#include <std_msgs/String.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+
+#include "ouster_ros/PacketMsg.h"
+#include "segment_writer.h"
+
+namespace ouster_ros {
+
+using ouster_ros::PacketMsg;
+
+class OusterPacketRecorder : public nodelet::Nodelet {
+   public:
+    ~OusterPacketRecorder() override {
+        lidar_packet_sub.shutdown();
+        imu_packet_sub.shutdown();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!writer) return;
+        NODELET_INFO_STREAM("OusterPacketRecorder: recorded "
+                            << writer->bytes_written() << " bytes of packets"
+                            << " into " << writer->segments().size()
+                            << " segments");
+        writer.reset();
+    }
+
+   private:
+    virtual void onInit() override {
+        auto& pnh = getPrivateNodeHandle();
+        config.prefix = pnh.param("segment_prefix", std::string{"ouster"});
+        auto segment_size_mb = pnh.param("segment_size_mb", 1024);
+        auto segment_duration = pnh.param("segment_duration", 0.0);
+        if (segment_size_mb <= 0) {
+            NODELET_ERROR("segment_size_mb must be a positive value");
+            throw std::runtime_error("invalid segment_size_mb");
+        }
+        config.segment_size = static_cast<size_t>(segment_size_mb) << 20;
+        config.segment_duration =
+            static_cast<uint64_t>(std::max(segment_duration, 0.0) * 1e9);
+
+        metadata_sub = getNodeHandle().subscribe<std_msgs::String>(
+            "metadata", 1, &OusterPacketRecorder::metadata_handler, this);
+        NODELET_INFO("OusterPacketRecorder: nodelet created!");
+    }
+
+    void metadata_handler(const std_msgs::String::ConstPtr& metadata_msg) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!writer) {
+            NODELET_INFO_STREAM("OusterPacketRecorder: recording packets to "
+                                << config.prefix << "_*"
+                                << segment::file_extension);
+            writer = std::make_unique<SegmentWriter>(config, metadata_msg->data);
+            create_subscribers();
+        } else {
+            NODELET_INFO("OusterPacketRecorder: sensor metadata changed, "
+                         "starting a new segment");
+            writer->set_metadata(metadata_msg->data);
+        }
+    }
+
+    void create_subscribers() {
+        lidar_packet_sub =
+            subscribe("lidar_packets", 1280, segment::LIDAR_PACKET);
+        imu_packet_sub = subscribe("imu_packets", 100, segment::IMU_PACKET);
+    }
+
+    // the message event carries the receipt time of the packet, which unlike
+    // the time the callback runs doesn't depend on how long it was queued
+    ros::Subscriber subscribe(const std::string& topic, uint32_t queue_size,
+                              segment::PacketType type) {
+        ros::SubscribeOptions ops;
+        ops.initByFullCallbackType<const ros::MessageEvent<PacketMsg const>&>(
+            topic, queue_size,
+            [this, type](const ros::MessageEvent<PacketMsg const>& event) {
+                record(type, event.getReceiptTime(),
+                       *event.getConstMessage());
+            });
+        return getNodeHandle().subscribe(ops);
+    }
+
+    void record(segment::PacketType type, const ros::Time& receipt_time,
+                const PacketMsg& msg) {
+        std::lock_guard<std::mutex> lock(mutex);
+        try {
+            writer->write(type, receipt_time.toNSec(), msg.buf.data(),
+                          msg.buf.size());
+        } catch (const std::runtime_error& e) {
+            NODELET_ERROR_STREAM_THROTTLE(
+                1, "OusterPacketRecorder: failed to record packet: "
+                       << e.what());
+        }
+    }
+
+   private:
+    ros::Subscriber metadata_sub;
+    ros::Subscriber lidar_packet_sub;
+    ros::Subscriber imu_packet_sub;
+
+    SegmentWriterConfig config;
+    std::mutex mutex;
+    std::unique_ptr<SegmentWriter> writer;
+};
+
+}  // namespace ouster_ros
+
+PLUGINLIB_EXPORT_CLASS(ouster_ros::OusterPacketRecorder, nodelet::Nodelet)
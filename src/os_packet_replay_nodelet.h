@@ -0,0 +1,266 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file os_packet_replay_nodelet.h
+ * @brief Base of the nodelets that replay recordings of sensor packets
+ * through the processing pipeline of os_driver without going through
+ * pub/sub
+ */
+
+#pragma once
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <std_msgs/Empty.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <thread>
+
+#include "frame_index.h"
+#include "os_driver_nodelet.h"
+#include "packet_source.h"
+#include "playback_pacer.h"
+
+namespace ouster_ros {
+
+/**
+ * @class OusterPacketReplay hands the packets of a recording directly to the
+ * packet handlers of OusterDriver on a dedicated thread.
+ *
+ * Derived classes open the recording and provide the sensor metadata, this
+ * class takes care of pacing (replay_rate), looping (replay_loop), limiting
+ * the replay to a time window (replay_start_offset, replay_end_offset), the
+ * offline mode and of signaling completion on the replay_completed topic.
+ *
+ * The replay can start at any frame of the recording (replay_start_frame)
+ * through a frame index that is built on first use and saved next to the
+ * recording, or to the file given by frame_index_file. The replay offsets
+ * then count from that frame rather than from the start of the recording.
+ *
+ * Each pass of a looped replay starts over from the timestamp interpolation
+ * state of the start frame, as the first pass does.
+ */
+class OusterPacketReplay : public OusterDriver {
+   public:
+    ~OusterPacketReplay() override { stop_replay_thread(); }
+
+   protected:
+    /**
+     * Opens the recording, implementations must also load cached_metadata
+     * and info and set recording_file.
+     */
+    virtual std::unique_ptr<PacketSource> open_recording(
+        const ros::NodeHandle& pnh) = 0;
+
+    // loads the metadata from the file given by the metadata parameter
+    void load_metadata_file(const ros::NodeHandle& pnh) {
+        auto meta_file = pnh.param("metadata", std::string{});
+        if (!is_arg_set(meta_file)) {
+            NODELET_ERROR("Must specify metadata file in replay mode");
+            throw std::runtime_error("metadata not specified");
+        }
+        cached_metadata = read_text_file(meta_file);
+        info = sensor::parse_metadata(cached_metadata);
+    }
+
+    // path of the replayed recording
+    std::string recording_file;
+
+   private:
+    virtual void onInit() override {
+        auto& pnh = getPrivateNodeHandle();
+        replay_rate = pnh.param("replay_rate", 1.0);
+        replay_loop = pnh.param("replay_loop", false);
+        replay_start_offset = pnh.param("replay_start_offset", 0.0);
+        replay_end_offset = pnh.param("replay_end_offset", 0.0);
+        offline_mode = pnh.param("offline_mode", false);
+        if (offline_mode && replay_rate > 0) {
+            NODELET_INFO("offline mode: replaying as fast as possible");
+            replay_rate = 0;
+        }
+
+        source = open_recording(pnh);
+        seek_start_frame(pnh);
+
+        create_metadata_publisher();
+        publish_metadata();
+        create_get_metadata_service();
+        on_metadata_updated(info);
+        create_publishers();
+        completed_pub = getNodeHandle().advertise<std_msgs::Empty>(
+            "replay_completed", 1, true);
+        start_replay_thread();
+        NODELET_INFO_STREAM("Replaying at "
+                            << (replay_rate > 0 ? std::to_string(replay_rate)
+                                                : std::string{"max"})
+                            << " rate");
+    }
+
+    // replays the recording once, returns false when interrupted or when
+    // there was nothing to replay
+    bool replay_pass(PlaybackPacer& pacer) {
+        using Clock = std::chrono::steady_clock;
+        const auto start_offset =
+            static_cast<int64_t>(std::max(replay_start_offset, 0.0) * 1e9);
+        const auto end_offset =
+            static_cast<int64_t>(std::max(replay_end_offset, 0.0) * 1e9);
+
+        if (start_frame_position)
+            source->seek(*start_frame_position);
+        else
+            source->rewind();
+        pacer.reset();
+        size_t lidar_packets = 0, imu_packets = 0, other_packets = 0;
+        bool first = true;
+        uint64_t first_ts = 0;
+        ReplayPacket packet;
+        const auto start = Clock::now();
+        while (replay_active && source->next(packet)) {
+            if (first) {
+                first_ts = packet.timestamp;
+                first = false;
+            }
+            // capture timestamps may go back in time in merged or reordered
+            // recordings, such packets count as captured at the start
+            const int64_t offset = std::max<int64_t>(
+                static_cast<int64_t>(packet.timestamp - first_ts), 0);
+            if (offset < start_offset) continue;
+            if (end_offset > 0 && offset > end_offset) break;
+
+            pacer.wait(packet.timestamp);
+            switch (packet.kind) {
+                case PacketKind::LIDAR:
+                    on_lidar_packet_msg(packet.data);
+                    ++lidar_packets;
+                    break;
+                case PacketKind::IMU:
+                    on_imu_packet_msg(packet.data);
+                    ++imu_packets;
+                    break;
+                default:
+                    ++other_packets;
+                    break;
+            }
+        }
+
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        NODELET_INFO_STREAM("replayed " << lidar_packets << " lidar and "
+                            << imu_packets << " imu packets in "
+                            << elapsed.count() << " s ("
+                            << lidar_packets / std::max(elapsed.count(), 1e-9)
+                            << " lidar packets/s), skipped " << other_packets
+                            << " other packets");
+        return replay_active && lidar_packets + imu_packets > 0;
+    }
+
+    // positions the replay at replay_start_frame, the timestamp interpolation
+    // state is restored so that the first scans are stamped as they would be
+    // when replaying the whole recording
+    void seek_start_frame(const ros::NodeHandle& pnh) {
+        int start_frame = pnh.param("replay_start_frame", 0);
+        if (start_frame <= 0) return;
+
+        auto index = load_frame_index(pnh);
+        if (static_cast<size_t>(start_frame) >= index.size()) {
+            NODELET_ERROR_STREAM("replay_start_frame " << start_frame
+                                 << " is beyond the last frame of the "
+                                    "recording: " << index.size() - 1);
+            throw std::runtime_error("replay_start_frame out of range");
+        }
+        const auto& entry = index[start_frame];
+        start_frame_position = entry.position;
+        initial_scan_ts_state = entry.timestamp_state();
+        NODELET_INFO_STREAM("Replay starts at frame " << start_frame
+                            << " (frame id " << entry.frame_id << ")");
+    }
+
+    // loads the frame index of the recording, (re)building it when it is
+    // missing or was built for a different version of the recording
+    FrameIndex load_frame_index(const ros::NodeHandle& pnh) {
+        auto index_file = pnh.param("frame_index_file", std::string{});
+        if (!is_arg_set(index_file))
+            index_file = recording_file + frame_index::file_extension;
+
+        struct stat st;
+        if (::stat(recording_file.c_str(), &st) != 0)
+            throw std::runtime_error("failed to stat " + recording_file);
+        const auto recording_size = static_cast<uint64_t>(st.st_size);
+
+        try {
+            auto index = FrameIndex::load(index_file);
+            if (index.recording_size() == recording_size) return index;
+            NODELET_WARN_STREAM("frame index " << index_file
+                                << " doesn't match the recording");
+        } catch (const std::runtime_error&) {
+            // no usable index yet
+        }
+
+        NODELET_INFO_STREAM("Building frame index " << index_file);
+        auto index = build_frame_index(*source, sensor::get_format(info),
+                                       recording_size);
+        try {
+            index.save(index_file);
+        } catch (const std::runtime_error& e) {
+            NODELET_WARN_STREAM("frame index not saved: " << e.what());
+        }
+        return index;
+    }
+
+    void start_replay_thread() {
+        replay_active = true;
+        replay_thread = std::make_unique<std::thread>([this]() {
+            if (offline_mode) wait_for_subscribers();
+            PlaybackPacer pacer(replay_rate);
+            while (replay_pass(pacer) && replay_loop) {
+                // the scan left incomplete by the previous pass and its
+                // timestamps have no bearing on the next pass
+                reset_lidar_packet_handler();
+            }
+            if (!replay_active) return;
+            // make sure every message was handed to its publisher before
+            // signaling completion
+            flush_publishing();
+            completed_pub.publish(std_msgs::Empty{});
+            NODELET_INFO("replay completed");
+        });
+    }
+
+    // messages published before a subscriber connects are lost, in offline
+    // mode nothing is replayed until at least one output is subscribed
+    void wait_for_subscribers() {
+        NODELET_INFO("offline mode: waiting for a subscriber to any output");
+        while (replay_active && !has_output_subscribers())
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    void stop_replay_thread() {
+        if (replay_thread && replay_thread->joinable()) {
+            replay_active = false;
+            replay_thread->join();
+        }
+    }
+
+   private:
+    std::unique_ptr<PacketSource> source;
+    double replay_rate = 1.0;
+    bool replay_loop = false;
+    double replay_start_offset = 0.0;
+    double replay_end_offset = 0.0;
+    bool offline_mode = false;
+    std::optional<uint64_t> start_frame_position;
+    ros::Publisher completed_pub;
+
+    std::atomic<bool> replay_active = {false};
+    std::unique_ptr<std::thread> replay_thread;
+};
+
+}  // namespace ouster_ros
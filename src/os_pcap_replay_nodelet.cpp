@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file os_pcap_replay_nodelet.cpp
+ * @brief A nodelet that replays pcap captures of sensor traffic through the
+ * processing pipeline of os_driver without going through the network or
+ * rosbag
+ */
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <pluginlib/class_list_macros.h>
+
+#include "os_packet_replay_nodelet.h"
+#include "pcap_packet_source.h"
+
+namespace sensor = ouster::sensor;
+
+namespace ouster_ros {
+
+class OusterPcapReplay : public OusterPacketReplay {
+   protected:
+    std::unique_ptr<PacketSource> open_recording(
+        const ros::NodeHandle& pnh) override {
+        auto pcap_file = pnh.param("pcap_file", std::string{});
+        if (!is_arg_set(pcap_file)) {
+            NODELET_ERROR("Must specify a pcap file to replay");
+            throw std::runtime_error("pcap_file not specified");
+        }
+        load_metadata_file(pnh);
+        NODELET_INFO_STREAM("Opening pcap file " << pcap_file);
+        recording_file = pcap_file;
+        return std::make_unique<PcapPacketSource>(
+            pcap_file, sensor::get_format(info), pnh.param("lidar_port", 0),
+            pnh.param("imu_port", 0));
+    }
+};
+
+}  // namespace ouster_ros
+
+PLUGINLIB_EXPORT_CLASS(ouster_ros::OusterPcapReplay, nodelet::Nodelet)
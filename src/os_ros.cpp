@@ -165,46 +165,98 @@ geometry_msgs::TransformStamped transform_to_tf_msg(
     return msg;
 }
 
-// TODO: provide a method that accepts sensor_msgs::LaserScan object
 sensor_msgs::LaserScan lidar_scan_to_laser_scan_msg(
     const ouster::LidarScan& ls, const ros::Time& timestamp,
     const std::string& frame, const ouster::sensor::lidar_mode ld_mode,
     const uint16_t ring, const std::vector<int>& pixel_shift_by_row,
     const int return_index) {
     sensor_msgs::LaserScan msg;
-    msg.header.stamp = timestamp;
-    msg.header.frame_id = frame;
-    msg.angle_min = -M_PI;   // TODO: configure to match the actual scan window
-    msg.angle_max = M_PI;    // TODO: configure to match the actual scan window
-    msg.range_min = 0.1f;    // TODO: fill per product type
-    msg.range_max = 120.0f;  // TODO: fill per product type
+    init_laser_scan_msg(msg, frame, ld_mode);
+    lidar_scan_to_laser_scan_msg(
+        ls, timestamp, ring,
+        laser_scan_column_permutation(ls.w, pixel_shift_by_row[ring]),
+        return_index, msg);
+    return msg;
+}
+
+namespace {
+
+// upper bounds of the maximum ranges of each product line
+float max_range_of_prod_line(const std::string& prod_line) {
+    if (prod_line.rfind("OS-0", 0) == 0) return 100.0f;
+    if (prod_line.rfind("OS-1", 0) == 0) return 200.0f;
+    if (prod_line.rfind("OS-2", 0) == 0) return 400.0f;
+    if (prod_line.rfind("OS-DOME", 0) == 0) return 100.0f;
+    return 120.0f;
+}
+
+struct read_ring_intensities {
+    template <typename T>
+    void operator()(Eigen::Ref<const ouster::img_t<T>> field, uint16_t ring,
+                    const std::vector<int>& column_permutation,
+                    std::vector<float>& intensities) {
+        for (size_t i = 0; i < column_permutation.size(); ++i)
+            intensities[i] = static_cast<float>(field(ring, column_permutation[i]));
+    }
+};
+
+}  // namespace
 
+void init_laser_scan_msg(sensor_msgs::LaserScan& msg, const std::string& frame,
+                         const ouster::sensor::lidar_mode ld_mode,
+                         const std::string& prod_line) {
     const auto scan_width = sensor::n_cols_of_lidar_mode(ld_mode);
     const auto scan_frequency = sensor::frequency_of_lidar_mode(ld_mode);
+    msg.header.frame_id = frame;
     msg.scan_time = 1.0f / scan_frequency;
     msg.time_increment = 1.0f / (scan_width * scan_frequency);
     msg.angle_increment = 2 * M_PI / scan_width;
+    msg.angle_min = -M_PI;
+    // the angle of the last entry, one increment short of a full revolution
+    msg.angle_max = msg.angle_min + (scan_width - 1) * msg.angle_increment;
+    msg.range_min = 0.1f;
+    msg.range_max = max_range_of_prod_line(prod_line);
+    msg.ranges.resize(scan_width);
+    msg.intensities.resize(scan_width);
+}
 
-    ouster::img_t<uint32_t> range = ls.field<uint32_t>(
-        static_cast<sensor::ChanField>(sensor::ChanField::RANGE + return_index));
-    ouster::img_t<uint32_t> signal = impl::get_or_fill_zero<uint32_t>(
-        static_cast<sensor::ChanField>(sensor::ChanField::SIGNAL + return_index),
-        ls);
-    const auto rg = range.data();
-    const auto sg = signal.data();
-    msg.ranges.resize(ls.w);
-    msg.intensities.resize(ls.w);
-
-    uint16_t u = ring;
-    for (auto v =  0; v < ls.w; ++v) {
-        auto v_shift = (v + ls.w - pixel_shift_by_row[u] + ls.w / 2) % ls.w;
-        auto src_idx = u * ls.w + v_shift;
-        auto tgt_idx = ls.w - 1 - v;
-        msg.ranges[tgt_idx] = rg[src_idx] * ouster::sensor::range_unit;
-        msg.intensities[tgt_idx] = static_cast<float>(sg[src_idx]);
+std::vector<int> laser_scan_column_permutation(size_t columns,
+                                               int pixel_shift) {
+    const int w = static_cast<int>(columns);
+    std::vector<int> column_permutation(columns);
+    for (int v = 0; v < w; ++v) {
+        const int v_shift = ((v - pixel_shift + w / 2) % w + w) % w;
+        column_permutation[w - 1 - v] = v_shift;
     }
+    return column_permutation;
+}
 
-    return msg;
+void lidar_scan_to_laser_scan_msg(const ouster::LidarScan& ls,
+                                  const ros::Time& timestamp,
+                                  const uint16_t ring,
+                                  const std::vector<int>& column_permutation,
+                                  const int return_index,
+                                  sensor_msgs::LaserScan& msg) {
+    msg.header.stamp = timestamp;
+
+    const auto range_field =
+        static_cast<sensor::ChanField>(sensor::ChanField::RANGE + return_index);
+    const auto signal_field = static_cast<sensor::ChanField>(
+        sensor::ChanField::SIGNAL + return_index);
+
+    // across supported lidar profiles range is always 32-bit
+    auto range = ls.field<uint32_t>(range_field);
+    for (size_t i = 0; i < column_permutation.size(); ++i)
+        msg.ranges[i] =
+            range(ring, column_permutation[i]) * ouster::sensor::range_unit;
+
+    if (!ls.field_type(signal_field)) {
+        std::fill(msg.intensities.begin(), msg.intensities.end(), 0.0f);
+        return;
+    }
+    // read the ring straight from the field in its native type
+    ouster::impl::visit_field(ls, signal_field, read_ring_intensities(), ring,
+                              column_permutation, msg.intensities);
 }
 
 }  // namespace ouster_ros
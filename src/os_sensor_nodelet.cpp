@@ -14,11 +14,16 @@
 
 #include <pluginlib/class_list_macros.h>
 #include <std_srvs/Empty.h>
+#include <std_srvs/Trigger.h>
 
 #include <chrono>
+#include <cmath>
+#include <ctime>
 
 #include "ouster_ros/PacketMsg.h"
 #include "os_sensor_nodelet.h"
+#include "pcap_writer.h"
+#include "segment_writer.h"
 
 namespace sensor = ouster::sensor;
 using nonstd::optional;
@@ -36,6 +41,7 @@ OusterSensor::~OusterSensor() {
 void OusterSensor::halt() {
     stop_packet_processing_threads();
     stop_sensor_connection_thread();
+    join_flight_recorder_dump_thread();
 }
 
 void OusterSensor::onInit() {
@@ -194,6 +200,134 @@ void OusterSensor::create_set_config_service() {
     NODELET_INFO("set_config service created");
 }
 
+void OusterSensor::create_dump_flight_recorder_service() {
+    auto& pnh = getPrivateNodeHandle();
+    flight_recorder_duration = pnh.param("flight_recorder_duration", 0.0);
+    flight_recorder_prefix =
+        pnh.param("flight_recorder_prefix", std::string{"flight_recorder"});
+    flight_recorder_format =
+        pnh.param("flight_recorder_format", std::string{"pcap"});
+
+    if (flight_recorder_duration < 0.0) {
+        auto error_msg = "flight_recorder_duration can not be negative";
+        NODELET_ERROR_STREAM(error_msg);
+        throw std::runtime_error(error_msg);
+    }
+    if (flight_recorder_format != "pcap" &&
+        flight_recorder_format != "segments") {
+        auto error_msg =
+            "Invalid flight_recorder_format: " + flight_recorder_format;
+        NODELET_ERROR_STREAM(error_msg);
+        throw std::runtime_error(error_msg);
+    }
+    if (flight_recorder_duration == 0.0) return;
+
+    dump_flight_recorder_srv =
+        getNodeHandle()
+            .advertiseService<std_srvs::Trigger::Request,
+                              std_srvs::Trigger::Response>(
+                "dump_flight_recorder",
+                [this](std_srvs::Trigger::Request&,
+                       std_srvs::Trigger::Response& response) {
+                    if (!flight_recorder) {
+                        response.success = false;
+                        response.message = "the flight recorder is not ready";
+                        return true;
+                    }
+                    if (flight_recorder_dumping.exchange(true)) {
+                        response.success = false;
+                        response.message = "a dump is already in progress";
+                        return true;
+                    }
+                    join_flight_recorder_dump_thread();
+
+                    char stamp[32];
+                    const std::time_t now = std::time(nullptr);
+                    std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S",
+                                  std::localtime(&now));
+                    const auto base_name =
+                        flight_recorder_prefix + "_" + stamp;
+                    // the dump runs aside so that the service returns and
+                    // packet ingest continues while it is written out
+                    flight_recorder_dump_thread = std::make_unique<std::thread>(
+                        [this, base_name, metadata = cached_metadata]() {
+                            dump_flight_recorder(base_name, metadata);
+                            flight_recorder_dumping = false;
+                        });
+
+                    response.success = true;
+                    response.message = base_name;
+                    return true;
+                });
+
+    NODELET_INFO_STREAM("dump_flight_recorder service created, keeping the "
+                        "last " << flight_recorder_duration
+                                << "s of packets");
+}
+
+void OusterSensor::dump_flight_recorder(const std::string& base_name,
+                                        const std::string& metadata) {
+    FlightRecorder::DumpStats stats;
+    try {
+        if (flight_recorder_format == "pcap") {
+            // addresses reserved for documentation (TEST-NET-1)
+            PcapWriter writer(base_name + ".pcap", 0xC0000201, 0xC0000202);
+            // the ports cached along with the client, which the connection
+            // thread may replace while the dump runs
+            const uint16_t lidar_port = client_lidar_port;
+            const uint16_t imu_port = client_imu_port;
+            stats = flight_recorder->dump(
+                [&](PacketKind kind, uint64_t ts, const uint8_t* data,
+                    size_t size) {
+                    const auto port =
+                        kind == PacketKind::LIDAR ? lidar_port : imu_port;
+                    writer.write_udp(ts, port, port, data, size);
+                });
+            writer.close();
+            if (!write_text_to_file(base_name + ".json", metadata))
+                NODELET_WARN_STREAM("Failed to write flight recorder metadata "
+                                    "to " << base_name << ".json");
+        } else {
+            SegmentWriterConfig config;
+            config.prefix = base_name;
+            auto& pf = sensor::get_format(info);
+            // a single segment holds the whole dump, with room to spare for
+            // the header and the index
+            config.segment_size =
+                segment::record_size(pf.lidar_packet_size) *
+                    flight_recorder->lidar_capacity() +
+                segment::record_size(pf.imu_packet_size) *
+                    flight_recorder->imu_capacity() +
+                metadata.size() + (1 << 20);
+            SegmentWriter writer(config, metadata);
+            stats = flight_recorder->dump([&](PacketKind kind, uint64_t ts,
+                                              const uint8_t* data,
+                                              size_t size) {
+                writer.write(kind == PacketKind::LIDAR
+                                 ? segment::LIDAR_PACKET
+                                 : segment::IMU_PACKET,
+                             ts, data, size);
+            });
+            writer.close();
+        }
+    } catch (const std::exception& e) {
+        NODELET_ERROR_STREAM("flight recorder dump to "
+                             << base_name << " failed: " << e.what());
+        return;
+    }
+
+    NODELET_INFO_STREAM("flight recorder dumped "
+                        << stats.lidar_packets << " lidar and "
+                        << stats.imu_packets << " imu packets to "
+                        << base_name << ", " << stats.lost_packets
+                        << " packets were overwritten during the dump");
+}
+
+void OusterSensor::join_flight_recorder_dump_thread() {
+    if (flight_recorder_dump_thread && flight_recorder_dump_thread->joinable())
+        flight_recorder_dump_thread->join();
+}
+
 std::shared_ptr<sensor::client> OusterSensor::create_sensor_client(
     const std::string& hostname, const sensor::sensor_config& config) {
     NODELET_INFO_STREAM("Starting sensor " << hostname << " initialization...");
@@ -219,6 +353,11 @@ std::shared_ptr<sensor::client> OusterSensor::create_sensor_client(
                                 sensor::TIME_FROM_UNSPEC, lidar_port, imu_port);
     }
 
+    if (cli) {
+        client_lidar_port =
+            static_cast<uint16_t>(sensor::get_lidar_port(*cli));
+        client_imu_port = static_cast<uint16_t>(sensor::get_imu_port(*cli));
+    }
     return cli;
 }
 
@@ -425,6 +564,7 @@ void OusterSensor::create_services() {
     create_get_metadata_service();
     create_get_config_service();
     create_set_config_service();
+    create_dump_flight_recorder_service();
 }
 
 void OusterSensor::create_publishers() {
@@ -445,6 +585,26 @@ void OusterSensor::allocate_buffers() {
     // TODO: gauge necessary queue size for lidar packets
     imu_packets =
         std::make_unique<ThreadSafeRingBuffer>(pf.imu_packet_size, 1024);
+
+    if (flight_recorder_duration > 0.0) {
+        const double packets_per_frame =
+            static_cast<double>(info.format.columns_per_frame) /
+            info.format.columns_per_packet;
+        const double frame_rate = sensor::frequency_of_lidar_mode(info.mode);
+        const auto lidar_capacity = static_cast<size_t>(std::ceil(
+            flight_recorder_duration * packets_per_frame * frame_rate));
+        // the rate of imu packets is not part of the metadata, Ouster sensors
+        // send them at a fixed 100 Hz regardless of the lidar mode
+        constexpr double imu_packet_rate = 100.0;
+        const auto imu_capacity = static_cast<size_t>(
+            std::ceil(flight_recorder_duration * imu_packet_rate));
+        flight_recorder = std::make_unique<FlightRecorder>(
+            pf.lidar_packet_size, lidar_capacity, pf.imu_packet_size,
+            imu_capacity);
+        NODELET_INFO_STREAM("flight recorder holds "
+                            << lidar_capacity << " lidar and " << imu_capacity
+                            << " imu packets");
+    }
 }
 
 bool OusterSensor::init_id_changed(const sensor::packet_format& pf,
@@ -483,6 +643,9 @@ void OusterSensor::handle_lidar_packet(sensor::client& cli,
         bool success = sensor::read_lidar_packet(cli, buffer, pf);
         if (success) {
             read_lidar_packet_errors = 0;
+            if (flight_recorder)
+                flight_recorder->record_lidar_packet(
+                    buffer, ros::Time::now().toNSec());
             if (!is_legacy_lidar_profile(info) && init_id_changed(pf, buffer)) {
                 // TODO: short circut reset if no breaking changes occured?
                 NODELET_WARN("sensor init_id has changed! reactivating..");
@@ -504,7 +667,11 @@ void OusterSensor::handle_imu_packet(sensor::client& cli,
                                      const sensor::packet_format& pf) {
     imu_packets->write_overwrite([this, &cli, pf](uint8_t* buffer) {
         bool success = sensor::read_imu_packet(cli, buffer, pf);
-        if (!success) {
+        if (success) {
+            if (flight_recorder)
+                flight_recorder->record_imu_packet(buffer,
+                                                   ros::Time::now().toNSec());
+        } else {
             if (++read_imu_packet_errors > max_read_imu_packet_errors) {
                 NODELET_ERROR_STREAM(
                     "maximum number of allowed errors from "
@@ -549,7 +716,8 @@ void OusterSensor::start_sensor_connection_thread() {
 
 void OusterSensor::stop_sensor_connection_thread() {
     NODELET_DEBUG("sensor_connection_thread stopping.");
-    if (sensor_connection_thread->joinable()) {
+    // the thread is never started by nodelets that don't connect to a sensor
+    if (sensor_connection_thread && sensor_connection_thread->joinable()) {
         sensor_connection_active = false;
         sensor_connection_thread->join();
     }
@@ -581,12 +749,14 @@ void OusterSensor::start_packet_processing_threads() {
 void OusterSensor::stop_packet_processing_threads() {
     NODELET_DEBUG("stopping packet processing threads.");
 
-    if (imu_packets_processing_thread->joinable()) {
+    if (imu_packets_processing_thread &&
+        imu_packets_processing_thread->joinable()) {
         imu_packets_processing_thread_active = false;
         imu_packets_processing_thread->join();
     }
 
-    if (lidar_packets_processing_thread->joinable()) {
+    if (lidar_packets_processing_thread &&
+        lidar_packets_processing_thread->joinable()) {
         lidar_packets_processing_thread_active = false;
         lidar_packets_processing_thread->join();
     }
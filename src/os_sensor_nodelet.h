@@ -14,6 +14,7 @@
 #include "ouster_ros/os_ros.h"
 // clang-format on
 
+#include <atomic>
 #include <string>
 #include <thread>
 
@@ -22,6 +23,7 @@
 #include "ouster_ros/PacketMsg.h"
 #include "ouster_ros/os_sensor_nodelet_base.h"
 
+#include "flight_recorder.h"
 #include "thread_safe_ring_buffer.h"
 
 namespace sensor = ouster::sensor;
@@ -66,6 +68,13 @@ class OusterSensor : public OusterSensorNodeletBase {
 
     void create_set_config_service();
 
+    void create_dump_flight_recorder_service();
+
+    void dump_flight_recorder(const std::string& base_name,
+                              const std::string& metadata);
+
+    void join_flight_recorder_dump_thread();
+
     std::shared_ptr<sensor::client> create_sensor_client(
         const std::string& hostname, const sensor::sensor_config& config);
 
@@ -117,6 +126,10 @@ class OusterSensor : public OusterSensorNodeletBase {
     std::string mtp_dest;
     bool mtp_main;
     std::shared_ptr<sensor::client> sensor_client;
+    // ports of sensor_client, set whenever a client is created; read by the
+    // flight recorder dump without touching the client
+    std::atomic<uint16_t> client_lidar_port = {0};
+    std::atomic<uint16_t> client_imu_port = {0};
     PacketMsg lidar_packet;
     PacketMsg imu_packet;
     ros::Publisher lidar_packet_pub;
@@ -124,11 +137,20 @@ class OusterSensor : public OusterSensorNodeletBase {
     ros::ServiceServer reset_srv;
     ros::ServiceServer get_config_srv;
     ros::ServiceServer set_config_srv;
+    ros::ServiceServer dump_flight_recorder_srv;
 
     // TODO: implement & utilize a lock-free ring buffer in future
     std::unique_ptr<ThreadSafeRingBuffer> lidar_packets;
     std::unique_ptr<ThreadSafeRingBuffer> imu_packets;
 
+    // seconds of packets kept by the flight recorder, 0 disables it
+    double flight_recorder_duration = 0.0;
+    std::string flight_recorder_prefix;
+    std::string flight_recorder_format;
+    std::unique_ptr<FlightRecorder> flight_recorder;
+    std::atomic<bool> flight_recorder_dumping = {false};
+    std::unique_ptr<std::thread> flight_recorder_dump_thread;
+
     std::atomic<bool> sensor_connection_active = {false};
     std::unique_ptr<std::thread> sensor_connection_thread;
 
@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file packet_source.h
+ * @brief Interface of the recordings replayed by OusterPacketReplay
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ouster_ros {
+
+enum class PacketKind { LIDAR, IMU, OTHER };
+
+/**
+ * A packet read from a recording, the data remains valid until the next call
+ * to PacketSource::next().
+ */
+struct ReplayPacket {
+    PacketKind kind;
+    uint64_t timestamp;  // recording time in nanoseconds
+    uint64_t position;   // where the packet is within the recording
+    const uint8_t* data;
+    size_t size;
+};
+
+/**
+ * @class PacketSource iterates over the sensor packets of a recording in the
+ * order they were recorded.
+ */
+class PacketSource {
+   public:
+    virtual ~PacketSource() = default;
+
+    /**
+     * Reads the next packet.
+     * @return false once the end of the recording is reached.
+     */
+    virtual bool next(ReplayPacket& packet) = 0;
+
+    /**
+     * Restarts reading from the first packet of the recording.
+     */
+    virtual void rewind() = 0;
+
+    /**
+     * Continues reading from the packet at the given position, positions are
+     * those reported in ReplayPacket::position.
+     */
+    virtual void seek(uint64_t position) = 0;
+};
+
+}  // namespace ouster_ros
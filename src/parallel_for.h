@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file parallel_for.h
+ * @brief Splits a loop across a fixed set of threads
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ouster_ros {
+
+/**
+ * @class ParallelFor runs a loop over [0, count) in contiguous chunks, one
+ * per thread, and returns once all chunks are done.
+ *
+ * The threads are started once and reused for every loop, the calling thread
+ * takes the first chunk itself. A single thread runs the loop inline.
+ */
+class ParallelFor {
+   public:
+    using RangeFn = std::function<void(size_t begin, size_t end)>;
+
+    /**
+     * @param[in] threads_count total number of threads working on a loop,
+     * including the calling thread.
+     */
+    explicit ParallelFor(int threads_count)
+        : n_threads(std::max(threads_count, 1)) {
+        for (size_t i = 1; i < n_threads; ++i)
+            workers.emplace_back([this, i]() { run(i); });
+    }
+
+    ~ParallelFor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_cv.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    ParallelFor(const ParallelFor&) = delete;
+    ParallelFor& operator=(const ParallelFor&) = delete;
+
+    size_t threads_count() const { return n_threads; }
+
+    void operator()(size_t count, const RangeFn& fn) {
+        if (workers.empty()) {
+            fn(0, count);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            loop_fn = &fn;
+            loop_count = count;
+            pending = workers.size();
+            ++generation;
+        }
+        work_cv.notify_all();
+        run_chunk(0, count, fn);
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [this]() { return pending == 0; });
+        loop_fn = nullptr;
+    }
+
+   private:
+    void run_chunk(size_t index, size_t count, const RangeFn& fn) const {
+        const size_t begin = count * index / n_threads;
+        const size_t end = count * (index + 1) / n_threads;
+        if (begin < end) fn(begin, end);
+    }
+
+    void run(size_t index) {
+        size_t seen_generation = 0;
+        while (true) {
+            const RangeFn* fn;
+            size_t count;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                work_cv.wait(lock, [&]() {
+                    return stopping || generation != seen_generation;
+                });
+                if (stopping) return;
+                seen_generation = generation;
+                fn = loop_fn;
+                count = loop_count;
+            }
+            run_chunk(index, count, *fn);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) done_cv.notify_one();
+        }
+    }
+
+   private:
+    const size_t n_threads;
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    const RangeFn* loop_fn = nullptr;
+    size_t loop_count = 0;
+    size_t pending = 0;
+    size_t generation = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+}  // namespace ouster_ros
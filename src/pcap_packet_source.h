@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file pcap_packet_source.h
+ * @brief A PacketSource reading the sensor packets of pcap captures
+ */
+
+#pragma once
+
+#include <ouster/types.h>
+
+#include <string>
+
+#include "packet_source.h"
+#include "pcap_reader.h"
+
+namespace ouster_ros {
+
+/**
+ * Reads the packets of a pcap capture, lidar and imu packets are identified
+ * by their size and, when given, by their destination port.
+ */
+class PcapPacketSource : public PacketSource {
+   public:
+    PcapPacketSource(const std::string& pcap_file,
+                     const ouster::sensor::packet_format& pf, int lidar_port,
+                     int imu_port)
+        : reader(pcap_file),
+          lidar_packet_size(pf.lidar_packet_size),
+          imu_packet_size(pf.imu_packet_size),
+          lidar_port(lidar_port),
+          imu_port(imu_port) {}
+
+    bool next(ReplayPacket& packet) override {
+        UdpPacket udp;
+        if (!reader.next(udp)) return false;
+        packet.timestamp = udp.timestamp;
+        packet.position = udp.record_offset;
+        packet.data = udp.data;
+        packet.size = udp.size;
+        if (udp.size == lidar_packet_size &&
+            (lidar_port == 0 || udp.dst_port == lidar_port))
+            packet.kind = PacketKind::LIDAR;
+        else if (udp.size == imu_packet_size &&
+                 (imu_port == 0 || udp.dst_port == imu_port))
+            packet.kind = PacketKind::IMU;
+        else
+            packet.kind = PacketKind::OTHER;
+        return true;
+    }
+
+    void rewind() override { reader.rewind(); }
+
+    void seek(uint64_t position) override { reader.seek(position); }
+
+   private:
+    PcapReader reader;
+    size_t lidar_packet_size;
+    size_t imu_packet_size;
+    int lidar_port;
+    int imu_port;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,301 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file pcap_reader.h
+ * @brief Reads the UDP packets of pcap captures through a memory mapping
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace ouster_ros {
+
+/**
+ * A UDP datagram read from a capture, the data remains valid until the next
+ * call to PcapReader::next().
+ */
+struct UdpPacket {
+    uint64_t timestamp;  // capture time in nanoseconds
+    uint16_t src_port;
+    uint16_t dst_port;
+    const uint8_t* data;
+    size_t size;
+    // offset within the file of the first record holding a fragment of the
+    // datagram, whichever fragment that is, so a seek there reads all of them
+    size_t record_offset;
+};
+
+/**
+ * @class PcapReader iterates over the IPv4/UDP datagrams of a pcap capture as
+ * written by tcpdump or wireshark, without depending on libpcap.
+ *
+ * The capture is memory mapped, datagrams that fit in a single frame are
+ * returned in place, fragmented datagrams (e.g. lidar packets larger than the
+ * MTU) are reassembled into internal buffers that are reused across packets.
+ * Supported link types are null/loopback, ethernet (with 802.1Q tags), linux
+ * cooked capture (v1 and v2) and raw IPv4.
+ */
+class PcapReader {
+    static constexpr size_t file_header_size = 24;
+    static constexpr size_t record_header_size = 16;
+    static constexpr size_t max_pending_datagrams = 8;
+
+    enum LinkType : uint32_t {
+        LINKTYPE_NULL = 0,
+        LINKTYPE_ETHERNET = 1,
+        LINKTYPE_RAW = 101,
+        LINKTYPE_LINUX_SLL = 113,
+        LINKTYPE_IPV4 = 228,
+        LINKTYPE_LINUX_SLL2 = 276
+    };
+
+   public:
+    explicit PcapReader(const std::string& path)
+        : file(std::make_unique<MappedFile>(path)) {
+        if (file->size() < file_header_size)
+            throw std::runtime_error("not a pcap file: " + path);
+        const uint8_t* header = file->data();
+        const uint32_t magic = read_le32(header);
+        if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+            swapped = false;
+        } else if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+            swapped = true;
+        } else {
+            throw std::runtime_error("not a pcap file (pcapng is not "
+                                     "supported): " + path);
+        }
+        nanosecond_resolution = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+        link_type = field32(header + 20) & 0x0FFFFFFF;
+        switch (link_type) {
+            case LINKTYPE_NULL:
+            case LINKTYPE_ETHERNET:
+            case LINKTYPE_RAW:
+            case LINKTYPE_LINUX_SLL:
+            case LINKTYPE_IPV4:
+            case LINKTYPE_LINUX_SLL2:
+                break;
+            default:
+                throw std::runtime_error("unsupported pcap link type " +
+                                         std::to_string(link_type) + ": " +
+                                         path);
+        }
+        pending.resize(max_pending_datagrams);
+        rewind();
+    }
+
+    /**
+     * Reads the next UDP datagram.
+     * @return false once the end of the capture is reached.
+     */
+    bool next(UdpPacket& packet) {
+        const uint8_t* data = file->data();
+        const size_t size = file->size();
+        while (offset + record_header_size <= size) {
+            const size_t record_offset = offset;
+            const uint8_t* record = data + offset;
+            const uint32_t ts_sec = field32(record);
+            const uint32_t ts_frac = field32(record + 4);
+            const uint32_t incl_len = field32(record + 8);
+            const uint32_t orig_len = field32(record + 12);
+            offset += record_header_size;
+            if (offset + incl_len > size) {
+                // the capture was cut short while writing the last record
+                offset = size;
+                return false;
+            }
+            const uint8_t* frame = data + offset;
+            offset += incl_len;
+            if (incl_len < orig_len) continue;  // truncated by snaplen
+
+            const uint64_t ts =
+                ts_sec * 1000000000ull +
+                (nanosecond_resolution ? ts_frac : ts_frac * 1000ull);
+            if (parse_frame(frame, incl_len, ts, record_offset, packet))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * Continues reading from the record at the given offset of the file,
+     * offsets are those reported in UdpPacket::record_offset.
+     */
+    void seek(size_t record_offset) {
+        offset = std::max(record_offset, file_header_size);
+        for (auto& p : pending) p.active = false;
+    }
+
+    void rewind() { seek(file_header_size); }
+
+    size_t file_size() const { return file->size(); }
+
+   private:
+    struct PendingDatagram {
+        bool active = false;
+        uint32_t src_ip = 0;
+        uint16_t id = 0;
+        uint64_t timestamp = 0;
+        size_t record_offset = 0;
+        size_t received = 0;
+        size_t total = 0;  // known once the last fragment arrived
+        uint64_t last_used = 0;
+        std::vector<uint8_t> buffer;
+    };
+
+    static uint16_t read_be16(const uint8_t* p) {
+        return static_cast<uint16_t>((p[0] << 8) | p[1]);
+    }
+
+    static uint32_t read_le32(const uint8_t* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) |
+               (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    uint32_t field32(const uint8_t* p) const {
+        const uint32_t v = read_le32(p);
+        return swapped ? __builtin_bswap32(v) : v;
+    }
+
+    bool parse_frame(const uint8_t* frame, size_t len, uint64_t ts,
+                     size_t record_offset, UdpPacket& packet) {
+        size_t ip_offset = 0;
+        switch (link_type) {
+            case LINKTYPE_NULL: {
+                if (len < 4) return false;
+                // host byte order of the capturing machine, AF_INET is 2
+                const uint32_t family = field32(frame);
+                if (family != 2) return false;
+                ip_offset = 4;
+                break;
+            }
+            case LINKTYPE_ETHERNET: {
+                if (len < 14) return false;
+                size_t type_offset = 12;
+                uint16_t ether_type = read_be16(frame + type_offset);
+                while ((ether_type == 0x8100 || ether_type == 0x88a8) &&
+                       len >= type_offset + 6) {
+                    type_offset += 4;
+                    ether_type = read_be16(frame + type_offset);
+                }
+                if (ether_type != 0x0800) return false;
+                ip_offset = type_offset + 2;
+                break;
+            }
+            case LINKTYPE_LINUX_SLL:
+                if (len < 16 || read_be16(frame + 14) != 0x0800) return false;
+                ip_offset = 16;
+                break;
+            case LINKTYPE_LINUX_SLL2:
+                if (len < 20 || read_be16(frame) != 0x0800) return false;
+                ip_offset = 20;
+                break;
+            default:
+                ip_offset = 0;
+                break;
+        }
+        return parse_ipv4(frame + ip_offset, len - ip_offset, ts,
+                          record_offset, packet);
+    }
+
+    bool parse_ipv4(const uint8_t* ip, size_t len, uint64_t ts,
+                    size_t record_offset, UdpPacket& packet) {
+        if (len < 20 || (ip[0] >> 4) != 4) return false;
+        const size_t header_len = (ip[0] & 0x0F) * 4;
+        const size_t total_len = read_be16(ip + 2);
+        if (header_len < 20 || total_len < header_len || total_len > len)
+            return false;
+        if (ip[9] != 17) return false;  // not UDP
+
+        const uint8_t* payload = ip + header_len;
+        const size_t payload_len = total_len - header_len;
+        const uint16_t flags_offset = read_be16(ip + 6);
+        const bool more_fragments = flags_offset & 0x2000;
+        const size_t fragment_offset = (flags_offset & 0x1FFF) * 8;
+
+        if (!more_fragments && fragment_offset == 0)
+            return parse_udp(payload, payload_len, ts, record_offset, packet);
+
+        uint32_t src_ip;
+        std::memcpy(&src_ip, ip + 12, sizeof(src_ip));
+        auto& p = pending_datagram(src_ip, read_be16(ip + 4), ts,
+                                   record_offset);
+        if (fragment_offset + payload_len > p.buffer.size())
+            p.buffer.resize(fragment_offset + payload_len);
+        std::memcpy(p.buffer.data() + fragment_offset, payload, payload_len);
+        p.received += payload_len;
+        if (fragment_offset == 0) p.timestamp = ts;
+        p.record_offset = std::min(p.record_offset, record_offset);
+        if (!more_fragments) p.total = fragment_offset + payload_len;
+        if (p.total == 0 || p.received < p.total) return false;
+
+        p.active = false;
+        return parse_udp(p.buffer.data(), p.total, p.timestamp,
+                         p.record_offset, packet);
+    }
+
+    PendingDatagram& pending_datagram(uint32_t src_ip, uint16_t id,
+                                      uint64_t ts, size_t record_offset) {
+        ++use_counter;
+        for (auto& p : pending) {
+            if (p.active && p.src_ip == src_ip && p.id == id) {
+                p.last_used = use_counter;
+                return p;
+            }
+        }
+        // start a new datagram in a free slot, evicting the least recently
+        // used incomplete datagram when all slots are taken
+        PendingDatagram* slot = nullptr;
+        for (auto& p : pending) {
+            if (!p.active) {
+                slot = &p;
+                break;
+            }
+            if (!slot || p.last_used < slot->last_used) slot = &p;
+        }
+        auto& p = *slot;
+        p.active = true;
+        p.src_ip = src_ip;
+        p.id = id;
+        p.timestamp = ts;
+        p.record_offset = record_offset;
+        p.received = 0;
+        p.total = 0;
+        p.last_used = use_counter;
+        return p;
+    }
+
+    static bool parse_udp(const uint8_t* udp, size_t len, uint64_t ts,
+                          size_t record_offset, UdpPacket& packet) {
+        if (len < 8) return false;
+        const size_t udp_len = read_be16(udp + 4);
+        if (udp_len < 8 || udp_len > len) return false;
+        packet.timestamp = ts;
+        packet.src_port = read_be16(udp);
+        packet.dst_port = read_be16(udp + 2);
+        packet.data = udp + 8;
+        packet.size = udp_len - 8;
+        packet.record_offset = record_offset;
+        return true;
+    }
+
+   private:
+    std::unique_ptr<MappedFile> file;
+    bool swapped = false;
+    bool nanosecond_resolution = false;
+    uint32_t link_type = LINKTYPE_ETHERNET;
+    size_t offset = file_header_size;
+    std::vector<PendingDatagram> pending;
+    uint64_t use_counter = 0;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file pcap_writer.h
+ * @brief Writes UDP datagrams into pcap captures
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ouster_ros {
+
+/**
+ * @class PcapWriter writes UDP datagrams as ethernet frames of a pcap capture
+ * with nanosecond timestamps; the result reads back with PcapReader, the
+ * ouster-sdk and wireshark. Datagrams that exceed the MTU are split into IPv4
+ * fragments the way the network stack of the sender would.
+ */
+class PcapWriter {
+    static constexpr size_t ethernet_header_size = 14;
+    static constexpr size_t ip_header_size = 20;
+    static constexpr size_t udp_header_size = 8;
+
+   public:
+    /**
+     * @param[in] src_ip, dst_ip addresses in host byte order.
+     */
+    PcapWriter(const std::string& path, uint32_t src_ip, uint32_t dst_ip,
+               size_t mtu = 1500)
+        : file(std::fopen(path.c_str(), "wb"), &std::fclose),
+          path(path),
+          src_ip(src_ip),
+          dst_ip(dst_ip),
+          // the payload of all fragments but the last must be a multiple of 8
+          max_fragment_payload((mtu - ip_header_size) & ~size_t{7}) {
+        if (!file) throw std::runtime_error("failed to open " + path);
+        uint8_t header[24] = {};
+        put_le32(header, 0xa1b23c4d);  // nanosecond resolution
+        put_le16(header + 4, 2);
+        put_le16(header + 6, 4);
+        put_le32(header + 16, 262144);  // snaplen
+        put_le32(header + 20, 1);       // LINKTYPE_ETHERNET
+        write(header, sizeof(header));
+        frame.resize(ethernet_header_size + ip_header_size +
+                     max_fragment_payload);
+    }
+
+    PcapWriter(const PcapWriter&) = delete;
+    PcapWriter& operator=(const PcapWriter&) = delete;
+
+    void write_udp(uint64_t timestamp, uint16_t src_port, uint16_t dst_port,
+                   const uint8_t* data, size_t size) {
+        const size_t datagram_size = udp_header_size + size;
+        if (datagram_size + ip_header_size > 0xFFFF)
+            throw std::runtime_error("datagram exceeds the ipv4 size limit");
+        udp_header[0] = static_cast<uint8_t>(src_port >> 8);
+        udp_header[1] = static_cast<uint8_t>(src_port);
+        udp_header[2] = static_cast<uint8_t>(dst_port >> 8);
+        udp_header[3] = static_cast<uint8_t>(dst_port);
+        udp_header[4] = static_cast<uint8_t>(datagram_size >> 8);
+        udp_header[5] = static_cast<uint8_t>(datagram_size);
+        udp_header[6] = udp_header[7] = 0;  // no checksum
+
+        ++ip_id;
+        for (size_t offset = 0; offset < datagram_size;
+             offset += max_fragment_payload) {
+            const size_t chunk =
+                std::min(max_fragment_payload, datagram_size - offset);
+            const bool more_fragments = offset + chunk < datagram_size;
+            uint8_t* payload = fill_headers(offset, chunk, more_fragments);
+            // the fragment payload spans the udp header and/or the data
+            size_t pos = offset;
+            const size_t end = offset + chunk;
+            if (pos < udp_header_size) {
+                const size_t n = std::min(udp_header_size, end) - pos;
+                std::memcpy(payload, udp_header + pos, n);
+                payload += n;
+                pos += n;
+            }
+            if (pos < end)
+                std::memcpy(payload, data + pos - udp_header_size, end - pos);
+            write_record(timestamp,
+                         ethernet_header_size + ip_header_size + chunk);
+        }
+    }
+
+    void close() {
+        if (file && std::fclose(file.release()) != 0)
+            throw std::runtime_error("failed to write " + path);
+    }
+
+   private:
+    uint8_t* fill_headers(size_t offset, size_t chunk, bool more_fragments) {
+        uint8_t* eth = frame.data();
+        std::fill(eth, eth + 12, 0);
+        eth[6] = 0x02;  // locally administered source address
+        eth[12] = 0x08;
+        eth[13] = 0x00;
+
+        uint8_t* ip = eth + ethernet_header_size;
+        const size_t total_len = ip_header_size + chunk;
+        const uint16_t flags_offset = static_cast<uint16_t>(
+            (more_fragments ? 0x2000 : 0) | (offset / 8));
+        ip[0] = 0x45;
+        ip[1] = 0;
+        put_be16(ip + 2, static_cast<uint16_t>(total_len));
+        put_be16(ip + 4, ip_id);
+        put_be16(ip + 6, flags_offset);
+        ip[8] = 64;  // ttl
+        ip[9] = 17;  // udp
+        put_be16(ip + 10, 0);
+        put_be32(ip + 12, src_ip);
+        put_be32(ip + 16, dst_ip);
+        uint32_t sum = 0;
+        for (size_t i = 0; i < ip_header_size; i += 2)
+            sum += (ip[i] << 8) | ip[i + 1];
+        while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+        put_be16(ip + 10, static_cast<uint16_t>(~sum));
+        return ip + ip_header_size;
+    }
+
+    void write_record(uint64_t timestamp, size_t size) {
+        uint8_t header[16];
+        put_le32(header, static_cast<uint32_t>(timestamp / 1000000000ull));
+        put_le32(header + 4, static_cast<uint32_t>(timestamp % 1000000000ull));
+        put_le32(header + 8, static_cast<uint32_t>(size));
+        put_le32(header + 12, static_cast<uint32_t>(size));
+        write(header, sizeof(header));
+        write(frame.data(), size);
+    }
+
+    void write(const uint8_t* data, size_t size) {
+        if (std::fwrite(data, 1, size, file.get()) != size)
+            throw std::runtime_error("failed to write " + path);
+    }
+
+    static void put_le16(uint8_t* p, uint16_t v) {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+    }
+
+    static void put_le32(uint8_t* p, uint32_t v) {
+        put_le16(p, static_cast<uint16_t>(v));
+        put_le16(p + 2, static_cast<uint16_t>(v >> 16));
+    }
+
+    static void put_be16(uint8_t* p, uint16_t v) {
+        p[0] = static_cast<uint8_t>(v >> 8);
+        p[1] = static_cast<uint8_t>(v);
+    }
+
+    static void put_be32(uint8_t* p, uint32_t v) {
+        put_be16(p, static_cast<uint16_t>(v >> 16));
+        put_be16(p + 2, static_cast<uint16_t>(v));
+    }
+
+   private:
+    std::unique_ptr<FILE, int (*)(FILE*)> file;
+    std::string path;
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    size_t max_fragment_payload;
+    uint16_t ip_id = 0;
+    uint8_t udp_header[udp_header_size];
+    std::vector<uint8_t> frame;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file playback_pacer.h
+ * @brief Paces the replay of recorded packets relative to their timestamps
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace ouster_ros {
+
+/**
+ * @class PlaybackPacer delays replayed packets so that they are delivered at
+ * a multiple of the rate at which they were recorded.
+ *
+ * The first packet after construction or reset() anchors the recording time
+ * to the wall clock, every following packet is held until its offset from the
+ * anchor, scaled by the rate, has elapsed. Packets that fall behind are not
+ * delayed, so the replay catches up rather than drifting.
+ */
+class PlaybackPacer {
+    using Clock = std::chrono::steady_clock;
+
+   public:
+    /**
+     * @param[in] rate multiple of real time to replay at, 1.0 replays in real
+     * time and a value <= 0 replays as fast as possible.
+     */
+    explicit PlaybackPacer(double rate = 1.0) : rate_(rate) {}
+
+    /**
+     * Blocks until the packet recorded at timestamp (nanoseconds) is due.
+     */
+    void wait(uint64_t timestamp) {
+        if (rate_ <= 0) return;
+        const auto now = Clock::now();
+        if (!anchored || timestamp < anchor_ts) {
+            anchored = true;
+            anchor_ts = timestamp;
+            anchor_time = now;
+            return;
+        }
+        const auto due =
+            anchor_time + std::chrono::duration_cast<Clock::duration>(
+                              std::chrono::duration<double, std::nano>(
+                                  (timestamp - anchor_ts) / rate_));
+        if (due > now) std::this_thread::sleep_until(due);
+    }
+
+    void reset() { anchored = false; }
+
+   private:
+    double rate_;
+    bool anchored = false;
+    uint64_t anchor_ts = 0;
+    Clock::time_point anchor_time;
+};
+
+}  // namespace ouster_ros
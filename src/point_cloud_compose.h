@@ -114,9 +114,14 @@ void copy_lidar_scan_fields_to_point(PointT& pt, const Tuple& tp, int idx) {
 template <class T>
 using Cloud = pcl::PointCloud<T>;
 
+/**
+ * @brief composes a destaggered point cloud from the LidarScan fields.
+ * @param[out] cloud_points destination for ls.w * ls.h points, this could be
+ * the points of a pcl cloud or the data section of a serialized message.
+ */
 template <std::size_t N, const ChanFieldTable<N>& PROFILE, typename PointT,
           typename PointS>
-void scan_to_cloud_f_destaggered(ouster_ros::Cloud<PointT>& cloud,
+void scan_to_cloud_f_destaggered(PointT* cloud_points,
                                  PointS& staging_point,
                                  const ouster::PointsF& points,
                                  uint64_t scan_ts, const ouster::LidarScan& ls,
@@ -135,7 +140,7 @@ void scan_to_cloud_f_destaggered(ouster_ros::Cloud<PointT>& cloud,
             // if target point and staging point has matching type bind the
             // target directly and avoid performing transform_point at the end
             auto& pt = CondBinaryBind<std::is_same_v<PointT, PointS>>::run(
-                cloud.points[tgt_idx], staging_point);
+                cloud_points[tgt_idx], staging_point);
             // all native point types have x, y, z, t and ring values
             pt.x = static_cast<decltype(pt.x)>(xyz(0));
             pt.y = static_cast<decltype(pt.y)>(xyz(1));
@@ -150,7 +155,7 @@ void scan_to_cloud_f_destaggered(ouster_ros::Cloud<PointT>& cloud,
             // only perform point transform operation when PointT, and PointS
             // don't match
             CondBinaryOp<!std::is_same_v<PointT, PointS>>::run(
-                cloud.points[tgt_idx], staging_point,
+                cloud_points[tgt_idx], staging_point,
                 [](auto& tgt_pt, const auto& src_pt) {
                     point::transform(tgt_pt, src_pt);
                 });
@@ -0,0 +1,207 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file point_cloud_file_writer.h
+ * @brief Writes PointCloud2 messages to binary PCD or PLY files
+ */
+
+#pragma once
+
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ouster_ros {
+
+enum class CloudFileFormat { PCD, PLY };
+
+inline CloudFileFormat cloud_file_format_of_string(const std::string& format) {
+    if (format == "pcd") return CloudFileFormat::PCD;
+    if (format == "ply") return CloudFileFormat::PLY;
+    throw std::runtime_error("unsupported cloud file format: " + format);
+}
+
+inline const char* file_extension(CloudFileFormat format) {
+    return format == CloudFileFormat::PCD ? ".pcd" : ".ply";
+}
+
+/**
+ * @class PointCloudFileWriter writes the points of PointCloud2 messages as
+ * binary PCD (organized clouds keep their width and height) or as binary
+ * little endian PLY vertices.
+ *
+ * Fields are written packed in the order of their offsets, any padding
+ * between the fields of a point is dropped. The file header and the staging
+ * buffer are reused between messages of the same layout, so a writer should
+ * not be shared between threads.
+ */
+class PointCloudFileWriter {
+    struct Span {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+   public:
+    explicit PointCloudFileWriter(CloudFileFormat format) : format(format) {}
+
+    void write(const sensor_msgs::PointCloud2& msg, const std::string& path) {
+        if (msg.is_bigendian)
+            throw std::runtime_error("big endian point clouds not supported");
+        update_layout(msg);
+
+        const size_t n_points = size_t{msg.width} * msg.height;
+        packed.resize(n_points * packed_point_size);
+        uint8_t* dst = packed.data();
+        for (uint32_t row = 0; row < msg.height; ++row) {
+            const uint8_t* src = msg.data.data() + size_t{row} * msg.row_step;
+            for (uint32_t col = 0; col < msg.width; ++col) {
+                for (const auto& span : spans) {
+                    std::memcpy(dst, src + span.offset, span.size);
+                    dst += span.size;
+                }
+                src += msg.point_step;
+            }
+        }
+
+        std::unique_ptr<FILE, int (*)(FILE*)> file(
+            std::fopen(path.c_str(), "wb"), &std::fclose);
+        if (!file) throw std::runtime_error("failed to open " + path);
+        const auto header = make_header(msg);
+        if (std::fwrite(header.data(), 1, header.size(), file.get()) !=
+                header.size() ||
+            std::fwrite(packed.data(), 1, packed.size(), file.get()) !=
+                packed.size() ||
+            std::fclose(file.release()) != 0)
+            throw std::runtime_error("failed to write " + path);
+    }
+
+   private:
+    static uint32_t size_of_datatype(uint8_t datatype) {
+        using sensor_msgs::PointField;
+        switch (datatype) {
+            case PointField::INT8:
+            case PointField::UINT8:
+                return 1;
+            case PointField::INT16:
+            case PointField::UINT16:
+                return 2;
+            case PointField::INT32:
+            case PointField::UINT32:
+            case PointField::FLOAT32:
+                return 4;
+            case PointField::FLOAT64:
+                return 8;
+            default:
+                throw std::runtime_error("unsupported point field datatype");
+        }
+    }
+
+    static char pcd_type_of_datatype(uint8_t datatype) {
+        using sensor_msgs::PointField;
+        switch (datatype) {
+            case PointField::INT8:
+            case PointField::INT16:
+            case PointField::INT32:
+                return 'I';
+            case PointField::FLOAT32:
+            case PointField::FLOAT64:
+                return 'F';
+            default:
+                return 'U';
+        }
+    }
+
+    static const char* ply_type_of_datatype(uint8_t datatype) {
+        using sensor_msgs::PointField;
+        switch (datatype) {
+            case PointField::INT8: return "char";
+            case PointField::UINT8: return "uchar";
+            case PointField::INT16: return "short";
+            case PointField::UINT16: return "ushort";
+            case PointField::INT32: return "int";
+            case PointField::UINT32: return "uint";
+            case PointField::FLOAT32: return "float";
+            default: return "double";
+        }
+    }
+
+    void update_layout(const sensor_msgs::PointCloud2& msg) {
+        if (msg.fields == fields && msg.point_step == point_step) return;
+        fields = msg.fields;
+        point_step = msg.point_step;
+        std::sort(fields.begin(), fields.end(),
+                  [](const auto& a, const auto& b) {
+                      return a.offset < b.offset;
+                  });
+        spans.clear();
+        packed_point_size = 0;
+        for (const auto& field : fields) {
+            const uint32_t size =
+                size_of_datatype(field.datatype) * std::max(field.count, 1u);
+            if (field.offset + size > point_step)
+                throw std::runtime_error("point field " + field.name +
+                                         " exceeds the point step");
+            // merge fields that are adjacent to copy them at once
+            if (!spans.empty() &&
+                spans.back().offset + spans.back().size == field.offset)
+                spans.back().size += size;
+            else
+                spans.push_back({field.offset, size});
+            packed_point_size += size;
+        }
+    }
+
+    std::string make_header(const sensor_msgs::PointCloud2& msg) const {
+        std::ostringstream os;
+        const size_t n_points = size_t{msg.width} * msg.height;
+        if (format == CloudFileFormat::PCD) {
+            os << "# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\n";
+            os << "FIELDS";
+            for (const auto& f : fields) os << ' ' << f.name;
+            os << "\nSIZE";
+            for (const auto& f : fields)
+                os << ' ' << size_of_datatype(f.datatype);
+            os << "\nTYPE";
+            for (const auto& f : fields)
+                os << ' ' << pcd_type_of_datatype(f.datatype);
+            os << "\nCOUNT";
+            for (const auto& f : fields) os << ' ' << std::max(f.count, 1u);
+            os << "\nWIDTH " << msg.width << "\nHEIGHT " << msg.height
+               << "\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS " << n_points
+               << "\nDATA binary\n";
+        } else {
+            os << "ply\nformat binary_little_endian 1.0\n"
+               << "element vertex " << n_points << '\n';
+            for (const auto& f : fields) {
+                const auto count = std::max(f.count, 1u);
+                for (uint32_t i = 0; i < count; ++i) {
+                    os << "property " << ply_type_of_datatype(f.datatype)
+                       << ' ' << f.name;
+                    if (count > 1) os << '_' << i;
+                    os << '\n';
+                }
+            }
+            os << "end_header\n";
+        }
+        return os.str();
+    }
+
+   private:
+    CloudFileFormat format;
+    std::vector<sensor_msgs::PointField> fields;
+    uint32_t point_step = 0;
+    std::vector<Span> spans;
+    size_t packed_point_size = 0;
+    std::vector<uint8_t> packed;
+};
+
+}  // namespace ouster_ros
@@ -14,21 +14,29 @@
 #include "ouster_ros/os_ros.h"
 // clang-format on
 
+#include <ros/console.h>
+
 #include "point_cloud_compose.h"
+#include "point_cloud_wire_format.h"
 #include "lidar_packet_handler.h"
+#include "message_pool.h"
 
 namespace ouster_ros {
 
 // Moved out of PointCloudProcessor to avoid type templatization
 using PointCloudProcessor_OutputType =
-    std::vector<std::shared_ptr<sensor_msgs::PointCloud2>>;
+    std::vector<sensor_msgs::PointCloud2ConstPtr>;
 using PointCloudProcessor_PostProcessingFn = std::function<void(PointCloudProcessor_OutputType)>;
+using PointCloudProcessor_SerializedOutputType =
+    std::vector<SerializedPointCloud2ConstPtr>;
+using PointCloudProcessor_SerializedPostProcessingFn =
+    std::function<void(PointCloudProcessor_SerializedOutputType)>;
 
 
 template <class PointT>
 class PointCloudProcessor {
    public:
-    using ScanToCloudFn = std::function<void(ouster_ros::Cloud<PointT>& cloud,
+    using ScanToCloudFn = std::function<void(PointT* cloud_points,
                                         const ouster::PointsF& points,
                                         uint64_t scan_ts, const ouster::LidarScan& ls,
                                         const std::vector<int>& pixel_shift_by_row,
@@ -39,15 +47,60 @@ class PointCloudProcessor {
                         const std::string& frame_id,
                         bool apply_lidar_to_sensor_transform,
                         ScanToCloudFn scan_to_cloud_fn_,
-                        PointCloudProcessor_PostProcessingFn post_processing_fn_)
+                        PointCloudProcessor_PostProcessingFn post_processing_fn_,
+                        OutputActiveFn output_active_fn_ = {})
+        : PointCloudProcessor(info, frame_id, apply_lidar_to_sensor_transform,
+                              scan_to_cloud_fn_, output_active_fn_) {
+        cloud = ouster_ros::Cloud<PointT>{info.format.columns_per_frame,
+                                          info.format.pixels_per_column};
+        pc_msgs.resize(n_returns);
+        post_processing_fn = post_processing_fn_;
+        using PointCloud2Pool = MessagePool<sensor_msgs::PointCloud2>;
+        for (size_t i = 0; i < pc_msgs.size(); ++i) {
+            pc_msg_pools.push_back(std::make_unique<PointCloud2Pool>(
+                msg_pool_size, PointCloud2Pool::InitFn{}, [i](size_t count) {
+                        ROS_WARN_STREAM_THROTTLE(
+                            10, "point cloud message pool of return "
+                                    << i << " exhausted " << count
+                                    << " times, subscribers are holding on "
+                                       "to messages for too long");
+                    }));
+        }
+    }
+
+    /**
+     * Constructs a processor that composes point clouds directly into the
+     * serialized form of a PointCloud2 message, skipping the pcl cloud and
+     * the PointCloud2 conversion steps altogether.
+     */
+    PointCloudProcessor(
+        const ouster::sensor::sensor_info& info, const std::string& frame_id,
+        bool apply_lidar_to_sensor_transform, ScanToCloudFn scan_to_cloud_fn_,
+        PointCloudProcessor_SerializedPostProcessingFn post_processing_fn_,
+        OutputActiveFn output_active_fn_ = {})
+        : PointCloudProcessor(info, frame_id, apply_lidar_to_sensor_transform,
+                              scan_to_cloud_fn_, output_active_fn_) {
+        serialized_msgs.resize(n_returns);
+        serialized_post_processing_fn = post_processing_fn_;
+        for (int i = 0; i < n_returns; ++i) {
+            wire_writers.push_back(
+                std::make_unique<PointCloud2WireWriter<PointT>>(
+                    info.format.columns_per_frame,
+                    info.format.pixels_per_column, frame, msg_pool_size));
+        }
+    }
+
+   private:
+    PointCloudProcessor(const ouster::sensor::sensor_info& info,
+                        const std::string& frame_id,
+                        bool apply_lidar_to_sensor_transform,
+                        ScanToCloudFn scan_to_cloud_fn_,
+                        OutputActiveFn output_active_fn_)
         : frame(frame_id),
           pixel_shift_by_row(info.format.pixel_shift_by_row),
-          cloud{info.format.columns_per_frame, info.format.pixels_per_column},
-          pc_msgs(get_n_returns(info)),
+          n_returns(get_n_returns(info)),
           scan_to_cloud_fn(scan_to_cloud_fn_),
-          post_processing_fn(post_processing_fn_) {
-        for (size_t i = 0; i < pc_msgs.size(); ++i)
-            pc_msgs[i] = std::make_shared<sensor_msgs::PointCloud2>();
+          output_active_fn(output_active_fn_) {
         ouster::mat4d additional_transform =
             apply_lidar_to_sensor_transform ? info.lidar_to_sensor_transform
                                             : ouster::mat4d::Identity();
@@ -64,7 +117,10 @@ class PointCloudProcessor {
         points = ouster::PointsF(lut_direction.rows(), lut_offset.cols());
     }
 
-   private:
+    bool output_active(int return_index) const {
+        return !output_active_fn || output_active_fn(return_index);
+    }
+
     template <typename T>
     void pcl_toROSMsg(const ouster_ros::Cloud<T>& pcl_cloud,
                       sensor_msgs::PointCloud2& cloud) {
@@ -75,20 +131,57 @@ class PointCloudProcessor {
 
     void process(const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
                  const ros::Time& msg_ts) {
+        if (serialized_post_processing_fn) {
+            process_serialized(lidar_scan, scan_ts, msg_ts);
+            return;
+        }
+
+        bool any_active = false;
         for (int i = 0; i < static_cast<int>(pc_msgs.size()); ++i) {
+            if (!output_active(i)) continue;
+            any_active = true;
             auto range_channel = static_cast<sensor::ChanField>(sensor::ChanField::RANGE + i);
             auto range = lidar_scan.field<uint32_t>(range_channel);
             ouster::cartesianT(points, range, lut_direction, lut_offset);
 
-            scan_to_cloud_fn(cloud, points, scan_ts, lidar_scan,
-                                        pixel_shift_by_row, i);
+            scan_to_cloud_fn(cloud.points.data(), points, scan_ts, lidar_scan,
+                             pixel_shift_by_row, i);
+
+            // a message acquired from the pool is not referenced by any
+            // subscriber, so it is safe to overwrite its content
+            auto pc_msg = pc_msg_pools[i]->acquire();
+            pcl_toROSMsg(cloud, *pc_msg);
+            pc_msg->header.stamp = msg_ts;
+            pc_msg->header.frame_id = frame;
+            pc_msgs[i] = pc_msg;
+        }
+
+        if (any_active && post_processing_fn) post_processing_fn(pc_msgs);
 
-            pcl_toROSMsg(cloud, *pc_msgs[i]);
-            pc_msgs[i]->header.stamp = msg_ts;
-            pc_msgs[i]->header.frame_id = frame;
+        // don't hold on to published messages, so they could be recycled
+        for (auto& pc_msg : pc_msgs) pc_msg.reset();
+    }
+
+    void process_serialized(const ouster::LidarScan& lidar_scan,
+                            uint64_t scan_ts, const ros::Time& msg_ts) {
+        bool any_active = false;
+        for (int i = 0; i < n_returns; ++i) {
+            if (!output_active(i)) continue;
+            any_active = true;
+            auto range_channel = static_cast<sensor::ChanField>(sensor::ChanField::RANGE + i);
+            auto range = lidar_scan.field<uint32_t>(range_channel);
+            ouster::cartesianT(points, range, lut_direction, lut_offset);
+
+            auto& writer = *wire_writers[i];
+            auto buffer = writer.acquire();
+            scan_to_cloud_fn(writer.points(*buffer), points, scan_ts,
+                             lidar_scan, pixel_shift_by_row, i);
+            serialized_msgs[i] = writer.finalize(buffer, msg_ts);
         }
 
-        if (post_processing_fn) post_processing_fn(pc_msgs);
+        if (any_active) serialized_post_processing_fn(serialized_msgs);
+
+        for (auto& msg : serialized_msgs) msg.reset();
     }
 
    public:
@@ -96,9 +189,26 @@ class PointCloudProcessor {
                                      const std::string& frame,
                                      bool apply_lidar_to_sensor_transform,
                                      ScanToCloudFn scan_to_cloud_fn_,
-                                     PointCloudProcessor_PostProcessingFn post_processing_fn) {
+                                     PointCloudProcessor_PostProcessingFn post_processing_fn,
+                                     OutputActiveFn output_active_fn = {}) {
+        auto handler = std::make_shared<PointCloudProcessor>(
+            info, frame, apply_lidar_to_sensor_transform, scan_to_cloud_fn_,
+            post_processing_fn, output_active_fn);
+
+        return [handler](const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
+                         const ros::Time& msg_ts) {
+            handler->process(lidar_scan, scan_ts, msg_ts);
+        };
+    }
+
+    static LidarScanProcessor create(
+        const ouster::sensor::sensor_info& info, const std::string& frame,
+        bool apply_lidar_to_sensor_transform, ScanToCloudFn scan_to_cloud_fn_,
+        PointCloudProcessor_SerializedPostProcessingFn post_processing_fn,
+        OutputActiveFn output_active_fn = {}) {
         auto handler = std::make_shared<PointCloudProcessor>(
-            info, frame, apply_lidar_to_sensor_transform, scan_to_cloud_fn_, post_processing_fn);
+            info, frame, apply_lidar_to_sensor_transform, scan_to_cloud_fn_,
+            post_processing_fn, output_active_fn);
 
         return [handler](const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
                          const ros::Time& msg_ts) {
@@ -107,6 +217,9 @@ class PointCloudProcessor {
     }
 
    private:
+    // number of preallocated messages per return
+    static constexpr size_t msg_pool_size = 4;
+
     // a buffer used for staging during the conversion
     // from a PCL point cloud to a ros point cloud message
     pcl::PCLPointCloud2 staging_pcl_pc2;
@@ -117,10 +230,22 @@ class PointCloudProcessor {
     ouster::PointsF lut_offset;
     ouster::PointsF points;
     std::vector<int> pixel_shift_by_row;
+    int n_returns;
+    ScanToCloudFn scan_to_cloud_fn;
+    OutputActiveFn output_active_fn;
+
+    // used when publishing PointCloud2 messages
     ouster_ros::Cloud<PointT> cloud;
     PointCloudProcessor_OutputType pc_msgs;
-    ScanToCloudFn scan_to_cloud_fn;
+    std::vector<std::unique_ptr<MessagePool<sensor_msgs::PointCloud2>>>
+        pc_msg_pools;
     PointCloudProcessor_PostProcessingFn post_processing_fn;
+
+    // used when publishing point clouds in their serialized form
+    std::vector<std::unique_ptr<PointCloud2WireWriter<PointT>>> wire_writers;
+    PointCloudProcessor_SerializedOutputType serialized_msgs;
+    PointCloudProcessor_SerializedPostProcessingFn
+        serialized_post_processing_fn;
 };
 
 }  // namespace ouster_ros
\ No newline at end of file
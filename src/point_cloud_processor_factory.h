@@ -13,7 +13,7 @@ class PointCloudProcessorFactory {
     make_scan_to_cloud_fn(const sensor::sensor_info& info) {
         switch (info.format.udp_profile_lidar) {
             case UDPProfileLidar::PROFILE_LIDAR_LEGACY:
-                return [](ouster_ros::Cloud<PointT>& cloud,
+                return [](PointT* cloud,
                           const ouster::PointsF& points, uint64_t scan_ts,
                           const ouster::LidarScan& ls,
                           const std::vector<int>& pixel_shift_by_row,
@@ -27,7 +27,7 @@ class PointCloudProcessorFactory {
                 };
 
             case UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL:
-                return [](ouster_ros::Cloud<PointT>& cloud,
+                return [](PointT* cloud,
                           const ouster::PointsF& points, uint64_t scan_ts,
                           const ouster::LidarScan& ls,
                           const std::vector<int>& pixel_shift_by_row,
@@ -50,7 +50,7 @@ class PointCloudProcessorFactory {
                 };
 
             case UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16:
-                return [](ouster_ros::Cloud<PointT>& cloud,
+                return [](PointT* cloud,
                           const ouster::PointsF& points, uint64_t scan_ts,
                           const ouster::LidarScan& ls,
                           const std::vector<int>& pixel_shift_by_row,
@@ -65,7 +65,7 @@ class PointCloudProcessorFactory {
                 };
 
             case UDPProfileLidar::PROFILE_RNG15_RFL8_NIR8:
-                return [](ouster_ros::Cloud<PointT>& cloud,
+                return [](PointT* cloud,
                           const ouster::PointsF& points, uint64_t scan_ts,
                           const ouster::LidarScan& ls,
                           const std::vector<int>& pixel_shift_by_row,
@@ -83,47 +83,42 @@ class PointCloudProcessorFactory {
         }
     }
 
-    template <typename PointT>
+    template <typename PointT, typename PostProcessingFn>
     static LidarScanProcessor make_point_cloud_procssor(
         const sensor::sensor_info& info, const std::string& frame,
         bool apply_lidar_to_sensor_transform,
-        PointCloudProcessor_PostProcessingFn post_processing_fn) {
+        PostProcessingFn post_processing_fn, OutputActiveFn output_active_fn) {
         auto scan_to_cloud_fn = make_scan_to_cloud_fn<PointT>(info);
         return PointCloudProcessor<PointT>::create(
             info, frame, apply_lidar_to_sensor_transform, scan_to_cloud_fn,
-            post_processing_fn);
-    }
-
-   public:
-    static bool point_type_requires_intensity(const std::string& point_type) {
-        return point_type == "xyzi" || point_type == "xyzir" ||
-               point_type == "original";
+            post_processing_fn, output_active_fn);
     }
 
-    static LidarScanProcessor create_point_cloud_processor(
+    template <typename PostProcessingFn>
+    static LidarScanProcessor make_point_cloud_procssor_of_type(
         const std::string& point_type, const sensor::sensor_info& info,
         const std::string& frame, bool apply_lidar_to_sensor_transform,
-        PointCloudProcessor_PostProcessingFn post_processing_fn) {
+        PostProcessingFn post_processing_fn, OutputActiveFn output_active_fn) {
         if (point_type == "native") {
             switch (info.format.udp_profile_lidar) {
                 case UDPProfileLidar::PROFILE_LIDAR_LEGACY:
                     return make_point_cloud_procssor<Point_LEGACY>(
                         info, frame, apply_lidar_to_sensor_transform,
-                        post_processing_fn);
+                        post_processing_fn, output_active_fn);
                 case UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL:
                     return make_point_cloud_procssor<
                         Point_RNG19_RFL8_SIG16_NIR16_DUAL>(
                         info, frame, apply_lidar_to_sensor_transform,
-                        post_processing_fn);
+                        post_processing_fn, output_active_fn);
                 case UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16:
                     return make_point_cloud_procssor<
                         Point_RNG19_RFL8_SIG16_NIR16>(
                         info, frame, apply_lidar_to_sensor_transform,
-                        post_processing_fn);
+                        post_processing_fn, output_active_fn);
                 case UDPProfileLidar::PROFILE_RNG15_RFL8_NIR8:
                     return make_point_cloud_procssor<Point_RNG15_RFL8_NIR8>(
                         info, frame, apply_lidar_to_sensor_transform,
-                        post_processing_fn);
+                        post_processing_fn, output_active_fn);
                 default:
                     // TODO: implement fallback?
                     throw std::runtime_error("unsupported udp_profile_lidar");
@@ -131,24 +126,54 @@ class PointCloudProcessorFactory {
         } else if (point_type == "xyz") {
             return make_point_cloud_procssor<pcl::PointXYZ>(
                 info, frame, apply_lidar_to_sensor_transform,
-                post_processing_fn);
+                post_processing_fn, output_active_fn);
         } else if (point_type == "xyzi") {
             return make_point_cloud_procssor<pcl::PointXYZI>(
                 info, frame, apply_lidar_to_sensor_transform,
-                post_processing_fn);
+                post_processing_fn, output_active_fn);
         } else if (point_type == "xyzir") {
             return make_point_cloud_procssor<PointXYZIR>(
                 info, frame, apply_lidar_to_sensor_transform,
-                post_processing_fn);
+                post_processing_fn, output_active_fn);
         } else if (point_type == "original") {
             return make_point_cloud_procssor<ouster_ros::Point>(
                 info, frame, apply_lidar_to_sensor_transform,
-                post_processing_fn);
+                post_processing_fn, output_active_fn);
         }
 
         throw std::runtime_error(
             "Un-supported point type used: " + point_type + "!");
     }
+
+   public:
+    static bool point_type_requires_intensity(const std::string& point_type) {
+        return point_type == "xyzi" || point_type == "xyzir" ||
+               point_type == "original";
+    }
+
+    static LidarScanProcessor create_point_cloud_processor(
+        const std::string& point_type, const sensor::sensor_info& info,
+        const std::string& frame, bool apply_lidar_to_sensor_transform,
+        PointCloudProcessor_PostProcessingFn post_processing_fn,
+        OutputActiveFn output_active_fn = {}) {
+        return make_point_cloud_procssor_of_type(
+            point_type, info, frame, apply_lidar_to_sensor_transform,
+            post_processing_fn, output_active_fn);
+    }
+
+    /**
+     * Creates a point cloud processor that outputs point clouds already
+     * serialized in the PointCloud2 wire format.
+     */
+    static LidarScanProcessor create_serialized_point_cloud_processor(
+        const std::string& point_type, const sensor::sensor_info& info,
+        const std::string& frame, bool apply_lidar_to_sensor_transform,
+        PointCloudProcessor_SerializedPostProcessingFn post_processing_fn,
+        OutputActiveFn output_active_fn = {}) {
+        return make_point_cloud_procssor_of_type(
+            point_type, info, frame, apply_lidar_to_sensor_transform,
+            post_processing_fn, output_active_fn);
+    }
 };
 
 }  // namespace ouster_ros
\ No newline at end of file
@@ -0,0 +1,270 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file point_cloud_wire_format.h
+ * @brief Composes point clouds directly into the wire format of a serialized
+ * sensor_msgs::PointCloud2 message
+ */
+
+#pragma once
+
+#include <pcl/conversions.h>
+#include <ros/console.h>
+#include <ros/serialization.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <boost/shared_array.hpp>
+#include <cassert>
+#include <cstring>
+
+#include "message_pool.h"
+
+namespace ouster_ros {
+
+/**
+ * @brief A PointCloud2 message that has already been serialized to its ROS
+ * wire format.
+ *
+ * The message shares the md5sum and datatype of sensor_msgs::PointCloud2 so it
+ * can be published through a PointCloud2 publisher. roscpp hands the buffer as
+ * is to the transport layer without copying it; subscribers receive a regular
+ * PointCloud2 message.
+ */
+struct SerializedPointCloud2 {
+    // serialized message including the 4 bytes length prefix
+    boost::shared_array<uint8_t> buffer;
+    uint32_t size = 0;
+    ros::Time stamp;
+};
+
+using SerializedPointCloud2ConstPtr =
+    boost::shared_ptr<const SerializedPointCloud2>;
+
+/**
+ * @brief a preallocated buffer that holds a serialized PointCloud2 message,
+ * storage is over allocated so that the point data could start at an address
+ * that satisfies the alignment requirements of pcl point types.
+ */
+struct PointCloud2WireBuffer {
+    std::vector<uint8_t> storage;
+    size_t start = 0;
+
+    uint8_t* data() { return storage.data() + start; }
+};
+
+/**
+ * @class PointCloud2WireWriter composes PointCloud2 messages of a fixed point
+ * type, size and frame directly into preallocated wire format buffers.
+ *
+ * Every field of the message other than the header stamp and sequence number
+ * is written once when a buffer is allocated; per frame only the stamp and the
+ * point data need to be filled.
+ */
+template <typename PointT>
+class PointCloud2WireWriter {
+    static constexpr size_t point_alignment = 16;
+
+   public:
+    PointCloud2WireWriter(uint32_t width, uint32_t height,
+                          const std::string& frame_id, size_t pool_size)
+        : width_(width), height_(height), frame(frame_id) {
+        pcl::for_each_type<typename pcl::traits::fieldList<PointT>::type>(
+            pcl::detail::FieldAdder<PointT>(fields));
+
+        // length prefix + header (seq, stamp.sec, stamp.nsec, frame_id)
+        stamp_offset = 4 + 4;
+        data_offset = stamp_offset + 8 + 4 + frame.size();
+        data_offset += 4 + 4;  // height, width
+        data_offset += 4;      // fields array length
+        for (const auto& f : fields)
+            data_offset += 4 + f.name.size() + 4 + 1 + 4;
+        data_offset += 1 + 4 + 4;  // is_bigendian, point_step, row_step
+        data_offset += 4;          // data array length
+        data_size = static_cast<size_t>(width_) * height_ * sizeof(PointT);
+        total_size = data_offset + data_size + 1;  // is_dense
+
+        pool = std::make_unique<MessagePool<PointCloud2WireBuffer>>(
+            pool_size,
+            [this](PointCloud2WireBuffer& buf) { init_buffer(buf); },
+            [](size_t count) {
+                ROS_WARN_STREAM_THROTTLE(
+                    10, "serialized point cloud buffer pool exhausted "
+                            << count << " times, subscribers are too slow");
+            });
+    }
+
+    PointCloud2WireWriter(const PointCloud2WireWriter&) = delete;
+    PointCloud2WireWriter& operator=(const PointCloud2WireWriter&) = delete;
+
+    /**
+     * Acquires a buffer whose content is not referenced by any subscriber.
+     */
+    MessagePool<PointCloud2WireBuffer>::Ptr acquire() {
+        return pool->acquire();
+    }
+
+    /**
+     * Gives access to the point data section of the buffer, which is suitably
+     * aligned for PointT.
+     */
+    PointT* points(PointCloud2WireBuffer& buf) const {
+        return reinterpret_cast<PointT*>(buf.data() + data_offset);
+    }
+
+    /**
+     * Stamps the buffer and wraps it as a message ready for publishing, the
+     * buffer returns to the pool once the message is no longer referenced.
+     */
+    boost::shared_ptr<SerializedPointCloud2> finalize(
+        const MessagePool<PointCloud2WireBuffer>::Ptr& buf,
+        const ros::Time& stamp) {
+        uint8_t* p = buf->data();
+        write_u32(p + stamp_offset - 4, seq++);
+        write_u32(p + stamp_offset, stamp.sec);
+        write_u32(p + stamp_offset + 4, stamp.nsec);
+
+        auto msg = boost::make_shared<SerializedPointCloud2>();
+        msg->buffer = boost::shared_array<uint8_t>(p, [buf](uint8_t*) {});
+        msg->size = static_cast<uint32_t>(total_size);
+        msg->stamp = stamp;
+        return msg;
+    }
+
+   private:
+    static uint8_t* write_u32(uint8_t* p, uint32_t v) {
+        std::memcpy(p, &v, sizeof(v));
+        return p + sizeof(v);
+    }
+
+    static uint8_t* write_u8(uint8_t* p, uint8_t v) {
+        *p = v;
+        return p + 1;
+    }
+
+    static uint8_t* write_str(uint8_t* p, const std::string& s) {
+        p = write_u32(p, static_cast<uint32_t>(s.size()));
+        std::memcpy(p, s.data(), s.size());
+        return p + s.size();
+    }
+
+    void init_buffer(PointCloud2WireBuffer& buf) const {
+        buf.storage.resize(total_size + point_alignment);
+        auto addr = reinterpret_cast<uintptr_t>(buf.storage.data());
+        buf.start = (point_alignment - (addr + data_offset) % point_alignment) %
+                    point_alignment;
+
+        uint8_t* p = buf.data();
+        p = write_u32(p, static_cast<uint32_t>(total_size - 4));
+        p = write_u32(p, 0);  // header.seq
+        p = write_u32(p, 0);  // header.stamp.sec
+        p = write_u32(p, 0);  // header.stamp.nsec
+        p = write_str(p, frame);
+        p = write_u32(p, height_);
+        p = write_u32(p, width_);
+        p = write_u32(p, static_cast<uint32_t>(fields.size()));
+        for (const auto& f : fields) {
+            p = write_str(p, f.name);
+            p = write_u32(p, f.offset);
+            p = write_u8(p, f.datatype);
+            p = write_u32(p, f.count);
+        }
+        p = write_u8(p, 0);  // is_bigendian
+        p = write_u32(p, static_cast<uint32_t>(sizeof(PointT)));
+        p = write_u32(p, static_cast<uint32_t>(sizeof(PointT) * width_));
+        p = write_u32(p, static_cast<uint32_t>(data_size));
+        assert(p == buf.data() + data_offset);
+        write_u8(p + data_size, 1);  // is_dense
+    }
+
+   private:
+    uint32_t width_;
+    uint32_t height_;
+    std::string frame;
+    std::vector<pcl::PCLPointField> fields;
+    size_t stamp_offset;
+    size_t data_offset;
+    size_t data_size;
+    size_t total_size;
+    uint32_t seq = 0;
+    std::unique_ptr<MessagePool<PointCloud2WireBuffer>> pool;
+};
+
+}  // namespace ouster_ros
+
+namespace ros {
+namespace message_traits {
+
+template <>
+struct IsMessage<ouster_ros::SerializedPointCloud2> : TrueType {};
+
+template <>
+struct MD5Sum<ouster_ros::SerializedPointCloud2> {
+    static const char* value() {
+        return MD5Sum<sensor_msgs::PointCloud2>::value();
+    }
+    static const char* value(const ouster_ros::SerializedPointCloud2&) {
+        return value();
+    }
+};
+
+template <>
+struct DataType<ouster_ros::SerializedPointCloud2> {
+    static const char* value() {
+        return DataType<sensor_msgs::PointCloud2>::value();
+    }
+    static const char* value(const ouster_ros::SerializedPointCloud2&) {
+        return value();
+    }
+};
+
+template <>
+struct Definition<ouster_ros::SerializedPointCloud2> {
+    static const char* value() {
+        return Definition<sensor_msgs::PointCloud2>::value();
+    }
+    static const char* value(const ouster_ros::SerializedPointCloud2&) {
+        return value();
+    }
+};
+
+}  // namespace message_traits
+
+namespace serialization {
+
+template <>
+struct Serializer<ouster_ros::SerializedPointCloud2> {
+    template <typename Stream>
+    inline static void write(Stream& stream,
+                             const ouster_ros::SerializedPointCloud2& m) {
+        // skip the length prefix, it is written by the caller
+        std::memcpy(stream.advance(m.size - 4), m.buffer.get() + 4, m.size - 4);
+    }
+
+    inline static uint32_t serializedLength(
+        const ouster_ros::SerializedPointCloud2& m) {
+        return m.size - 4;
+    }
+};
+
+/**
+ * roscpp serializes a message right before handing it to the transport layer,
+ * for an already serialized point cloud simply share its buffer.
+ */
+template <>
+inline SerializedMessage serializeMessage<ouster_ros::SerializedPointCloud2>(
+    const ouster_ros::SerializedPointCloud2& message) {
+    SerializedMessage m(message.buffer, message.size);
+    m.message_start = message.buffer.get() + 4;
+    return m;
+}
+
+template <>
+inline SerializedMessage
+serializeMessage<const ouster_ros::SerializedPointCloud2>(
+    const ouster_ros::SerializedPointCloud2& message) {
+    return serializeMessage<ouster_ros::SerializedPointCloud2>(message);
+}
+
+}  // namespace serialization
+}  // namespace ros
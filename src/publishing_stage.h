@@ -0,0 +1,253 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file publishing_stage.h
+ * @brief An outbound stage that decouples publishing (and thereby message
+ * serialization) of large messages from the lidar processing thread
+ */
+
+#pragma once
+
+#include <ros/console.h>
+#include <ros/ros.h>
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+
+namespace ouster_ros {
+
+/**
+ * @class PublishingStage dispatches messages to their publishers.
+ *
+ * When constructed with zero threads, messages are published immediately on
+ * the calling thread. Otherwise, each topic is assigned to one of the worker
+ * threads, each worker owning a bounded queue; this preserves the order of
+ * messages within a topic while serialization happens off the caller thread.
+ *
+ * @remarks
+ *  Messages are held as ConstPtr until published, processors must not modify
+ *  a message after handing it to this stage; which holds for messages that
+ *  originate from a MessagePool.
+ */
+class PublishingStage {
+    using Clock = std::chrono::steady_clock;
+
+    struct PublishTask {
+        std::string topic;
+        std::function<void()> publish;
+        Clock::time_point enqueued;
+    };
+
+    struct LatencyStats {
+        size_t count = 0;
+        double total_ms = 0.0;
+        double max_ms = 0.0;
+    };
+
+    struct Worker {
+        Worker(size_t queue_size, QueuePolicy policy)
+            : queue(queue_size, policy) {}
+        BoundedQueue<PublishTask> queue;
+        std::thread thread;
+        std::map<std::string, LatencyStats> stats;
+        Clock::time_point last_report = Clock::now();
+    };
+
+   public:
+    /**
+     * @param[in] threads_count number of publishing threads, zero to publish
+     * on the calling thread.
+     * @param[in] queue_size capacity of the queue of each publishing thread.
+     * @param[in] policy what to do when a publishing queue is full.
+     * @param[in] latency_report_period how often (in seconds) to report
+     * publish latency per topic, zero disables the report.
+     */
+    PublishingStage(int threads_count, size_t queue_size, QueuePolicy policy,
+                    double latency_report_period)
+        : report_period(std::chrono::duration_cast<Clock::duration>(
+              std::chrono::duration<double>(latency_report_period))) {
+        for (int i = 0; i < threads_count; ++i) {
+            workers.push_back(std::make_unique<Worker>(queue_size, policy));
+            auto& worker = *workers.back();
+            worker.thread = std::thread([this, &worker]() { run(worker); });
+        }
+    }
+
+    ~PublishingStage() {
+        for (auto& worker : workers) worker->queue.close();
+        for (auto& worker : workers)
+            if (worker->thread.joinable()) worker->thread.join();
+    }
+
+    PublishingStage(const PublishingStage&) = delete;
+    PublishingStage& operator=(const PublishingStage&) = delete;
+
+    /**
+     * Creates a publishing stage configured through the parameters:
+     * publish_threads, publish_queue_size, publish_queue_policy and
+     * publish_latency_report_period. When offline_mode is set the queues
+     * always block so that no message is dropped.
+     */
+    static std::unique_ptr<PublishingStage> create_from_parameters(
+        const ros::NodeHandle& pnh) {
+        int threads_count = pnh.param("publish_threads", 0);
+        int queue_size = pnh.param("publish_queue_size", 2);
+        auto policy =
+            pnh.param("publish_queue_policy", std::string{"DROP_OLDEST"});
+        double report_period = pnh.param("publish_latency_report_period", 0.0);
+        bool offline_mode = pnh.param("offline_mode", false);
+
+        if (threads_count < 0) {
+            ROS_WARN("publish_threads can't be negative, publishing inline");
+            threads_count = 0;
+        }
+        if (queue_size < 1) {
+            ROS_WARN("publish_queue_size must be at least 1, using 1");
+            queue_size = 1;
+        }
+        if (!is_queue_policy(policy)) {
+            ROS_WARN_STREAM("unsupported publish_queue_policy: "
+                            << policy << ", using DROP_OLDEST");
+            policy = "DROP_OLDEST";
+        }
+        if (offline_mode && policy != "BLOCK") {
+            ROS_INFO("offline mode: publishing queues block when full");
+            policy = "BLOCK";
+        }
+
+        return std::make_unique<PublishingStage>(
+            threads_count, static_cast<size_t>(queue_size),
+            queue_policy_of_string(policy), report_period);
+    }
+
+    /**
+     * Publishes msg through pub, a ros::Publisher or any publisher with the
+     * same getTopic() and publish() methods.
+     */
+    template <typename PublisherT, typename MsgT>
+    void publish(const PublisherT& pub,
+                 const boost::shared_ptr<const MsgT>& msg) {
+        if (deferred_tasks) {
+            deferred_tasks->push_back([this, pub, msg]() { publish(pub, msg); });
+            return;
+        }
+        submit(pub.getTopic(), [pub, msg]() { pub.publish(msg); });
+    }
+
+    /**
+     * @class Deferred holds back the messages published through any
+     * publishing stage on the calling thread for as long as it lives, until
+     * commit() hands them on in the order they were published. Lets threads
+     * that process scans concurrently publish their outputs in scan order.
+     */
+    class Deferred {
+       public:
+        Deferred() : previous(deferred_tasks) { deferred_tasks = &tasks; }
+        ~Deferred() { deferred_tasks = previous; }
+
+        Deferred(const Deferred&) = delete;
+        Deferred& operator=(const Deferred&) = delete;
+
+        void commit() {
+            deferred_tasks = previous;
+            for (auto& task : tasks) task();
+            tasks.clear();
+            deferred_tasks = &tasks;
+        }
+
+       private:
+        std::vector<std::function<void()>> tasks;
+        std::vector<std::function<void()>>* previous;
+    };
+
+    /**
+     * Blocks until all messages submitted before the call were published.
+     */
+    void flush() {
+        std::vector<std::future<void>> done;
+        for (auto& worker : workers) {
+            auto published = std::make_shared<std::promise<void>>();
+            done.push_back(published->get_future());
+            // workers publish in order, so once this task runs every
+            // message queued ahead of it was published; should the task be
+            // dropped the broken promise releases the wait as well
+            worker->queue.push(PublishTask{
+                std::string{}, [published]() { published->set_value(); },
+                Clock::now()});
+        }
+        for (auto& f : done) f.wait();
+    }
+
+   private:
+    void submit(const std::string& topic, std::function<void()> publish_fn) {
+        if (workers.empty()) {
+            auto start = Clock::now();
+            publish_fn();
+            record_latency(inline_worker_stats, topic, start);
+            return;
+        }
+
+        auto& worker =
+            *workers[std::hash<std::string>{}(topic) % workers.size()];
+        if (!worker.queue.push(
+                PublishTask{topic, std::move(publish_fn), Clock::now()})) {
+            ROS_WARN_STREAM_THROTTLE(
+                10, "publishing queue is full, dropped a message of ["
+                        << topic << "], total messages dropped by queue: "
+                        << worker.queue.dropped_count());
+        }
+    }
+
+    void run(Worker& worker) {
+        PublishTask task;
+        while (worker.queue.pop(task)) {
+            task.publish();
+            if (!task.topic.empty())
+                record_latency(worker, task.topic, task.enqueued);
+            task = PublishTask{};   // release the message held by the task
+        }
+    }
+
+    void record_latency(Worker& worker, const std::string& topic,
+                        Clock::time_point start) {
+        if (report_period.count() <= 0) return;
+
+        auto now = Clock::now();
+        auto latency_ms =
+            std::chrono::duration<double, std::milli>(now - start).count();
+        auto& topic_stats = worker.stats[topic];
+        ++topic_stats.count;
+        topic_stats.total_ms += latency_ms;
+        topic_stats.max_ms = std::max(topic_stats.max_ms, latency_ms);
+
+        if (now - worker.last_report < report_period) return;
+        worker.last_report = now;
+
+        for (auto& it : worker.stats) {
+            if (it.second.count == 0) continue;
+            ROS_INFO_STREAM("publish latency of [" << it.first << "]: mean "
+                            << it.second.total_ms / it.second.count
+                            << " ms, max " << it.second.max_ms << " ms over "
+                            << it.second.count << " messages");
+            it.second = LatencyStats{};
+        }
+    }
+
+   private:
+    static inline thread_local std::vector<std::function<void()>>*
+        deferred_tasks = nullptr;
+
+    Clock::duration report_period;
+    std::vector<std::unique_ptr<Worker>> workers;
+    // used to collect latency stats when publishing on the calling thread
+    Worker inline_worker_stats{1, QueuePolicy::DROP_OLDEST};
+};
+
+}  // namespace ouster_ros
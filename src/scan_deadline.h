@@ -0,0 +1,221 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file scan_deadline.h
+ * @brief Skips the processing of scans that are too late to be of use
+ */
+
+#pragma once
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <ros/console.h>
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include "lidar_packet_handler.h"
+
+namespace ouster_ros {
+
+/**
+ * Determines what happens to a scan that missed its deadline.
+ */
+enum class DeadlineAction {
+    SKIP,  // skip the processors of the outputs configured to be skipped
+    DROP   // skip all processors guarded by the deadline
+};
+
+inline DeadlineAction deadline_action_of_string(const std::string& action) {
+    if (action == "SKIP") return DeadlineAction::SKIP;
+    if (action == "DROP") return DeadlineAction::DROP;
+    throw std::runtime_error("unsupported scan deadline action: " + action);
+}
+
+/**
+ * @class ScanDeadline guards processors against scans that are processed too
+ * late, so that an overloaded host catches up with the sensor right away
+ * instead of working off a backlog of old scans.
+ *
+ * The lateness of a scan is how much older it is, when a processor is about
+ * to run, than the most timely scan seen; measuring it relative to that
+ * holds regardless of the clock the scans are stamped with and leaves out the
+ * time it takes to complete a scan. The reference follows slow drifts of the
+ * sensor clock against the host clock.
+ *
+ * Being relative, the lateness can't tell a backlog the host has from the
+ * start: the first scan seeds the reference, and a delay present from then
+ * on goes undetected until a more timely scan lowers the reference.
+ *
+ * Guarded processors may run on several threads, which then see the scans
+ * slightly out of order.
+ */
+class ScanDeadline {
+   public:
+    /**
+     * @param[in] deadline_s how late in seconds a scan may be processed.
+     * @param[in] action what to do with a late scan.
+     * @param[in] skip_outputs the outputs whose processors late scans skip
+     * under the SKIP action.
+     */
+    ScanDeadline(double deadline_s, DeadlineAction action,
+                 const std::set<std::string>& skip_outputs)
+        : deadline_ns(static_cast<int64_t>(deadline_s * 1e9)),
+          action(action),
+          skip_outputs(skip_outputs) {
+        if (deadline_ns <= 0)
+            throw std::runtime_error("scan deadline must be positive");
+    }
+
+    /**
+     * Creates a scan deadline configured through the parameters:
+     * scan_deadline, scan_deadline_action and scan_deadline_skip. Returns
+     * null when scan_deadline is zero or in offline mode, which processes
+     * every scan.
+     */
+    static std::unique_ptr<ScanDeadline> create_from_parameters(
+        const ros::NodeHandle& pnh) {
+        double deadline = pnh.param("scan_deadline", 0.0);
+        auto action = pnh.param("scan_deadline_action", std::string{"SKIP"});
+        auto skip =
+            pnh.param("scan_deadline_skip", std::string{"PCL|IMG|PROJ"});
+        bool offline_mode = pnh.param("offline_mode", false);
+
+        if (deadline <= 0.0) return nullptr;
+        if (offline_mode) {
+            ROS_INFO("offline mode: scan deadline disabled");
+            return nullptr;
+        }
+        if (action != "SKIP" && action != "DROP") {
+            ROS_WARN_STREAM("unsupported scan_deadline_action: "
+                            << action << ", using SKIP");
+            action = "SKIP";
+        }
+        return std::make_unique<ScanDeadline>(
+            deadline, deadline_action_of_string(action),
+            impl::parse_tokens(skip, '|'));
+    }
+
+    /**
+     * Wraps the processor of an output (named after its proc_mask flag) so
+     * that it skips late scans, unless the action is SKIP and the output is
+     * not among the ones to skip; in which case the processor is returned as
+     * is. The deadline must outlive the returned processor.
+     */
+    LidarScanProcessor guard(const std::string& output,
+                             LidarScanProcessor processor) {
+        if (action == DeadlineAction::SKIP && !skip_outputs.count(output))
+            return processor;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& skipped = skipped_scans[output];
+        return [this, output, processor, &skipped](
+                   const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
+                   const ros::Time& msg_ts) {
+            int64_t lateness_ns = 0;
+            if (!late(msg_ts.toNSec(), ros::Time::now().toNSec(),
+                      &lateness_ns)) {
+                processor(lidar_scan, scan_ts, msg_ts);
+                return;
+            }
+            std::string report;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++skipped;
+                report = skipped_report();
+            }
+            ROS_WARN_STREAM_THROTTLE(
+                10, "scan processed " << lateness_ns / 1000000
+                                      << " ms late, skipped " << output
+                                      << "; scans skipped so far: "
+                                      << report);
+        };
+    }
+
+    /**
+     * Determines whether a scan stamped msg_ns is late at now_ns, both in
+     * nanoseconds. A scan found late stays late for the remaining processors.
+     * @param[out] lateness_ns if given, receives how late the scan is.
+     */
+    bool late(uint64_t msg_ns, uint64_t now_ns,
+              int64_t* lateness_ns = nullptr) {
+        const int64_t offset =
+            static_cast<int64_t>(now_ns) - static_cast<int64_t>(msg_ns);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (newest_msg_ns == 0 || msg_ns + rewind_ns < newest_msg_ns) {
+            // first scan, or the sensor clock jumped back
+            reference = offset;
+            newest_msg_ns = msg_ns;
+            late_scans.clear();
+        } else if (msg_ns > newest_msg_ns) {
+            // let the reference rise slowly so that it follows the drift
+            // of the sensor clock, but not the lateness under overload
+            const auto elapsed = static_cast<int64_t>(msg_ns - newest_msg_ns);
+            reference = std::min(offset, reference + elapsed / drift_ratio);
+            newest_msg_ns = msg_ns;
+        } else {
+            // the scan is processed after a newer one or once again
+            reference = std::min(offset, reference);
+        }
+
+        const int64_t lateness = offset - reference;
+        if (lateness_ns) *lateness_ns = lateness;
+        const bool found = std::find(late_scans.begin(), late_scans.end(),
+                                     msg_ns) != late_scans.end();
+        if (found) return true;
+        if (lateness <= deadline_ns) return false;
+        late_scans.push_back(msg_ns);
+        if (late_scans.size() > max_late_scans) late_scans.pop_front();
+        return true;
+    }
+
+    size_t skipped_count(const std::string& output) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = skipped_scans.find(output);
+        return it == skipped_scans.end() ? 0 : it->second;
+    }
+
+   private:
+    std::string skipped_report() const {
+        std::string report;
+        for (const auto& it : skipped_scans) {
+            if (!report.empty()) report += ", ";
+            report += it.first + " " + std::to_string(it.second);
+        }
+        return report;
+    }
+
+   private:
+    // the reference may rise by 1 ms per second, well beyond clock drifts;
+    // it otherwise only drops, so a delay the first scans already carry
+    // stays part of the reference until a more timely scan comes along
+    static constexpr int64_t drift_ratio = 1000;
+    // older scans than the newest one by more than that reset the reference,
+    // reordering by concurrent processing stays well below it
+    static constexpr uint64_t rewind_ns = 1000000000;
+    // scans remembered to be late, enough to cover the ones in flight
+    static constexpr size_t max_late_scans = 16;
+
+    const int64_t deadline_ns;
+    const DeadlineAction action;
+    const std::set<std::string> skip_outputs;
+
+    mutable std::mutex mutex;
+    std::map<std::string, size_t> skipped_scans;
+    uint64_t newest_msg_ns = 0;
+    int64_t reference = 0;
+    std::deque<uint64_t> late_scans;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,314 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file scan_history.h
+ * @brief Keeps the most recent lidar scans so they can be looked up by time
+ */
+
+#pragma once
+
+#include <ouster/lidar_scan.h>
+#include <ouster/types.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ouster_ros {
+
+/**
+ * The result of a ScanHistory lookup: a scan shared with the history along
+ * with the columns of the scan that matched the query, scan is null when no
+ * scan matched.
+ */
+struct ScanHistoryMatch {
+    std::shared_ptr<const ouster::LidarScan> scan;
+    uint64_t scan_ts = 0;     // timestamp of the messages produced from scan
+    int first_col = -1;       // first and last matching columns (inclusive)
+    int last_col = -1;
+    uint64_t first_col_ts = 0;  // timestamps of these columns
+    uint64_t last_col_ts = 0;
+};
+
+/**
+ * @class ScanHistory holds the last capacity lidar scans in preallocated
+ * buffers.
+ *
+ * Scans are handed out as shared pointers so callers can keep using a scan
+ * after the history has moved on; a buffer is only recycled once nobody
+ * references it anymore. The history allocates spare buffers for scans held
+ * by callers, if all of them are taken a new scan is dropped rather than
+ * growing the memory used.
+ *
+ * Timestamps are expressed in the time base of the published messages: each
+ * scan is added with the offset between its message timestamp and its column
+ * timestamps, so that column times can be compared with the stamps of other
+ * sensors regardless of the timestamp mode.
+ *
+ * The class is thread safe, a scan is copied into its buffer outside the lock
+ * so lookups are never held up by the copy.
+ */
+class ScanHistory {
+    struct Entry {
+        size_t slot;
+        int64_t ts_offset;  // message time minus column time
+        uint64_t scan_ts;
+        uint64_t first_ts;  // first and last non zero column timestamps
+        uint64_t last_ts;
+    };
+
+   public:
+    ScanHistory(const ouster::sensor::sensor_info& info, size_t capacity,
+                size_t spare_count = 2)
+        : capacity_(std::max<size_t>(capacity, 1)), entries(capacity_) {
+        const auto& format = info.format;
+        for (size_t i = 0; i < capacity_ + spare_count; ++i)
+            slots.push_back(
+                {std::make_shared<ouster::LidarScan>(
+                     format.columns_per_frame, format.pixels_per_column,
+                     format.udp_profile_lidar),
+                 false});
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+
+    // number of scans that were dropped since all buffers were taken
+    size_t dropped_count() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped;
+    }
+
+    /**
+     * Copies scan into the history, evicting the oldest scan once full.
+     * @param[in] scan_ts the timestamp of the messages produced from scan.
+     * @param[in] col_scan_ts the same timestamp in the clock of the column
+     * timestamps of scan.
+     * @return false if the scan was dropped.
+     */
+    bool add(const ouster::LidarScan& scan, uint64_t scan_ts,
+             uint64_t col_scan_ts) {
+        const auto ts = scan.timestamp();
+        Entry entry{0, static_cast<int64_t>(scan_ts - col_scan_ts), scan_ts,
+                    0, 0};
+        for (int i = 0; i < ts.size(); ++i) {
+            if (ts[i] == 0) continue;
+            if (entry.first_ts == 0) entry.first_ts = ts[i];
+            entry.last_ts = ts[i];
+        }
+        if (entry.first_ts == 0) return false;
+
+        std::shared_ptr<ouster::LidarScan> buffer;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // a buffer outside of the history that nobody references can
+            // not be handed out anymore, so it is safe to overwrite
+            auto it = std::find_if(slots.begin(), slots.end(), [](auto& s) {
+                return !s.in_history && s.scan.use_count() == 1;
+            });
+            const bool full = count == capacity_;
+            // otherwise the buffer of the scan about to be evicted, unless a
+            // caller holds it; the oldest scan is only evicted when the new
+            // one gets a buffer
+            if (it == slots.end() && full &&
+                slots[entries[first].slot].scan.use_count() == 1)
+                it = slots.begin() + entries[first].slot;
+            if (it == slots.end()) {
+                ++dropped;
+                return false;
+            }
+            if (full) {
+                slots[entries[first].slot].in_history = false;
+                first = (first + 1) % capacity_;
+                --count;
+            }
+            it->in_history = true;
+            entry.slot = it - slots.begin();
+            buffer = it->scan;
+        }
+
+        *buffer = scan;
+        buffer.reset();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[(first + count) % capacity_] = entry;
+        ++count;
+        return true;
+    }
+
+    /**
+     * Finds the scan that covers ts, or the one closest to it, and within it
+     * the column whose timestamp is closest to ts.
+     */
+    ScanHistoryMatch find(uint64_t ts) const { return find(ts, ts); }
+
+    /**
+     * Finds the scan that covers the middle of [begin, end], or the one
+     * closest to it, and within it the columns whose timestamps fall within
+     * [begin, end]; when none does the column closest to the middle is
+     * returned.
+     */
+    ScanHistoryMatch find(uint64_t begin, uint64_t end) const {
+        if (end < begin) std::swap(begin, end);
+        const uint64_t mid = begin + (end - begin) / 2;
+
+        ScanHistoryMatch match;
+        int64_t ts_offset = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uint64_t best_distance = UINT64_MAX;
+            for (size_t i = 0; i < count; ++i) {
+                const Entry& e = entries[(first + i) % capacity_];
+                const uint64_t first_ts = e.first_ts + e.ts_offset;
+                const uint64_t last_ts = e.last_ts + e.ts_offset;
+                const uint64_t distance = mid < first_ts ? first_ts - mid
+                                          : mid > last_ts ? mid - last_ts
+                                                          : 0;
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    match.scan = slots[e.slot].scan;
+                    match.scan_ts = e.scan_ts;
+                    ts_offset = e.ts_offset;
+                }
+            }
+        }
+        if (!match.scan) return match;
+
+        const auto ts = match.scan->timestamp();
+        uint64_t best_distance = UINT64_MAX;
+        int nearest_col = -1;
+        for (int i = 0; i < ts.size(); ++i) {
+            if (ts[i] == 0) continue;
+            const uint64_t col_ts = ts[i] + ts_offset;
+            if (col_ts >= begin && col_ts <= end) {
+                if (match.first_col < 0) match.first_col = i;
+                match.last_col = i;
+            }
+            const uint64_t distance =
+                col_ts > mid ? col_ts - mid : mid - col_ts;
+            if (distance < best_distance) {
+                best_distance = distance;
+                nearest_col = i;
+            }
+        }
+        if (match.first_col < 0) match.first_col = match.last_col = nearest_col;
+        match.first_col_ts = ts[match.first_col] + ts_offset;
+        match.last_col_ts = ts[match.last_col] + ts_offset;
+        return match;
+    }
+
+   private:
+    struct Slot {
+        std::shared_ptr<ouster::LidarScan> scan;
+        bool in_history;
+    };
+
+    const size_t capacity_;
+    mutable std::mutex mutex;
+    std::vector<Slot> slots;
+    std::vector<Entry> entries;  // circular, oldest at first
+    size_t first = 0;
+    size_t count = 0;
+    size_t dropped = 0;
+};
+
+/**
+ * Fills cloud with the points of the matched columns [first_col, last_col]
+ * of a ScanHistory match, height rows by as many columns as matched, ordered
+ * row by row. Every point has the fields x, y, z (float32, in meters), t
+ * (uint32, nanoseconds from match.scan_ts to the column timestamp), range
+ * (uint32, in millimeters) and ring (uint16). Points of empty columns or
+ * without a return are all zeros, apart from their ring.
+ *
+ * @param[in] lut_direction, lut_offset the xyz lookup table of the sensor,
+ * one row per pixel of the scan in row major order.
+ */
+inline void scan_columns_to_cloud(
+    const ScanHistoryMatch& match,
+    const Eigen::Array<float, Eigen::Dynamic, 3>& lut_direction,
+    const Eigen::Array<float, Eigen::Dynamic, 3>& lut_offset,
+    sensor_msgs::PointCloud2& cloud) {
+    struct Field {
+        const char* name;
+        uint32_t offset;
+        uint8_t datatype;
+    };
+    static const Field fields[] = {
+        {"x", 0, sensor_msgs::PointField::FLOAT32},
+        {"y", 4, sensor_msgs::PointField::FLOAT32},
+        {"z", 8, sensor_msgs::PointField::FLOAT32},
+        {"t", 12, sensor_msgs::PointField::UINT32},
+        {"range", 16, sensor_msgs::PointField::UINT32},
+        {"ring", 20, sensor_msgs::PointField::UINT16}};
+    cloud.fields.clear();
+    for (const auto& f : fields) {
+        sensor_msgs::PointField field;
+        field.name = f.name;
+        field.offset = f.offset;
+        field.datatype = f.datatype;
+        field.count = 1;
+        cloud.fields.push_back(field);
+    }
+    cloud.is_bigendian = false;
+    cloud.is_dense = false;
+    cloud.point_step = 24;
+    cloud.data.clear();
+    if (!match.scan || match.first_col < 0) {
+        cloud.height = cloud.width = cloud.row_step = 0;
+        return;
+    }
+
+    const auto& scan = *match.scan;
+    const auto ts = scan.timestamp();
+    const auto range = scan.field<uint32_t>(ouster::sensor::ChanField::RANGE);
+    const int width = static_cast<int>(range.cols());
+    const int height = static_cast<int>(range.rows());
+    const int cols = match.last_col - match.first_col + 1;
+    // the match stamps its columns in message time
+    const int64_t ts_offset =
+        static_cast<int64_t>(match.first_col_ts - ts[match.first_col]);
+
+    cloud.height = height;
+    cloud.width = cols;
+    cloud.row_step = cols * cloud.point_step;
+    cloud.data.assign(static_cast<size_t>(height) * cloud.row_step, 0);
+    for (int c = 0; c < cols; ++c) {
+        const int col = match.first_col + c;
+        uint32_t t = 0;
+        if (ts[col] != 0) {
+            const int64_t dt = static_cast<int64_t>(ts[col]) + ts_offset -
+                               static_cast<int64_t>(match.scan_ts);
+            t = static_cast<uint32_t>(std::min<int64_t>(
+                std::max<int64_t>(dt, 0),
+                std::numeric_limits<uint32_t>::max()));
+        }
+        for (int r = 0; r < height; ++r) {
+            uint8_t* point =
+                cloud.data.data() + r * cloud.row_step + c * cloud.point_step;
+            const uint16_t ring = static_cast<uint16_t>(r);
+            std::memcpy(point + 20, &ring, sizeof(ring));
+            const uint32_t rng = ts[col] != 0 ? range(r, col) : 0;
+            if (rng == 0) continue;
+            const int i = r * width + col;
+            float xyz[3];
+            for (int k = 0; k < 3; ++k)
+                xyz[k] = lut_direction(i, k) * rng + lut_offset(i, k);
+            std::memcpy(point, xyz, sizeof(xyz));
+            std::memcpy(point + 12, &t, sizeof(t));
+            std::memcpy(point + 16, &rng, sizeof(rng));
+        }
+    }
+}
+
+}  // namespace ouster_ros
@@ -0,0 +1,272 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file scan_processing_stage.h
+ * @brief A stage that decouples the processing of completed scans from the
+ * thread that assembles them out of lidar packets
+ */
+
+#pragma once
+
+#include <ros/console.h>
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "lidar_packet_handler.h"
+#include "publishing_stage.h"
+
+namespace ouster_ros {
+
+/**
+ * @class ScanProcessingStage hands completed scans to processing threads
+ * through a bounded queue.
+ *
+ * Scans are copied into one of a fixed set of buffers, allocated upfront, as
+ * they complete; the packet thread then returns to consuming packets while the
+ * processing threads run the processors over the queued scans. When
+ * processing falls behind, the queue policy decides which scan gets dropped
+ * (or blocks the packet thread); dropped scans are counted and reported.
+ *
+ * With several workers consecutive scans are processed concurrently, each
+ * worker running its own set of processors. The messages they publish are
+ * held back until the worker's turn comes in scan order; then the ordered
+ * processors, which carry state from one scan to the next, run over the scan
+ * and its messages get published. Outputs thus leave the stage in scan order.
+ */
+class ScanProcessingStage {
+    struct Job {
+        std::unique_ptr<ouster::LidarScan> scan;
+        uint64_t scan_ts;
+        ros::Time msg_ts;
+    };
+
+   public:
+    /**
+     * @param[in] processors the processors to run over every queued scan, on
+     * the processing thread.
+     * @param[in] queue_size the number of completed scans the queue holds.
+     * @param[in] policy what to do when a scan completes while the queue is
+     * full.
+     */
+    ScanProcessingStage(const ouster::sensor::sensor_info& info,
+                        const std::vector<LidarScanProcessor>& processors,
+                        size_t queue_size, QueuePolicy policy)
+        : ScanProcessingStage(info, {processors}, {}, queue_size, policy) {}
+
+    /**
+     * @param[in] worker_processors the processors of each worker, one worker
+     * per entry; they run concurrently over consecutive scans.
+     * @param[in] ordered_processors the processors to run over every scan in
+     * scan order, after the processors of the worker.
+     * @param[in] queue_size the number of completed scans the queue holds.
+     * @param[in] policy what to do when a scan completes while the queue is
+     * full.
+     */
+    ScanProcessingStage(
+        const ouster::sensor::sensor_info& info,
+        const std::vector<std::vector<LidarScanProcessor>>& worker_processors,
+        const std::vector<LidarScanProcessor>& ordered_processors,
+        size_t queue_size, QueuePolicy policy)
+        : worker_processors(worker_processors),
+          ordered_processors(ordered_processors),
+          jobs(queue_size, policy),
+          // enough buffers for a full queue, the scans being processed and
+          // the one being submitted
+          free_scans(queue_size + worker_processors.size() + 1,
+                     QueuePolicy::BLOCK) {
+        if (worker_processors.empty())
+            throw std::runtime_error("scan processing needs a worker");
+        for (size_t i = 0; i < free_scans.capacity(); ++i) {
+            free_scans.push(std::make_unique<ouster::LidarScan>(
+                info.format.columns_per_frame, info.format.pixels_per_column,
+                info.format.udp_profile_lidar));
+        }
+        for (size_t i = 0; i < worker_processors.size(); ++i)
+            threads.emplace_back([this, i]() { run(i); });
+    }
+
+    ~ScanProcessingStage() {
+        jobs.close();
+        for (auto& thread : threads)
+            if (thread.joinable()) thread.join();
+    }
+
+    ScanProcessingStage(const ScanProcessingStage&) = delete;
+    ScanProcessingStage& operator=(const ScanProcessingStage&) = delete;
+
+    /**
+     * Creates a scan processing stage for the processors configured through
+     * the parameters: scan_queue_size and scan_queue_policy. Returns null
+     * when scan_queue_size is zero, scans are then processed on the packet
+     * thread. When offline_mode is set the queue always blocks so that no
+     * scan is dropped.
+     */
+    static std::unique_ptr<ScanProcessingStage> create_from_parameters(
+        const ros::NodeHandle& pnh, const ouster::sensor::sensor_info& info,
+        const std::vector<LidarScanProcessor>& processors) {
+        return create_from_parameters(pnh, info, {processors}, {});
+    }
+
+    /**
+     * Creates a scan processing stage with a worker per entry of
+     * worker_processors, see above for the parameters. Several workers
+     * always get a stage, with a queue of at least one scan per worker.
+     */
+    static std::unique_ptr<ScanProcessingStage> create_from_parameters(
+        const ros::NodeHandle& pnh, const ouster::sensor::sensor_info& info,
+        const std::vector<std::vector<LidarScanProcessor>>& worker_processors,
+        const std::vector<LidarScanProcessor>& ordered_processors) {
+        int queue_size = pnh.param("scan_queue_size", 0);
+        auto policy =
+            pnh.param("scan_queue_policy", std::string{"DROP_OLDEST"});
+        bool offline_mode = pnh.param("offline_mode", false);
+
+        const int workers = static_cast<int>(worker_processors.size());
+        const bool no_processors =
+            ordered_processors.empty() &&
+            std::all_of(worker_processors.begin(), worker_processors.end(),
+                        [](const auto& processors) {
+                            return processors.empty();
+                        });
+        if (workers == 0 || no_processors) return nullptr;
+        if (workers == 1 && queue_size <= 0) return nullptr;
+        queue_size = std::max(queue_size, workers);
+        if (!is_queue_policy(policy)) {
+            ROS_WARN_STREAM("unsupported scan_queue_policy: "
+                            << policy << ", using DROP_OLDEST");
+            policy = "DROP_OLDEST";
+        }
+        if (offline_mode && policy != "BLOCK") {
+            ROS_INFO("offline mode: scan queue blocks when full");
+            policy = "BLOCK";
+        }
+
+        return std::make_unique<ScanProcessingStage>(
+            info, worker_processors, ordered_processors,
+            static_cast<size_t>(queue_size), queue_policy_of_string(policy));
+    }
+
+    /**
+     * Makes a processor that queues the scans it receives for this stage,
+     * the stage must outlive the returned processor.
+     */
+    LidarScanProcessor submitter() {
+        return [this](const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
+                      const ros::Time& msg_ts) {
+            submit(lidar_scan, scan_ts, msg_ts);
+        };
+    }
+
+    void submit(const ouster::LidarScan& lidar_scan, uint64_t scan_ts,
+                const ros::Time& msg_ts) {
+        std::unique_ptr<ouster::LidarScan> scan;
+        if (!free_scans.pop(scan)) return;
+        *scan = lidar_scan;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++pending;
+        }
+        Job discarded;
+        const size_t dropped_before = jobs.dropped_count();
+        if (jobs.push(Job{std::move(scan), scan_ts, msg_ts}, &discarded))
+            return;
+
+        if (!discarded.scan) return;
+        free_scans.push(std::move(discarded.scan));
+        finished_one();
+        // the push also fails when the queue got closed on shutdown, which
+        // drops nothing worth reporting
+        const size_t dropped = jobs.dropped_count();
+        if (dropped == dropped_before) return;
+        ROS_WARN_STREAM_THROTTLE(
+            10, "scan queue is full, dropped a scan; total scans dropped: "
+                    << dropped);
+    }
+
+    /**
+     * Gets the total number of scans dropped due to the queue being full.
+     */
+    size_t dropped_count() const { return jobs.dropped_count(); }
+
+    /**
+     * Blocks until all scans submitted before the call were processed.
+     */
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return pending == 0; });
+    }
+
+   private:
+    void run(size_t worker) {
+        Job job;
+        uint64_t seq;
+        while (next_job(job, seq)) {
+            if (worker_processors.size() == 1) {
+                process(worker, job);
+            } else {
+                PublishingStage::Deferred deferred;
+                process(worker, job);
+                std::unique_lock<std::mutex> lock(turn_mutex);
+                turn.wait(lock, [this, seq] { return next_seq == seq; });
+                for (const auto& processor : ordered_processors)
+                    processor(*job.scan, job.scan_ts, job.msg_ts);
+                deferred.commit();
+                ++next_seq;
+                turn.notify_all();
+            }
+            free_scans.push(std::move(job.scan));
+            finished_one();
+        }
+    }
+
+    // numbers jobs as they are taken, so scans dropped from the queue leave
+    // no gaps in the order workers take turns in
+    bool next_job(Job& job, uint64_t& seq) {
+        std::lock_guard<std::mutex> lock(pop_mutex);
+        if (!jobs.pop(job)) return false;
+        seq = popped++;
+        return true;
+    }
+
+    void process(size_t worker, const Job& job) {
+        for (const auto& processor : worker_processors[worker])
+            processor(*job.scan, job.scan_ts, job.msg_ts);
+        if (worker_processors.size() == 1)
+            for (const auto& processor : ordered_processors)
+                processor(*job.scan, job.scan_ts, job.msg_ts);
+    }
+
+    void finished_one() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) idle.notify_all();
+    }
+
+   private:
+    std::vector<std::vector<LidarScanProcessor>> worker_processors;
+    std::vector<LidarScanProcessor> ordered_processors;
+    BoundedQueue<Job> jobs;
+    BoundedQueue<std::unique_ptr<ouster::LidarScan>> free_scans;
+    // scans submitted but neither processed nor dropped yet
+    size_t pending = 0;
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::mutex pop_mutex;
+    uint64_t popped = 0;
+    // the number of the job whose outputs are published next
+    std::mutex turn_mutex;
+    std::condition_variable turn;
+    uint64_t next_seq = 0;
+    std::vector<std::thread> threads;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file sector_ranges.h
+ * @brief Tracks the nearest return per azimuth sector column by column
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ouster_ros {
+
+/**
+ * Configures the sectors of SectorRanges; returns are only considered when
+ * their height lies within [height_min, height_max] (disabled unless min <
+ * max) and their horizontal distance is at least range_min.
+ */
+struct SectorRangesConfig {
+    int sectors = 72;
+    double height_min = 0.0;  // meters
+    double height_max = 0.0;
+    double range_min = 0.0;  // meters
+    // publish every that many columns, 0 to publish whenever sectors complete
+    int publish_every_columns = 0;
+
+    bool height_band_enabled() const { return height_min < height_max; }
+};
+
+/**
+ * @class SectorRanges the nearest return within each azimuth sector, updated
+ * as the columns of a scan come in.
+ *
+ * Every pixel of the scan is assigned to a sector upfront from the azimuth of
+ * its beam. A sector completes with the last column that holds any of its
+ * pixels, at which point the nearest return seen since its previous
+ * completion becomes its value. The ranges reported are the nearer of that
+ * value and the returns seen so far in the current sweep of the sector, so a
+ * new obstacle shows up with the column that measured it.
+ */
+class SectorRanges {
+   public:
+    using PointsF = Eigen::Array<float, Eigen::Dynamic, 3>;
+
+    /**
+     * @param[in] lut_direction, lut_offset the xyz lookup table of the
+     * sensor for a W x H scan, in the frame the sectors are relative to.
+     */
+    SectorRanges(const PointsF& lut_direction, const PointsF& lut_offset,
+                 size_t W, size_t H, const SectorRangesConfig& config)
+        : W(W),
+          H(H),
+          n_sectors(std::min(std::max(config.sectors, 1), 65535)),
+          height_band(config.height_band_enabled()),
+          height_min(static_cast<float>(config.height_min)),
+          height_max(static_cast<float>(config.height_max)),
+          range_min(static_cast<float>(config.range_min)),
+          lut_direction(lut_direction),
+          lut_offset(lut_offset),
+          pixel_sector(W * H, 0),
+          completed_by_column(W + 1, 0),
+          partial(n_sectors, inf),
+          complete(n_sectors, inf) {
+        std::vector<int> last_column(n_sectors, -1);
+        const double width = 2 * M_PI / n_sectors;
+        for (size_t b = 0; b < H; ++b) {
+            for (size_t m = 0; m < W; ++m) {
+                const size_t i = b * W + m;
+                const double azimuth =
+                    std::atan2(lut_direction(i, 1), lut_direction(i, 0));
+                const int s = std::min(
+                    static_cast<int>((azimuth + M_PI) / width), n_sectors - 1);
+                pixel_sector[i] = static_cast<uint16_t>(s);
+                last_column[s] = std::max(last_column[s], static_cast<int>(m));
+            }
+        }
+        // sectors completed by each column, stored as ranges of a flat list
+        for (int s = 0; s < n_sectors; ++s)
+            if (last_column[s] >= 0) ++completed_by_column[last_column[s] + 1];
+        for (size_t m = 0; m < W; ++m)
+            completed_by_column[m + 1] += completed_by_column[m];
+        completed_sectors.resize(completed_by_column[W]);
+        std::vector<size_t> fill(completed_by_column.begin(),
+                                 completed_by_column.end() - 1);
+        for (int s = 0; s < n_sectors; ++s)
+            if (last_column[s] >= 0)
+                completed_sectors[fill[last_column[s]]++] =
+                    static_cast<uint16_t>(s);
+    }
+
+    int sectors() const { return n_sectors; }
+
+    /**
+     * Adds a column of the scan given its ranges, one per beam in the units
+     * of the lookup table.
+     * @return true if the column completed any sector.
+     */
+    bool add_column(size_t m, const uint32_t* range) {
+        if (m >= W) return false;
+        for (size_t b = 0; b < H; ++b) {
+            if (range[b] == 0) continue;
+            const size_t i = b * W + m;
+            const float r = static_cast<float>(range[b]);
+            if (height_band) {
+                const float z = lut_direction(i, 2) * r + lut_offset(i, 2);
+                if (z < height_min || z > height_max) continue;
+            }
+            const float x = lut_direction(i, 0) * r + lut_offset(i, 0);
+            const float y = lut_direction(i, 1) * r + lut_offset(i, 1);
+            const float d = std::sqrt(x * x + y * y);
+            if (d < range_min) continue;
+            float& nearest = partial[pixel_sector[i]];
+            nearest = std::min(nearest, d);
+        }
+        const size_t begin = completed_by_column[m];
+        const size_t end = completed_by_column[m + 1];
+        for (size_t k = begin; k < end; ++k) {
+            const uint16_t s = completed_sectors[k];
+            complete[s] = partial[s];
+            partial[s] = inf;
+        }
+        return begin != end;
+    }
+
+    // copies the current nearest range of each sector, +inf for no return
+    void ranges(std::vector<float>& out) const {
+        out.resize(n_sectors);
+        for (int s = 0; s < n_sectors; ++s)
+            out[s] = std::min(complete[s], partial[s]);
+    }
+
+   private:
+    static constexpr float inf = std::numeric_limits<float>::infinity();
+
+    const size_t W;
+    const size_t H;
+    const int n_sectors;
+    const bool height_band;
+    const float height_min;
+    const float height_max;
+    const float range_min;
+    PointsF lut_direction;
+    PointsF lut_offset;
+    std::vector<uint16_t> pixel_sector;
+    std::vector<size_t> completed_by_column;
+    std::vector<uint16_t> completed_sectors;
+    std::vector<float> partial;
+    std::vector<float> complete;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file sector_ranges_processor.h
+ * @brief takes in lidar packets and produces SectorRanges messages without
+ * waiting for the scan to complete
+ */
+
+#pragma once
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include <ros/console.h>
+
+#include <algorithm>
+
+#include "ouster_ros/SectorRanges.h"
+
+#include "lidar_packet_handler.h"
+#include "sector_ranges.h"
+
+namespace ouster_ros {
+
+namespace sensor = ouster::sensor;
+
+/**
+ * Reads the config from the parameters: sector_count, sector_height_min,
+ * sector_height_max, sector_range_min and sector_publish_columns. A
+ * sector_count out of range is reported and clamped.
+ */
+inline SectorRangesConfig sector_ranges_config_from_parameters(
+    const ros::NodeHandle& pnh) {
+    SectorRangesConfig config;
+    config.sectors = pnh.param("sector_count", config.sectors);
+    config.height_min = pnh.param("sector_height_min", config.height_min);
+    config.height_max = pnh.param("sector_height_max", config.height_max);
+    config.range_min = pnh.param("sector_range_min", config.range_min);
+    config.publish_every_columns =
+        pnh.param("sector_publish_columns", config.publish_every_columns);
+    if (config.sectors < 1 || config.sectors > 65535) {
+        const int sectors = std::min(std::max(config.sectors, 1), 65535);
+        ROS_WARN_STREAM("sector_count must be within [1, 65535], using "
+                        << sectors);
+        config.sectors = sectors;
+    }
+    return config;
+}
+
+/**
+ * @class SectorRangesProcessor updates the nearest return per azimuth sector
+ * with every lidar packet, ahead of the scan batching, and hands out a
+ * SectorRanges message every publish_every_columns columns or, when that is
+ * zero, after every packet that completed a sector.
+ */
+class SectorRangesProcessor {
+   public:
+    using OutputType = ouster_ros::SectorRangesConstPtr;
+    using PostProcessingFn = std::function<void(OutputType)>;
+
+   public:
+    SectorRangesProcessor(const ouster::sensor::sensor_info& info,
+                          const std::string& frame_id,
+                          bool apply_lidar_to_sensor_transform,
+                          const SectorRangesConfig& config,
+                          const std::string& timestamp_mode,
+                          int64_t ptp_utc_tai_offset, PostProcessingFn func)
+        : pf(sensor::get_format(info)),
+          frame(frame_id),
+          sectors(make_sectors(info, apply_lidar_to_sensor_transform, config)),
+          publish_every_columns(config.publish_every_columns),
+          use_ros_time(timestamp_mode == "TIME_FROM_ROS_TIME"),
+          ts_offset(timestamp_mode == "TIME_FROM_PTP_1588"
+                        ? ptp_utc_tai_offset
+                        : 0),
+          column_range(info.format.pixels_per_column),
+          post_processing_fn(func) {}
+
+   private:
+    static SectorRanges make_sectors(const ouster::sensor::sensor_info& info,
+                                     bool apply_lidar_to_sensor_transform,
+                                     const SectorRangesConfig& config) {
+        ouster::mat4d additional_transform =
+            apply_lidar_to_sensor_transform ? info.lidar_to_sensor_transform
+                                            : ouster::mat4d::Identity();
+        auto xyz_lut = ouster::make_xyz_lut(
+            info.format.columns_per_frame, info.format.pixels_per_column,
+            ouster::sensor::range_unit, info.beam_to_lidar_transform,
+            additional_transform, info.beam_azimuth_angles,
+            info.beam_altitude_angles);
+        return SectorRanges(xyz_lut.direction.cast<float>(),
+                            xyz_lut.offset.cast<float>(),
+                            info.format.columns_per_frame,
+                            info.format.pixels_per_column, config);
+    }
+
+    void process(const uint8_t* lidar_buf) {
+        bool completed = false;
+        for (int icol = 0; icol < pf.columns_per_packet; ++icol) {
+            const uint8_t* col = pf.nth_col(icol, lidar_buf);
+            if (!(pf.col_status(col) & 0x01)) continue;
+            pf.col_field(col, sensor::ChanField::RANGE, column_range.data());
+            completed |=
+                sectors.add_column(pf.col_measurement_id(col),
+                                   column_range.data());
+            last_col_ts = pf.col_timestamp(col);
+            ++columns_since_publish;
+        }
+
+        const bool publish = publish_every_columns > 0
+                                 ? columns_since_publish >= publish_every_columns
+                                 : completed;
+        if (!publish) return;
+        columns_since_publish = 0;
+
+        // a fresh message per publish, they are small and subscribers may
+        // still hold on to the previous ones
+        auto msg = boost::make_shared<ouster_ros::SectorRanges>();
+        msg->header.frame_id = frame;
+        msg->header.stamp =
+            use_ros_time
+                ? ros::Time::now()
+                : impl::ts_to_ros_time(
+                      impl::ts_safe_offset_add(last_col_ts, ts_offset));
+        msg->angle_min = -M_PI;
+        msg->angle_increment = 2 * M_PI / sectors.sectors();
+        sectors.ranges(msg->ranges);
+        post_processing_fn(msg);
+    }
+
+   public:
+    static LidarPacketProcessor create(const ouster::sensor::sensor_info& info,
+                                       const std::string& frame,
+                                       bool apply_lidar_to_sensor_transform,
+                                       const SectorRangesConfig& config,
+                                       const std::string& timestamp_mode,
+                                       int64_t ptp_utc_tai_offset,
+                                       PostProcessingFn func) {
+        auto handler = std::make_shared<SectorRangesProcessor>(
+            info, frame, apply_lidar_to_sensor_transform, config,
+            timestamp_mode, ptp_utc_tai_offset, func);
+
+        return [handler](const uint8_t* lidar_buf) {
+            handler->process(lidar_buf);
+        };
+    }
+
+   private:
+    sensor::packet_format pf;
+    std::string frame;
+    SectorRanges sectors;
+    int publish_every_columns;
+    bool use_ros_time;
+    int64_t ts_offset;
+    std::vector<uint32_t> column_range;
+    int columns_since_publish = 0;
+    uint64_t last_col_ts = 0;
+    PostProcessingFn post_processing_fn;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file segment_format.h
+ * @brief On disk layout of the packet segment files written by
+ * SegmentWriter and read back by SegmentReader
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ouster_ros {
+
+/**
+ * A segment file holds raw sensor packets in the order they were received:
+ *
+ *  | SegmentHeader | metadata json | records ... | index entries ... |
+ *
+ * Each record is a SegmentRecordHeader followed by the packet bytes, padded
+ * to a multiple of 8 bytes. Files are preallocated while written, a record
+ * header with a zero size therefore marks the end of the records of a file
+ * that was not closed properly. Once a segment is closed the sparse index is
+ * appended after the records, the header is completed and the file is
+ * truncated to the bytes actually used.
+ */
+namespace segment {
+
+constexpr char magic[8] = {'O', 'S', 'P', 'K', 'T', 'S', 'E', 'G'};
+constexpr uint32_t version = 1;
+constexpr size_t alignment = 8;
+constexpr const char* file_extension = ".oseg";
+
+enum PacketType : uint16_t { LIDAR_PACKET = 1, IMU_PACKET = 2 };
+
+struct SegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t metadata_size;
+    uint64_t data_offset;   // offset of the first record
+    uint64_t data_end;      // end of the records, 0 while being written
+    uint64_t index_offset;  // offset of the first index entry
+    uint64_t index_count;
+    uint64_t record_count;
+    uint64_t first_timestamp;  // receive time of the first record
+    uint64_t last_timestamp;   // receive time of the last record
+};
+
+struct SegmentRecordHeader {
+    uint32_t size;  // size of the packet, excluding header and padding
+    uint16_t type;  // PacketType
+    uint16_t reserved;
+    uint64_t timestamp;  // receive time in nanoseconds
+};
+
+struct SegmentIndexEntry {
+    uint64_t timestamp;
+    uint64_t offset;  // offset of the record within the file
+};
+
+static_assert(sizeof(SegmentHeader) == 72, "unexpected segment header size");
+static_assert(sizeof(SegmentRecordHeader) == 16,
+              "unexpected record header size");
+static_assert(sizeof(SegmentIndexEntry) == 16, "unexpected index entry size");
+
+inline size_t aligned(size_t size) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+inline size_t record_size(size_t packet_size) {
+    return sizeof(SegmentRecordHeader) + aligned(packet_size);
+}
+
+}  // namespace segment
+
+}  // namespace ouster_ros
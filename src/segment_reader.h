@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file segment_reader.h
+ * @brief Reads back the packet segment files written by SegmentWriter
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "mapped_file.h"
+#include "segment_format.h"
+
+namespace ouster_ros {
+
+/**
+ * A packet read from a segment, the data points into the mapped file and
+ * remains valid for the lifetime of the reader.
+ */
+struct SegmentRecord {
+    segment::PacketType type;
+    uint64_t timestamp;  // receive time in nanoseconds
+    const uint8_t* data;
+    size_t size;
+};
+
+/**
+ * @class SegmentReader iterates over the packets of a single segment file.
+ *
+ * Segments that were not closed properly, e.g. because the recorder was
+ * killed, are read up to the last complete record; seeking in them falls back
+ * to a linear scan since their index was never written.
+ */
+class SegmentReader {
+   public:
+    explicit SegmentReader(const std::string& path)
+        : file(std::make_unique<MappedFile>(path)) {
+        if (file->size() < sizeof(segment::SegmentHeader))
+            throw std::runtime_error("not a packet segment: " + path);
+        std::memcpy(&header, file->data(), sizeof(header));
+        if (std::memcmp(header.magic, segment::magic, sizeof(header.magic)))
+            throw std::runtime_error("not a packet segment: " + path);
+        if (header.version != segment::version)
+            throw std::runtime_error("unsupported packet segment version " +
+                                     std::to_string(header.version) + ": " +
+                                     path);
+        if (sizeof(segment::SegmentHeader) + header.metadata_size >
+                file->size() ||
+            header.data_offset > file->size())
+            throw std::runtime_error("corrupted packet segment: " + path);
+
+        metadata_.assign(reinterpret_cast<const char*>(file->data()) +
+                             sizeof(segment::SegmentHeader),
+                         header.metadata_size);
+        const size_t index_end =
+            header.index_offset +
+            header.index_count * sizeof(segment::SegmentIndexEntry);
+        complete_ = header.data_end != 0 && header.data_end <= file->size() &&
+                    index_end <= file->size();
+        data_end = complete_ ? header.data_end : file->size();
+        rewind();
+    }
+
+    // the sensor metadata json the packets were recorded with
+    const std::string& metadata() const { return metadata_; }
+
+    // whether the segment was closed properly by the writer
+    bool complete() const { return complete_; }
+
+    /**
+     * Reads the next packet.
+     * @return false once all packets of the segment were read.
+     */
+    bool next(SegmentRecord& record) {
+        if (offset + sizeof(segment::SegmentRecordHeader) > data_end)
+            return false;
+        segment::SegmentRecordHeader rh;
+        std::memcpy(&rh, file->data() + offset, sizeof(rh));
+        const size_t rec_size = segment::record_size(rh.size);
+        // a zero size marks the end of an unfinished segment
+        if (rh.size == 0 || offset + rec_size > data_end) {
+            offset = data_end;
+            return false;
+        }
+        record.type = static_cast<segment::PacketType>(rh.type);
+        record.timestamp = rh.timestamp;
+        record.data =
+            file->data() + offset + sizeof(segment::SegmentRecordHeader);
+        record.size = rh.size;
+        offset += rec_size;
+        return true;
+    }
+
+    /**
+     * Positions the reader on the first packet received at or after the
+     * given timestamp (nanoseconds).
+     */
+    void seek(uint64_t timestamp) {
+        rewind();
+        if (complete_ && header.index_count > 0) {
+            const auto* first =
+                reinterpret_cast<const segment::SegmentIndexEntry*>(
+                    file->data() + header.index_offset);
+            const auto* last = first + header.index_count;
+            auto it = std::upper_bound(
+                first, last, timestamp,
+                [](uint64_t ts, const segment::SegmentIndexEntry& entry) {
+                    return ts < entry.timestamp;
+                });
+            if (it != first) offset = (it - 1)->offset;
+        }
+        // skip ahead from the closest indexed record
+        SegmentRecord record;
+        size_t record_offset = offset;
+        while (next(record)) {
+            if (record.timestamp >= timestamp) {
+                offset = record_offset;
+                return;
+            }
+            record_offset = offset;
+        }
+    }
+
+    void rewind() { offset = header.data_offset; }
+
+   private:
+    const std::unique_ptr<MappedFile> file;
+    segment::SegmentHeader header;
+    std::string metadata_;
+    bool complete_ = false;
+    size_t data_end = 0;
+    size_t offset = 0;
+};
+
+}  // namespace ouster_ros
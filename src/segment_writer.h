@@ -0,0 +1,242 @@
+/**
+ * Copyright (c) 2018-2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file segment_writer.h
+ * @brief Records raw sensor packets into preallocated memory mapped segment
+ * files
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "segment_format.h"
+
+namespace ouster_ros {
+
+struct SegmentWriterConfig {
+    // segment files are named <prefix>_<sequence>.oseg, sequence numbers of
+    // existing files are skipped
+    std::string prefix = "ouster";
+    // space preallocated for each segment, a new segment is started once full
+    size_t segment_size = 1024ul * 1024 * 1024;
+    // receive time span of a segment in nanoseconds, 0 for no time limit
+    uint64_t segment_duration = 0;
+    // an index entry is added every index_interval records
+    size_t index_interval = 64;
+};
+
+/**
+ * @class SegmentWriter appends packets to segment files (see segment_format.h).
+ *
+ * A segment is preallocated with posix_fallocate and mapped into memory, so
+ * writing a packet is a copy into the mapping: there is no per packet system
+ * call or message serialization, and the kernel writes back dirty pages in
+ * the background. Segments are rotated when the next packet does not fit,
+ * when the configured duration has elapsed, or when the metadata changes.
+ * Since the mapping is shared the records written so far survive a crash of
+ * the process, the reader then locates their end by scanning. Existing files
+ * are never overwritten: a writer started again with the same prefix, after a
+ * restart or a crash, continues at the next free sequence number.
+ *
+ * The class is not thread safe, callers recording from several threads must
+ * serialize calls to write().
+ */
+class SegmentWriter {
+   public:
+    SegmentWriter(const SegmentWriterConfig& config,
+                  const std::string& metadata)
+        : config_(config), metadata_(metadata) {
+        const size_t min_size =
+            segment::aligned(sizeof(segment::SegmentHeader) +
+                             metadata_.size()) +
+            sizeof(segment::SegmentIndexEntry);
+        if (config_.segment_size <= min_size)
+            throw std::runtime_error(
+                "segment size is too small to hold the sensor metadata");
+        if (config_.index_interval == 0) config_.index_interval = 1;
+    }
+
+    ~SegmentWriter() {
+        try {
+            close();
+        } catch (const std::exception&) {
+            // nothing more can be done about it at this point
+        }
+    }
+
+    SegmentWriter(const SegmentWriter&) = delete;
+    SegmentWriter& operator=(const SegmentWriter&) = delete;
+
+    /**
+     * Appends a packet received at timestamp (nanoseconds).
+     */
+    void write(segment::PacketType type, uint64_t timestamp,
+               const uint8_t* data, size_t size) {
+        const size_t rec_size = segment::record_size(size);
+        if (mapping && (!fits(rec_size) || duration_elapsed(timestamp)))
+            close();
+        if (!mapping) open_segment();
+        if (!fits(rec_size))
+            throw std::runtime_error(
+                "packet of " + std::to_string(size) +
+                " bytes does not fit in a segment, increase the segment size");
+
+        auto* header = reinterpret_cast<segment::SegmentRecordHeader*>(
+            mapping + data_end);
+        header->size = static_cast<uint32_t>(size);
+        header->type = type;
+        header->reserved = 0;
+        header->timestamp = timestamp;
+        std::memcpy(header + 1, data, size);
+
+        if (record_count % config_.index_interval == 0)
+            index.push_back({timestamp, data_end});
+        if (record_count == 0) first_timestamp = timestamp;
+        last_timestamp = timestamp;
+        ++record_count;
+        data_end += rec_size;
+        bytes_written_ += size;
+    }
+
+    /**
+     * Closes the current segment and records the following packets with the
+     * new metadata.
+     */
+    void set_metadata(const std::string& metadata) {
+        close();
+        metadata_ = metadata;
+    }
+
+    /**
+     * Completes the current segment, if any, the next write starts a new one.
+     */
+    void close() {
+        if (!mapping) return;
+
+        const size_t index_offset = data_end;
+        std::memcpy(mapping + index_offset, index.data(),
+                    index.size() * sizeof(segment::SegmentIndexEntry));
+        auto* header = reinterpret_cast<segment::SegmentHeader*>(mapping);
+        header->index_offset = index_offset;
+        header->index_count = index.size();
+        header->record_count = record_count;
+        header->first_timestamp = first_timestamp;
+        header->last_timestamp = last_timestamp;
+        // completed last, a non zero data_end marks a closed segment
+        header->data_end = data_end;
+
+        const size_t used =
+            index_offset + index.size() * sizeof(segment::SegmentIndexEntry);
+        ::munmap(mapping, config_.segment_size);
+        mapping = nullptr;
+        // release the preallocated space that was not needed
+        const int res = ::ftruncate(fd, used);
+        const int error = errno;
+        ::close(fd);
+        fd = -1;
+        if (res != 0) {
+            errno = error;
+            throw_error("failed to truncate segment " + path_);
+        }
+    }
+
+    const std::vector<std::string>& segments() const { return segments_; }
+
+    // number of packet bytes written, excluding headers and index
+    uint64_t bytes_written() const { return bytes_written_; }
+
+   private:
+    bool fits(size_t rec_size) const {
+        // leave room for the index entry the record may add and for the
+        // end marker of an unfinished segment
+        const size_t index_bytes =
+            (index.size() + 1) * sizeof(segment::SegmentIndexEntry);
+        const size_t reserved =
+            std::max(index_bytes, sizeof(segment::SegmentRecordHeader));
+        return data_end + rec_size + reserved <= config_.segment_size;
+    }
+
+    bool duration_elapsed(uint64_t timestamp) const {
+        return config_.segment_duration > 0 && record_count > 0 &&
+               timestamp >= first_timestamp + config_.segment_duration;
+    }
+
+    void open_segment() {
+        for (;; ++next_sequence) {
+            char sequence[24];
+            std::snprintf(sequence, sizeof(sequence), "_%05zu", next_sequence);
+            path_ = config_.prefix + sequence + segment::file_extension;
+            fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+            if (fd >= 0 || errno != EEXIST) break;
+        }
+        if (fd < 0) throw_error("failed to create segment " + path_);
+        ++next_sequence;
+        // reserve the blocks upfront so that writes never fail half way
+        // through a record and the file is not fragmented
+        int res = ::posix_fallocate(fd, 0, config_.segment_size);
+        if (res != 0) {
+            errno = res;
+            throw_error("failed to preallocate segment " + path_);
+        }
+        void* addr = ::mmap(nullptr, config_.segment_size,
+                            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) throw_error("failed to map segment " + path_);
+        mapping = static_cast<uint8_t*>(addr);
+        ::madvise(addr, config_.segment_size, MADV_SEQUENTIAL);
+
+        auto* header = reinterpret_cast<segment::SegmentHeader*>(mapping);
+        std::memcpy(header->magic, segment::magic, sizeof(header->magic));
+        header->version = segment::version;
+        header->metadata_size = static_cast<uint32_t>(metadata_.size());
+        header->data_offset = segment::aligned(sizeof(segment::SegmentHeader) +
+                                               metadata_.size());
+        std::memcpy(mapping + sizeof(segment::SegmentHeader), metadata_.data(),
+                    metadata_.size());
+
+        data_end = header->data_offset;
+        record_count = 0;
+        first_timestamp = last_timestamp = 0;
+        index.clear();
+        segments_.push_back(path_);
+    }
+
+    void throw_error(const std::string& what) {
+        std::string error = what + ": " + std::strerror(errno);
+        if (mapping) ::munmap(mapping, config_.segment_size);
+        if (fd >= 0) ::close(fd);
+        mapping = nullptr;
+        fd = -1;
+        throw std::runtime_error(error);
+    }
+
+   private:
+    SegmentWriterConfig config_;
+    std::string metadata_;
+
+    int fd = -1;
+    uint8_t* mapping = nullptr;
+    std::string path_;
+    size_t data_end = 0;
+    uint64_t record_count = 0;
+    uint64_t first_timestamp = 0;
+    uint64_t last_timestamp = 0;
+    std::vector<segment::SegmentIndexEntry> index;
+
+    std::vector<std::string> segments_;
+    size_t next_sequence = 0;
+    uint64_t bytes_written_ = 0;
+};
+
+}  // namespace ouster_ros
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "../src/auto_exposure.h"
+
+using namespace ouster_ros;
+
+class AutoExposureTest : public ::testing::Test {
+   protected:
+    static const int H = 128;
+    static const int W = 1024;
+
+    // a long tailed image resembling signal/near_ir with some missing pixels
+    ouster::img_t<float> make_image() {
+        ouster::img_t<float> image(H, W);
+        for (Eigen::Index i = 0; i < image.size(); ++i)
+            image.data()[i] = i % 13 == 0 ? 0.0f : dist(gen);
+        return image;
+    }
+
+    std::mt19937 gen{42};
+    std::gamma_distribution<float> dist{2.0f, 150.0f};
+};
+
+TEST_F(AutoExposureTest, MatchesViz) {
+    HistogramAutoExposure ae;
+    ouster::viz::AutoExposure viz_ae;
+
+    for (int frame = 0; frame < 10; ++frame) {
+        auto image = make_image();
+        ouster::img_t<float> expected = image;
+        ae(image);
+        viz_ae(expected);
+        auto diff = (image - expected).abs();
+        EXPECT_LT(diff.mean(), 0.01) << "frame: " << frame;
+        EXPECT_LT(diff.maxCoeff(), 0.05) << "frame: " << frame;
+    }
+}
+
+TEST_F(AutoExposureTest, OutputIsNormalized) {
+    HistogramAutoExposure ae;
+    auto image = make_image();
+    ae(image);
+    EXPECT_GE(image.minCoeff(), 0.0f);
+    EXPECT_LE(image.maxCoeff(), 1.0f);
+    EXPECT_GT(image.mean(), 0.1f);
+}
+
+TEST_F(AutoExposureTest, KeepsExposureBetweenUpdates) {
+    HistogramAutoExposure ae(0.1, 0.1, 2);
+    auto first = make_image();
+    ae(first);
+
+    // a brighter image on a frame without an update is scaled with the
+    // exposure computed on the previous frame
+    ouster::img_t<float> second = make_image() * 4.0f;
+    ae(second);
+    EXPECT_GT(second.mean(), first.mean() * 1.5f);
+}
+
+TEST_F(AutoExposureTest, ThrottledBeamUniformityCorrectorMatchesViz) {
+    ThrottledBeamUniformityCorrector buc(1);
+    ouster::viz::BeamUniformityCorrector viz_buc;
+    for (int frame = 0; frame < 3; ++frame) {
+        auto image = make_image();
+        ouster::img_t<float> expected = image;
+        buc(image);
+        viz_buc(expected);
+        EXPECT_TRUE(image.isApprox(expected));
+    }
+}
+
+TEST_F(AutoExposureTest, ThrottledBeamUniformityCorrectorReusesOffsets) {
+    ThrottledBeamUniformityCorrector buc(2);
+    auto image = make_image();
+    ouster::img_t<float> first = image;
+    ouster::img_t<float> second = image;
+    buc(first);
+    buc(second);  // not an update frame, cached offsets are applied
+    EXPECT_LT((first.max(0.0f) - second).abs().maxCoeff(), 1e-3);
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+#include "../src/bounded_queue.h"
+
+using namespace std::chrono_literals;
+using namespace ouster_ros;
+
+class BoundedQueueTest : public ::testing::Test {
+   protected:
+    static const int CAPACITY = 3;
+};
+
+TEST_F(BoundedQueueTest, PreservesOrder) {
+    BoundedQueue<int> queue(CAPACITY, QueuePolicy::BLOCK);
+    for (int i = 0; i < CAPACITY; ++i) EXPECT_TRUE(queue.push(i));
+    EXPECT_EQ(queue.size(), static_cast<size_t>(CAPACITY));
+    for (int i = 0; i < CAPACITY; ++i) {
+        int item = -1;
+        EXPECT_TRUE(queue.pop(item));
+        EXPECT_EQ(item, i);
+    }
+    EXPECT_EQ(queue.size(), 0U);
+}
+
+TEST_F(BoundedQueueTest, DropOldestDiscardsFrontItem) {
+    BoundedQueue<int> queue(CAPACITY, QueuePolicy::DROP_OLDEST);
+    for (int i = 0; i < CAPACITY; ++i) EXPECT_TRUE(queue.push(i));
+    EXPECT_FALSE(queue.push(CAPACITY));
+    EXPECT_FALSE(queue.push(CAPACITY + 1));
+    EXPECT_EQ(queue.dropped_count(), 2U);
+    EXPECT_EQ(queue.size(), static_cast<size_t>(CAPACITY));
+
+    int item = -1;
+    EXPECT_TRUE(queue.pop(item));
+    EXPECT_EQ(item, 2);
+}
+
+TEST_F(BoundedQueueTest, DropNewestDiscardsPushedItem) {
+    BoundedQueue<int> queue(CAPACITY, QueuePolicy::DROP_NEWEST);
+    for (int i = 0; i < CAPACITY; ++i) EXPECT_TRUE(queue.push(i));
+    const int newest = CAPACITY;
+    int discarded = -1;
+    EXPECT_FALSE(queue.push(newest, &discarded));
+    EXPECT_EQ(discarded, newest);
+    EXPECT_EQ(queue.dropped_count(), 1U);
+
+    int item = -1;
+    EXPECT_TRUE(queue.pop(item));
+    EXPECT_EQ(item, 0);
+    EXPECT_TRUE(queue.push(CAPACITY + 1));
+}
+
+TEST_F(BoundedQueueTest, DiscardedItemIsHandedBack) {
+    BoundedQueue<int> queue(1, QueuePolicy::DROP_OLDEST);
+    queue.push(1);
+    int discarded = -1;
+    EXPECT_FALSE(queue.push(2, &discarded));
+    EXPECT_EQ(discarded, 1);
+}
+
+TEST_F(BoundedQueueTest, BlockWaitsForSpace) {
+    BoundedQueue<int> queue(CAPACITY, QueuePolicy::BLOCK);
+    for (int i = 0; i < CAPACITY; ++i) queue.push(i);
+
+    std::atomic<bool> pushed{false};
+    std::thread producer([&]() {
+        queue.push(CAPACITY);
+        pushed = true;
+    });
+
+    std::this_thread::sleep_for(50ms);
+    EXPECT_FALSE(pushed);
+
+    int item = -1;
+    EXPECT_TRUE(queue.pop(item));
+    producer.join();
+    EXPECT_TRUE(pushed);
+    EXPECT_EQ(queue.dropped_count(), 0U);
+    EXPECT_EQ(queue.size(), static_cast<size_t>(CAPACITY));
+}
+
+TEST_F(BoundedQueueTest, CloseReleasesBlockedThreads) {
+    BoundedQueue<int> queue(CAPACITY, QueuePolicy::BLOCK);
+    std::thread consumer([&]() {
+        int item;
+        EXPECT_FALSE(queue.pop(item));
+    });
+    std::this_thread::sleep_for(20ms);
+    queue.close();
+    consumer.join();
+    EXPECT_FALSE(queue.push(0));
+}
+
+TEST_F(BoundedQueueTest, ItemsRemainAvailableAfterClose) {
+    BoundedQueue<int> queue(CAPACITY, QueuePolicy::DROP_OLDEST);
+    queue.push(7);
+    queue.close();
+    int item = -1;
+    EXPECT_TRUE(queue.pop(item));
+    EXPECT_EQ(item, 7);
+    EXPECT_FALSE(queue.pop(item));
+}
+
+TEST_F(BoundedQueueTest, ParsePolicy) {
+    EXPECT_EQ(queue_policy_of_string("DROP_OLDEST"), QueuePolicy::DROP_OLDEST);
+    EXPECT_EQ(queue_policy_of_string("DROP_NEWEST"), QueuePolicy::DROP_NEWEST);
+    EXPECT_EQ(queue_policy_of_string("BLOCK"), QueuePolicy::BLOCK);
+    EXPECT_THROW(queue_policy_of_string("UNKNOWN"), std::runtime_error);
+}
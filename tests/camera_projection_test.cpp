@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "../src/camera_projection.h"
+#include "../src/parallel_for.h"
+
+using namespace ouster_ros;
+
+namespace {
+
+CameraConfig make_camera(CameraModel model) {
+    CameraConfig camera;
+    camera.name = "front";
+    camera.model = model;
+    camera.width = 64;
+    camera.height = 48;
+    camera.fx = camera.fy = 40.0;
+    camera.cx = 32.0;
+    camera.cy = 24.0;
+    return camera;
+}
+
+struct Drained {
+    std::vector<float> depth;
+    std::vector<uint32_t> point;
+};
+
+Drained drain(CameraDepthBuffer& buffer) {
+    Drained out{std::vector<float>(buffer.size()),
+                std::vector<uint32_t>(buffer.size())};
+    buffer.drain(0, buffer.size(), [&](size_t px, float depth, uint32_t pt) {
+        out.depth[px] = depth;
+        out.point[px] = pt;
+    });
+    return out;
+}
+
+auto all_active = [](size_t) { return true; };
+
+}  // namespace
+
+TEST(CameraProjectionTest, NearestPointWinsThePixel) {
+    // points given in mm along unit directions, the camera looks along +z
+    CameraProjector::PointsF direction(5, 3), offset(5, 3);
+    offset.setZero();
+    direction << 0, 0, 0.001f,      // on the optical axis
+        0, 0, 0.001f,               // same pixel, nearer
+        0.0005f, 0, 0.001f,         // x/z = 0.5 -> u = 32 + 20
+        0, 0, -0.001f,              // behind the camera
+        0.01f, 0, 0.001f;           // outside of the image
+    const uint32_t range[5] = {5000, 2000, 4000, 3000, 1000};
+
+    CameraProjector projector(direction, offset,
+                              {make_camera(CameraModel::PINHOLE)});
+    projector.project(range, 0, 5, all_active);
+    auto out = drain(projector.depth_buffer(0));
+
+    const size_t center = 24 * 64 + 32;
+    EXPECT_FLOAT_EQ(out.depth[center], 2.0f);
+    EXPECT_EQ(out.point[center], 1u);
+    EXPECT_FLOAT_EQ(out.depth[24 * 64 + 52], 4.0f);
+    EXPECT_EQ(out.point[24 * 64 + 52], 2u);
+    size_t hits = 0;
+    for (float d : out.depth) hits += d > 0.0f;
+    EXPECT_EQ(hits, 2u);
+
+    // draining empties the buffer for the next scan
+    auto again = drain(projector.depth_buffer(0));
+    EXPECT_FLOAT_EQ(again.depth[center], 0.0f);
+}
+
+TEST(CameraProjectionTest, EquidistantModelMapsAnglesLinearly) {
+    CameraProjector::PointsF direction(1, 3), offset(1, 3);
+    offset.setZero();
+    // 45 degrees off axis
+    direction << 0.001f, 0, 0.001f;
+    const uint32_t range[1] = {1000};
+
+    CameraProjector projector(direction, offset,
+                              {make_camera(CameraModel::EQUIDISTANT)});
+    projector.project(range, 0, 1, all_active);
+    auto out = drain(projector.depth_buffer(0));
+    // u = cx + fx * theta = 32 + 40 * pi / 4 = 63.4
+    EXPECT_FLOAT_EQ(out.depth[24 * 64 + 63], 1.0f);
+}
+
+TEST(CameraProjectionTest, ParallelProjectionMatchesSerial) {
+    const size_t n = 20000;
+    CameraProjector::PointsF direction(n, 3), offset(n, 3);
+    std::vector<uint32_t> range(n);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> xy(-0.0006f, 0.0006f);
+    std::uniform_int_distribution<uint32_t> mm(0, 20000);
+    for (size_t i = 0; i < n; ++i) {
+        direction.row(i) << xy(rng), xy(rng), 0.001f;
+        range[i] = mm(rng);
+    }
+    offset.setZero();
+
+    auto camera = make_camera(CameraModel::PINHOLE);
+    camera.distortion = {-0.1, 0.01, 0.001, -0.001, 0.0};
+    CameraProjector serial(direction, offset, {camera});
+    CameraProjector parallel(direction, offset, {camera});
+    serial.project(range.data(), 0, n, all_active);
+    ParallelFor parallel_for(4);
+    parallel_for(n, [&](size_t begin, size_t end) {
+        parallel.project(range.data(), begin, end, all_active);
+    });
+
+    auto expected = drain(serial.depth_buffer(0));
+    auto actual = drain(parallel.depth_buffer(0));
+    EXPECT_EQ(expected.depth, actual.depth);
+    EXPECT_EQ(expected.point, actual.point);
+}
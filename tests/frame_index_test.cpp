@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+#include "../src/frame_index.h"
+
+using namespace ouster_ros;
+
+class FrameIndexTest : public ::testing::Test {
+   protected:
+    // frames of 4 packets, 16 columns per packet, the last packet of frame 2
+    // went missing
+    static FrameIndex build_index() {
+        FrameIndexBuilder builder;
+        uint64_t position = 24;
+        for (uint32_t frame = 0; frame < 4; ++frame) {
+            for (int packet = 0; packet < 4; ++packet) {
+                if (frame == 2 && packet == 3) continue;
+                const int last_col = packet * 16 + 15;
+                const uint64_t ts = 1000000 + frame * 64000 + packet * 16000;
+                builder.add_lidar_packet(position, 5000 + position, 100 + frame,
+                                         ts, last_col, ts + 15000);
+                position += 1000;
+            }
+        }
+        return builder.finish(position);
+    }
+};
+
+TEST_F(FrameIndexTest, IndexesTheFirstPacketOfEachFrame) {
+    auto index = build_index();
+    ASSERT_EQ(index.size(), 4u);
+    EXPECT_EQ(index[0].position, 24u);
+    EXPECT_EQ(index[1].position, 4024u);
+    EXPECT_EQ(index[3].position, 11024u);
+    EXPECT_EQ(index[3].timestamp, 16024u);
+    EXPECT_EQ(index[1].frame_id, 101u);
+    EXPECT_EQ(index[1].sensor_timestamp, 1064000u);
+}
+
+TEST_F(FrameIndexTest, RecordsTheTimestampStateOfThePreviousFrame) {
+    auto index = build_index();
+    EXPECT_EQ(index[0].timestamp_state().last_col_idx, -1);
+
+    auto state = index[1].timestamp_state();
+    EXPECT_EQ(state.last_col_idx, 63);
+    EXPECT_EQ(state.last_col_ts, 1000000u + 48000 + 15000);
+
+    // frame 2 lacks its last packet
+    state = index[3].timestamp_state();
+    EXPECT_EQ(state.last_col_idx, 47);
+    EXPECT_EQ(state.last_col_ts, 1000000u + 128000 + 32000 + 15000);
+}
+
+TEST_F(FrameIndexTest, LooksUpFramesByIdAndSensorTimestamp) {
+    auto index = build_index();
+    EXPECT_EQ(index.find_frame_id(102), 2);
+    EXPECT_EQ(index.find_frame_id(99), -1);
+    EXPECT_EQ(index.find_sensor_timestamp(1064000), 1);
+    EXPECT_EQ(index.find_sensor_timestamp(1064001), 2);
+    EXPECT_EQ(index.find_sensor_timestamp(2000000), -1);
+}
+
+TEST_F(FrameIndexTest, RoundTripsThroughFile) {
+    const std::string path = testing::TempDir() + "frame_index_test.frames";
+    auto index = build_index();
+    index.save(path);
+    auto loaded = FrameIndex::load(path);
+    std::remove(path.c_str());
+
+    ASSERT_EQ(loaded.size(), index.size());
+    EXPECT_EQ(loaded.recording_size(), index.recording_size());
+    for (size_t i = 0; i < index.size(); ++i) {
+        EXPECT_EQ(loaded[i].position, index[i].position);
+        EXPECT_EQ(loaded[i].prev_last_col_idx, index[i].prev_last_col_idx);
+        EXPECT_EQ(loaded[i].prev_last_col_ts, index[i].prev_last_col_ts);
+    }
+    EXPECT_EQ(loaded.find_frame_id(103), 3);
+
+    EXPECT_THROW(FrameIndex::load(path), std::runtime_error);
+}
@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include <ouster/lidar_scan.h>
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+
+#include "../src/laser_scan_processor.h"
+
+using namespace ouster::sensor;
+using namespace ouster_ros;
+
+class LaserScanTest : public ::testing::Test {
+   protected:
+    static constexpr size_t W = 1024;
+    static constexpr size_t H = 16;
+
+    void SetUp() override {
+        ls = std::make_unique<ouster::LidarScan>(
+            W, H, UDPProfileLidar::PROFILE_RNG19_RFL8_SIG16_NIR16);
+        auto range = ls->field<uint32_t>(RANGE);
+        auto signal = ls->field<uint16_t>(SIGNAL);
+        for (size_t i = 0; i < W * H; ++i) {
+            range.data()[i] = static_cast<uint32_t>(i * 7 % 100000);
+            signal.data()[i] = static_cast<uint16_t>(i * 13 % 65536);
+        }
+        for (size_t u = 0; u < H; ++u)
+            pixel_shift_by_row.push_back(u % 2 ? -31 : 12);
+    }
+
+    std::unique_ptr<ouster::LidarScan> ls;
+    std::vector<int> pixel_shift_by_row;
+};
+
+TEST_F(LaserScanTest, InPlaceExtractionMatchesReference) {
+    const uint16_t ring = 5;
+    sensor_msgs::LaserScan msg;
+    init_laser_scan_msg(msg, "os_lidar", MODE_1024x10);
+    auto columns = laser_scan_column_permutation(W, pixel_shift_by_row[ring]);
+    lidar_scan_to_laser_scan_msg(*ls, ros::Time(1, 0), ring, columns, 0, msg);
+
+    ASSERT_EQ(msg.ranges.size(), W);
+    ASSERT_EQ(msg.intensities.size(), W);
+    auto range = ls->field<uint32_t>(RANGE);
+    auto signal = ls->field<uint16_t>(SIGNAL);
+    const int w = static_cast<int>(W);
+    for (int v = 0; v < w; ++v) {
+        auto v_shift = (v + w - pixel_shift_by_row[ring] + w / 2) % w;
+        auto tgt_idx = w - 1 - v;
+        EXPECT_FLOAT_EQ(msg.ranges[tgt_idx],
+                        range(ring, v_shift) * range_unit);
+        EXPECT_FLOAT_EQ(msg.intensities[tgt_idx], signal(ring, v_shift));
+    }
+    EXPECT_EQ(msg.header.stamp, ros::Time(1, 0));
+    EXPECT_EQ(msg.header.frame_id, "os_lidar");
+}
+
+TEST_F(LaserScanTest, InitSetsAngleWindowAndRangeLimits) {
+    sensor_msgs::LaserScan msg;
+    init_laser_scan_msg(msg, "os_lidar", MODE_1024x10, "OS-2-128");
+    EXPECT_FLOAT_EQ(msg.angle_min, -M_PI);
+    EXPECT_NEAR(msg.angle_max + msg.angle_increment, M_PI, 1e-5);
+    EXPECT_FLOAT_EQ(msg.scan_time, 0.1f);
+    EXPECT_GT(msg.range_max, 120.0f);
+
+    init_laser_scan_msg(msg, "os_lidar", MODE_1024x10);
+    EXPECT_FLOAT_EQ(msg.range_max, 120.0f);
+}
+
+class LaserScanBandTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        info = default_sensor_info(MODE_1024x10);
+        info.fw_rev = "v2.4.0";
+        W = info.format.columns_per_frame;
+        H = info.format.pixels_per_column;
+        ls = std::make_unique<ouster::LidarScan>(
+            W, H, info.format.udp_profile_lidar);
+        for (size_t u = 0; u < H; ++u)
+            columns.push_back(laser_scan_column_permutation(
+                W, info.format.pixel_shift_by_row[u]));
+    }
+
+    // sets the range (mm) and signal of ring u at every entry of the scan
+    void fill_ring(size_t u, uint32_t range_mm, uint32_t signal) {
+        ls->field<uint32_t>(RANGE).row(u).setConstant(range_mm);
+        ouster::impl::visit_field(*ls, SIGNAL, [&](auto field) {
+            using T = typename decltype(field)::Scalar;
+            field.row(u).setConstant(static_cast<T>(signal));
+        });
+    }
+
+    // sets the range of ring u at entry i of the laser scan
+    void set_entry(size_t u, size_t i, uint32_t range_mm) {
+        ls->field<uint32_t>(RANGE)(u, columns[u][i]) = range_mm;
+    }
+
+    sensor_msgs::LaserScanConstPtr process(const LaserScanConfig& config) {
+        LaserScanProcessor::OutputType out;
+        auto processor = LaserScanProcessor::create(
+            info, "os_lidar", 0,
+            [&](LaserScanProcessor::OutputType msgs) { out = msgs; }, {},
+            config);
+        processor(*ls, 0, ros::Time(1, 0));
+        return out.empty() ? nullptr : out[0];
+    }
+
+    sensor_info info;
+    size_t W, H;
+    std::unique_ptr<ouster::LidarScan> ls;
+    std::vector<std::vector<int>> columns;
+};
+
+TEST_F(LaserScanBandTest, RingBandKeepsTheNearestReturnOfEachColumn) {
+    // ring u is at 10 - u meters, ring 6 is the nearest but outside the band
+    for (size_t u = 0; u < 6; ++u) fill_ring(u, 10000 - u * 1000, 100 + u);
+    fill_ring(6, 1000, 106);
+    set_entry(5, 7, 0);   // ring 4 is the nearest left at entry 7
+    set_entry(3, 11, 50);  // below range_min, ignored
+    for (size_t u = 2; u <= 5; ++u) set_entry(u, 9, 0);  // no return at all
+
+    LaserScanConfig config;
+    config.band_ring_min = 2;
+    config.band_ring_max = 5;
+    auto msg = process(config);
+    ASSERT_TRUE(msg);
+    ASSERT_EQ(msg->ranges.size(), W);
+    for (size_t i = 0; i < W; ++i) {
+        if (i == 7) {
+            EXPECT_FLOAT_EQ(msg->ranges[i], 6.0f);
+            EXPECT_FLOAT_EQ(msg->intensities[i], 104.0f);
+        } else if (i == 9) {
+            EXPECT_FLOAT_EQ(msg->ranges[i], 0.0f);
+            EXPECT_FLOAT_EQ(msg->intensities[i], 0.0f);
+        } else {
+            EXPECT_FLOAT_EQ(msg->ranges[i], 5.0f) << "entry " << i;
+            EXPECT_FLOAT_EQ(msg->intensities[i], 105.0f) << "entry " << i;
+        }
+    }
+    EXPECT_EQ(msg->header.stamp, ros::Time(1, 0));
+}
+
+TEST_F(LaserScanBandTest, HeightBandSkipsReturnsOutsideOfIt) {
+    // the top ring looks up the most, the middle one is nearly level
+    const size_t top = 0;
+    size_t level = 0;
+    for (size_t u = 0; u < H; ++u)
+        if (std::abs(info.beam_altitude_angles[u]) <
+            std::abs(info.beam_altitude_angles[level]))
+            level = u;
+    for (size_t u = 0; u < H; ++u) fill_ring(u, 20000, 100 + u);
+    fill_ring(top, 3000, 100 + top);
+    fill_ring(level, 8000, 100 + level);
+
+    // the z of each of these returns in the sensor frame, from the same
+    // lookup table the processor builds the band with
+    auto lut = ouster::make_xyz_lut(info);
+    auto z = [&](size_t u, size_t i, double range_mm) {
+        const size_t idx = u * W + columns[u][i];
+        return lut.direction(idx, 2) * range_mm + lut.offset(idx, 2);
+    };
+    for (size_t i = 0; i < W; ++i) {
+        ASSERT_GT(z(top, i, 3000), 1.0);
+        ASSERT_LT(std::abs(z(level, i, 8000)), 1.0);
+    }
+
+    LaserScanConfig config;
+    config.band_height_min = -1.0;
+    config.band_height_max = 1.0;
+    auto msg = process(config);
+    ASSERT_TRUE(msg);
+    for (size_t i = 0; i < W; ++i) {
+        EXPECT_FLOAT_EQ(msg->ranges[i], 8.0f) << "entry " << i;
+        EXPECT_FLOAT_EQ(msg->intensities[i], 100.0f + level);
+    }
+}
+
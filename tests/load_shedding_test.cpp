@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#include "../src/load_shedding.h"
+
+using namespace ouster_ros;
+using ouster::sensor::ChanField;
+using ouster::sensor::UDPProfileLidar;
+
+namespace {
+
+constexpr double scan_period = 0.1;
+
+LoadSheddingConfig make_config() {
+    LoadSheddingConfig config;
+    config.hold_scans = 2;
+    return config;
+}
+
+}  // namespace
+
+TEST(LoadSheddingTest, StepsAreTakenInOrderAndUndoneInReverse) {
+    std::vector<int> levels;
+    LoadShedder shedder(make_config(), scan_period, 2,
+                        [&](int level) { levels.push_back(level); });
+    EXPECT_TRUE(shedder.image_active(ChanField::RANGE));
+
+    // overloaded: a step is taken every hold_scans + 1 scans
+    for (int i = 0; i < 9; ++i) shedder.scan_processed(1.5 * scan_period);
+    EXPECT_EQ(levels, (std::vector<int>{1, 2, 3}));
+    EXPECT_FALSE(shedder.images_active());
+    EXPECT_FALSE(shedder.cloud_active(1));
+    EXPECT_TRUE(shedder.return_active(2));  // extra laser scan rings
+    int clouds = 0;
+    for (int i = 0; i < 4; ++i) {
+        clouds += shedder.cloud_active(0);
+        shedder.scan_processed(1.5 * scan_period);
+    }
+    EXPECT_EQ(clouds, 2);
+
+    // in between the thresholds the level holds
+    for (int i = 0; i < 20; ++i) shedder.scan_processed(0.8 * scan_period);
+    EXPECT_EQ(shedder.level(), 3);
+
+    // with headroom the steps are undone, images come back last
+    for (int i = 0; i < 40; ++i) shedder.scan_processed(0.1 * scan_period);
+    EXPECT_EQ(levels, (std::vector<int>{1, 2, 3, 2, 1, 0}));
+    EXPECT_TRUE(shedder.return_active(1));
+    EXPECT_TRUE(shedder.image_active(ChanField::SIGNAL2));
+}
+
+TEST(LoadSheddingTest, SecondReturnStepKeepsFirstReturnImages) {
+    auto config = make_config();
+    config.order = {LoadSheddingStep::SECOND_RETURN};
+    LoadShedder shedder(config, scan_period, 2);
+    for (int i = 0; i < 3; ++i) shedder.scan_processed(2 * scan_period);
+    EXPECT_EQ(shedder.level(), 1);
+    EXPECT_TRUE(shedder.image_active(ChanField::RANGE));
+    EXPECT_FALSE(shedder.image_active(ChanField::RANGE2));
+    EXPECT_TRUE(shedder.cloud_active(0));
+
+    config.restore_load = config.shed_load;
+    EXPECT_THROW(LoadShedder(config, scan_period, 2), std::runtime_error);
+}
+
+TEST(LoadSheddingTest, StepIsKeptWhileUndoingItWouldOverloadAgain) {
+    auto config = make_config();
+    config.order = {LoadSheddingStep::IMAGES};
+    std::vector<int> levels;
+    LoadShedder shedder(config, scan_period, 1,
+                        [&](int level) { levels.push_back(level); });
+    // images take half of the scan period, more than the thresholds' gap
+    auto process = [&](double other_load) {
+        const double images = shedder.images_active() ? 0.5 : 0.0;
+        shedder.scan_processed((other_load + images) * scan_period);
+    };
+    for (int i = 0; i < 100; ++i) process(0.5);
+    EXPECT_EQ(levels, (std::vector<int>{1}));
+
+    // once the rest of the load drops the images come back
+    for (int i = 0; i < 40; ++i) process(0.05);
+    EXPECT_EQ(levels, (std::vector<int>{1, 0}));
+}
+
+TEST(LoadSheddingTest, CloudDecimationFollowsTheFrameId) {
+    auto config = make_config();
+    config.order = {LoadSheddingStep::CLOUD_DECIMATION};
+    config.cloud_decimation = 3;
+    LoadShedder shedder(config, scan_period, 1);
+    for (int i = 0; i < 3; ++i) shedder.scan_processed(2 * scan_period);
+    ASSERT_EQ(shedder.level(), 1);
+
+    std::vector<int32_t> kept;
+    auto processor = shedder.wrap({[&](const ouster::LidarScan& scan,
+                                       uint64_t, const ros::Time&) {
+        if (shedder.cloud_active(0)) kept.push_back(scan.frame_id);
+    }});
+    ouster::LidarScan scan(4, 2, UDPProfileLidar::PROFILE_LIDAR_LEGACY);
+    // concurrent workers may complete scans out of order
+    for (int32_t frame_id : {10, 12, 11, 13, 15, 14}) {
+        scan.frame_id = frame_id;
+        processor(scan, 0, ros::Time{});
+    }
+    EXPECT_EQ(kept, (std::vector<int32_t>{12, 15}));
+}
+
+TEST(LoadSheddingTest, OrderedProcessorsCountAgainstASingleScanPeriod) {
+    LoadShedder shedder(make_config(), scan_period, 1, {}, 2);
+    // two workers take 1.2 scan periods per scan, within their budget
+    for (int i = 0; i < 10; ++i) shedder.scan_processed(1.2 * scan_period);
+    EXPECT_EQ(shedder.level(), 0);
+    EXPECT_NEAR(shedder.load(), 0.6, 1e-9);
+
+    // the ordered processors, run one scan at a time, can't keep up
+    for (int i = 0; i < 3; ++i) {
+        shedder.ordered_scan_processed(1.1 * scan_period);
+        shedder.scan_processed(1.2 * scan_period);
+    }
+    EXPECT_EQ(shedder.level(), 1);
+    EXPECT_FALSE(shedder.images_active());
+}
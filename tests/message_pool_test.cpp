@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+
+#include "../src/message_pool.h"
+
+using namespace ouster_ros;
+
+struct TestMsg {
+    std::vector<uint8_t> data;
+};
+
+class MessagePoolTest : public ::testing::Test {
+   protected:
+    static const int POOL_SIZE = 3;
+    static const int DATA_SIZE = 16;
+
+    void SetUp() override {
+        pool = std::make_unique<MessagePool<TestMsg>>(
+            POOL_SIZE, [](TestMsg& msg) { msg.data.resize(DATA_SIZE); });
+    }
+
+    void TearDown() override { pool.reset(); }
+
+    std::unique_ptr<MessagePool<TestMsg>> pool;
+};
+
+TEST_F(MessagePoolTest, PreallocatesMessages) {
+    EXPECT_EQ(pool->capacity(), static_cast<size_t>(POOL_SIZE));
+    EXPECT_EQ(pool->available(), static_cast<size_t>(POOL_SIZE));
+    auto msg = pool->acquire();
+    EXPECT_EQ(msg->data.size(), static_cast<size_t>(DATA_SIZE));
+    EXPECT_EQ(pool->available(), static_cast<size_t>(POOL_SIZE - 1));
+    EXPECT_EQ(pool->exhausted_count(), 0U);
+}
+
+TEST_F(MessagePoolTest, RecyclesOnlyAfterLastReferenceIsDropped) {
+    auto msg = pool->acquire();
+    const TestMsg* raw = msg.get();
+    boost::shared_ptr<const TestMsg> subscriber_ref = msg;
+
+    msg.reset();
+    EXPECT_EQ(pool->available(), static_cast<size_t>(POOL_SIZE - 1));
+
+    subscriber_ref.reset();
+    EXPECT_EQ(pool->available(), static_cast<size_t>(POOL_SIZE));
+
+    // the most recently released message is handed out first
+    auto reused = pool->acquire();
+    EXPECT_EQ(reused.get(), raw);
+}
+
+TEST_F(MessagePoolTest, FallsBackToAllocationWhenExhausted) {
+    std::vector<MessagePool<TestMsg>::Ptr> held;
+    for (int i = 0; i < POOL_SIZE; ++i) held.push_back(pool->acquire());
+    EXPECT_EQ(pool->available(), 0U);
+    EXPECT_EQ(pool->exhausted_count(), 0U);
+
+    auto extra = pool->acquire();
+    ASSERT_TRUE(extra);
+    EXPECT_EQ(extra->data.size(), static_cast<size_t>(DATA_SIZE));
+    EXPECT_EQ(pool->exhausted_count(), 1U);
+
+    // messages allocated on exhaustion are not added to the pool
+    extra.reset();
+    EXPECT_EQ(pool->available(), 0U);
+    held.clear();
+    EXPECT_EQ(pool->available(), static_cast<size_t>(POOL_SIZE));
+}
+
+TEST_F(MessagePoolTest, MessagesCanOutliveThePool) {
+    auto msg = pool->acquire();
+    pool.reset();
+    msg->data[0] = 1;  // must still be valid
+    msg.reset();       // and released without the pool
+}
+
+TEST_F(MessagePoolTest, ReleaseFromOtherThreads) {
+    const int ITERATIONS = 1000;
+    for (int i = 0; i < ITERATIONS; ++i) {
+        auto msg = pool->acquire();
+        std::thread t([m = std::move(msg)]() mutable { m.reset(); });
+        t.join();
+    }
+    EXPECT_EQ(pool->available(), static_cast<size_t>(POOL_SIZE));
+    EXPECT_EQ(pool->exhausted_count(), 0U);
+}
+
+TEST_F(MessagePoolTest, ReportsExhaustion) {
+    size_t reported = 0;
+    MessagePool<TestMsg> small_pool(1, {}, [&reported](size_t count) {
+        reported = count;
+    });
+    auto first = small_pool.acquire();
+    EXPECT_EQ(reported, 0U);
+    auto second = small_pool.acquire();
+    auto third = small_pool.acquire();
+    EXPECT_EQ(reported, 2U);
+    EXPECT_EQ(small_pool.exhausted_count(), 2U);
+}
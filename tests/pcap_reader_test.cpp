@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+
+#include "../src/pcap_reader.h"
+#include "../src/playback_pacer.h"
+
+using namespace ouster_ros;
+
+class PcapReaderTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        path = testing::TempDir() + "pcap_reader_test.pcap";
+        // global header: microsecond resolution, ethernet link type
+        put32(0xa1b2c3d4);
+        put16(2);
+        put16(4);
+        put32(0);
+        put32(0);
+        put32(65535);
+        put32(1);
+    }
+
+    void TearDown() override { std::remove(path.c_str()); }
+
+    void put16(uint16_t v) {
+        bytes.push_back(v & 0xFF);
+        bytes.push_back(v >> 8);
+    }
+
+    void put32(uint32_t v) {
+        put16(v & 0xFFFF);
+        put16(v >> 16);
+    }
+
+    static void put_be16(std::vector<uint8_t>& b, uint16_t v) {
+        b.push_back(v >> 8);
+        b.push_back(v & 0xFF);
+    }
+
+    // appends an ethernet frame holding an ip fragment of the udp datagram
+    void add_fragment(uint32_t ts_usec, uint16_t id, const uint8_t* payload,
+                      size_t len, size_t fragment_offset, bool more) {
+        std::vector<uint8_t> frame(12, 0);
+        put_be16(frame, 0x0800);
+        frame.push_back(0x45);
+        frame.push_back(0);
+        put_be16(frame, static_cast<uint16_t>(20 + len));
+        put_be16(frame, id);
+        put_be16(frame, static_cast<uint16_t>((more ? 0x2000 : 0) |
+                                              fragment_offset / 8));
+        frame.push_back(64);
+        frame.push_back(17);
+        put_be16(frame, 0);
+        for (uint8_t b : {192, 168, 1, 10, 192, 168, 1, 20}) frame.push_back(b);
+        frame.insert(frame.end(), payload, payload + len);
+
+        put32(1);
+        put32(ts_usec);
+        put32(static_cast<uint32_t>(frame.size()));
+        put32(static_cast<uint32_t>(frame.size()));
+        bytes.insert(bytes.end(), frame.begin(), frame.end());
+    }
+
+    static std::vector<uint8_t> make_datagram(uint16_t port, size_t size) {
+        std::vector<uint8_t> udp;
+        put_be16(udp, 7502);
+        put_be16(udp, port);
+        put_be16(udp, static_cast<uint16_t>(size + 8));
+        put_be16(udp, 0);
+        for (size_t i = 0; i < size; ++i) udp.push_back(i % 251);
+        return udp;
+    }
+
+    void write() {
+        std::ofstream ofs(path, std::ios::binary);
+        ofs.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    std::string path;
+    std::vector<uint8_t> bytes;
+};
+
+TEST_F(PcapReaderTest, ReadsWholeAndFragmentedDatagrams) {
+    auto imu = make_datagram(7503, 48);
+    add_fragment(10, 1, imu.data(), imu.size(), 0, false);
+
+    // a lidar packet split in three fragments, the last one arriving first
+    auto lidar = make_datagram(7502, 3000);
+    add_fragment(20, 2, lidar.data() + 2400, lidar.size() - 2400, 2400, false);
+    add_fragment(30, 2, lidar.data(), 1200, 0, true);
+    add_fragment(40, 2, lidar.data() + 1200, 1200, 1200, true);
+    write();
+
+    PcapReader reader(path);
+    UdpPacket packet;
+    ASSERT_TRUE(reader.next(packet));
+    EXPECT_EQ(packet.dst_port, 7503);
+    EXPECT_EQ(packet.size, 48u);
+    EXPECT_EQ(packet.timestamp, 1000010000u);
+    EXPECT_EQ(packet.record_offset, 24u);
+    EXPECT_TRUE(std::equal(packet.data, packet.data + packet.size,
+                           imu.begin() + 8));
+
+    ASSERT_TRUE(reader.next(packet));
+    EXPECT_EQ(packet.dst_port, 7502);
+    ASSERT_EQ(packet.size, 3000u);
+    // timestamp of the first fragment of the datagram
+    EXPECT_EQ(packet.timestamp, 1000030000u);
+    EXPECT_TRUE(std::equal(packet.data, packet.data + packet.size,
+                           lidar.begin() + 8));
+    EXPECT_FALSE(reader.next(packet));
+
+    reader.rewind();
+    ASSERT_TRUE(reader.next(packet));
+    EXPECT_EQ(packet.size, 48u);
+}
+
+TEST_F(PcapReaderTest, SeeksToTheFirstRecordOfAnOutOfOrderDatagram) {
+    auto imu = make_datagram(7503, 48);
+    add_fragment(10, 1, imu.data(), imu.size(), 0, false);
+    // the fragments of the lidar packet arrive last one first
+    const size_t first_record = bytes.size();
+    auto lidar = make_datagram(7502, 3000);
+    add_fragment(20, 2, lidar.data() + 2400, lidar.size() - 2400, 2400, false);
+    add_fragment(30, 2, lidar.data() + 1200, 1200, 1200, true);
+    add_fragment(40, 2, lidar.data(), 1200, 0, true);
+    write();
+
+    PcapReader reader(path);
+    UdpPacket packet;
+    ASSERT_TRUE(reader.next(packet));
+    ASSERT_TRUE(reader.next(packet));
+    ASSERT_EQ(packet.size, 3000u);
+    EXPECT_EQ(packet.record_offset, first_record);
+
+    // seeking to the reported offset reads the whole datagram again
+    reader.seek(packet.record_offset);
+    ASSERT_TRUE(reader.next(packet));
+    EXPECT_EQ(packet.dst_port, 7502);
+    ASSERT_EQ(packet.size, 3000u);
+    EXPECT_TRUE(std::equal(packet.data, packet.data + packet.size,
+                           lidar.begin() + 8));
+    EXPECT_FALSE(reader.next(packet));
+}
+
+TEST_F(PcapReaderTest, StopsAtTruncatedRecord) {
+    auto imu = make_datagram(7503, 48);
+    add_fragment(10, 1, imu.data(), imu.size(), 0, false);
+    add_fragment(20, 2, imu.data(), imu.size(), 0, false);
+    bytes.resize(bytes.size() - 10);
+    write();
+
+    PcapReader reader(path);
+    UdpPacket packet;
+    EXPECT_TRUE(reader.next(packet));
+    EXPECT_FALSE(reader.next(packet));
+}
+
+TEST_F(PcapReaderTest, RejectsOtherFormats) {
+    bytes.assign(64, 0);
+    write();
+    EXPECT_THROW(PcapReader reader(path), std::runtime_error);
+}
+
+TEST(PlaybackPacerTest, PacesRelativeToFirstPacket) {
+    using Clock = std::chrono::steady_clock;
+    PlaybackPacer pacer(2.0);
+    auto start = Clock::now();
+    pacer.wait(1000000000);
+    pacer.wait(1000000000 + 40000000);  // due 20 ms after the first packet
+    auto elapsed = Clock::now() - start;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(19));
+
+    PlaybackPacer unthrottled(0.0);
+    start = Clock::now();
+    unthrottled.wait(0);
+    unthrottled.wait(10000000000);
+    EXPECT_LT(Clock::now() - start, std::chrono::milliseconds(100));
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "../src/point_cloud_file_writer.h"
+
+using namespace ouster_ros;
+
+class PointCloudFileWriterTest : public ::testing::Test {
+   protected:
+    static sensor_msgs::PointField field(const std::string& name,
+                                         uint32_t offset, uint8_t datatype) {
+        sensor_msgs::PointField f;
+        f.name = name;
+        f.offset = offset;
+        f.datatype = datatype;
+        f.count = 1;
+        return f;
+    }
+
+    // a 2x2 cloud of {float x, float y, float z, pad, uint16 ring, pad}
+    static sensor_msgs::PointCloud2 make_cloud() {
+        using sensor_msgs::PointField;
+        sensor_msgs::PointCloud2 msg;
+        msg.width = 2;
+        msg.height = 2;
+        msg.point_step = 20;
+        msg.row_step = msg.point_step * msg.width;
+        // fields intentionally listed out of offset order
+        msg.fields = {field("ring", 16, PointField::UINT16),
+                      field("x", 0, PointField::FLOAT32),
+                      field("y", 4, PointField::FLOAT32),
+                      field("z", 8, PointField::FLOAT32)};
+        msg.data.assign(msg.row_step * msg.height, 0xff);
+        for (uint16_t i = 0; i < 4; ++i) {
+            float xyz[3] = {1.0f * i, 2.0f * i, 3.0f * i};
+            std::memcpy(&msg.data[i * msg.point_step], xyz, sizeof(xyz));
+            std::memcpy(&msg.data[i * msg.point_step + 16], &i, sizeof(i));
+        }
+        return msg;
+    }
+
+    static std::string read_file(const std::string& path) {
+        std::ifstream ifs(path, std::ios::binary);
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+        return ss.str();
+    }
+
+    static void expect_packed_points(const std::string& data) {
+        ASSERT_EQ(data.size(), 4u * 14);
+        for (uint16_t i = 0; i < 4; ++i) {
+            float xyz[3];
+            uint16_t ring;
+            std::memcpy(xyz, &data[i * 14], sizeof(xyz));
+            std::memcpy(&ring, &data[i * 14 + 12], sizeof(ring));
+            EXPECT_FLOAT_EQ(xyz[0], 1.0f * i);
+            EXPECT_FLOAT_EQ(xyz[2], 3.0f * i);
+            EXPECT_EQ(ring, i);
+        }
+    }
+};
+
+TEST_F(PointCloudFileWriterTest, WritesBinaryPcdWithoutPadding) {
+    const std::string path = "/tmp/point_cloud_file_writer_test.pcd";
+    PointCloudFileWriter writer(CloudFileFormat::PCD);
+    writer.write(make_cloud(), path);
+    auto content = read_file(path);
+    std::remove(path.c_str());
+
+    const std::string data_marker = "DATA binary\n";
+    auto pos = content.find(data_marker);
+    ASSERT_NE(pos, std::string::npos);
+    auto header = content.substr(0, pos);
+    EXPECT_NE(header.find("FIELDS x y z ring\n"), std::string::npos);
+    EXPECT_NE(header.find("SIZE 4 4 4 2\n"), std::string::npos);
+    EXPECT_NE(header.find("TYPE F F F U\n"), std::string::npos);
+    EXPECT_NE(header.find("WIDTH 2\nHEIGHT 2\n"), std::string::npos);
+    EXPECT_NE(header.find("POINTS 4\n"), std::string::npos);
+    expect_packed_points(content.substr(pos + data_marker.size()));
+}
+
+TEST_F(PointCloudFileWriterTest, WritesBinaryPly) {
+    const std::string path = "/tmp/point_cloud_file_writer_test.ply";
+    PointCloudFileWriter writer(CloudFileFormat::PLY);
+    writer.write(make_cloud(), path);
+    auto content = read_file(path);
+    std::remove(path.c_str());
+
+    const std::string end_marker = "end_header\n";
+    auto pos = content.find(end_marker);
+    ASSERT_NE(pos, std::string::npos);
+    EXPECT_EQ(content.substr(0, pos),
+              "ply\nformat binary_little_endian 1.0\nelement vertex 4\n"
+              "property float x\nproperty float y\nproperty float z\n"
+              "property ushort ring\n");
+    expect_packed_points(content.substr(pos + end_marker.size()));
+}
+
+TEST_F(PointCloudFileWriterTest, RejectsUnknownFormat) {
+    EXPECT_THROW(cloud_file_format_of_string("las"), std::runtime_error);
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+// prevent clang-format from altering the location of "ouster_ros/os_ros.h", the
+// header file needs to be the first include due to PCL_NO_PRECOMPILE flag
+// clang-format off
+#include "ouster_ros/os_ros.h"
+// clang-format on
+#include "ouster_ros/os_point.h"
+#include "../src/point_cloud_wire_format.h"
+
+using namespace ouster_ros;
+
+class PointCloudWireFormatTest : public ::testing::Test {
+   protected:
+    static const uint32_t WIDTH = 8;
+    static const uint32_t HEIGHT = 4;
+
+    static void fill_point(ouster_ros::Point& pt, int i) {
+        pt.x = 0.5f * i;
+        pt.y = -0.25f * i;
+        pt.z = 1.0f + i;
+        pt.intensity = 2.0f * i;
+        pt.t = 100 * i;
+        pt.reflectivity = static_cast<uint16_t>(i);
+        pt.ring = static_cast<uint16_t>(i / WIDTH);
+        pt.ambient = static_cast<uint16_t>(i + 1);
+        pt.range = 1000 * i;
+    }
+};
+
+TEST_F(PointCloudWireFormatTest, MatchesSerializedPointCloud2) {
+    PointCloud2WireWriter<ouster_ros::Point> writer(WIDTH, HEIGHT, "os_lidar",
+                                                    2);
+    Cloud<ouster_ros::Point> cloud{WIDTH, HEIGHT};
+
+    auto buffer = writer.acquire();
+    auto* points = writer.points(*buffer);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(points) % 16, 0U);
+    for (int i = 0; i < static_cast<int>(WIDTH * HEIGHT); ++i) {
+        fill_point(points[i], i);
+        fill_point(cloud.points[i], i);
+    }
+
+    ros::Time stamp(1234, 5678);
+    auto msg = writer.finalize(buffer, stamp);
+
+    sensor_msgs::PointCloud2 expected;
+    pcl::toROSMsg(cloud, expected);
+    expected.header.stamp = stamp;
+    expected.header.frame_id = "os_lidar";
+
+    // roscpp must send the buffer as is
+    auto m = ros::serialization::serializeMessage(*msg);
+    EXPECT_EQ(m.buf.get(), msg->buffer.get());
+    EXPECT_EQ(m.num_bytes,
+              ros::serialization::serializationLength(expected) + 4);
+
+    sensor_msgs::PointCloud2 actual;
+    ros::serialization::IStream stream(m.message_start, m.num_bytes - 4);
+    ros::serialization::deserialize(stream, actual);
+
+    EXPECT_EQ(actual.header.stamp, expected.header.stamp);
+    EXPECT_EQ(actual.header.frame_id, expected.header.frame_id);
+    EXPECT_EQ(actual.width, expected.width);
+    EXPECT_EQ(actual.height, expected.height);
+    EXPECT_EQ(actual.point_step, expected.point_step);
+    EXPECT_EQ(actual.row_step, expected.row_step);
+    EXPECT_EQ(actual.is_dense, expected.is_dense);
+    ASSERT_EQ(actual.fields.size(), expected.fields.size());
+    for (size_t i = 0; i < actual.fields.size(); ++i) {
+        EXPECT_EQ(actual.fields[i].name, expected.fields[i].name);
+        EXPECT_EQ(actual.fields[i].offset, expected.fields[i].offset);
+        EXPECT_EQ(actual.fields[i].datatype, expected.fields[i].datatype);
+        EXPECT_EQ(actual.fields[i].count, expected.fields[i].count);
+    }
+
+    Cloud<ouster_ros::Point> roundtrip;
+    pcl::fromROSMsg(actual, roundtrip);
+    ASSERT_EQ(roundtrip.size(), cloud.size());
+    for (size_t i = 0; i < cloud.size(); ++i) {
+        EXPECT_EQ(roundtrip.points[i].x, cloud.points[i].x);
+        EXPECT_EQ(roundtrip.points[i].range, cloud.points[i].range);
+        EXPECT_EQ(roundtrip.points[i].ring, cloud.points[i].ring);
+    }
+}
+
+TEST_F(PointCloudWireFormatTest, BuffersReturnToPoolWhenReleased) {
+    PointCloud2WireWriter<ouster_ros::Point> writer(WIDTH, HEIGHT, "os_lidar",
+                                                    1);
+    auto msg = writer.finalize(writer.acquire(), ros::Time(1, 0));
+    const auto* first = msg->buffer.get();
+    msg.reset();
+
+    auto next = writer.finalize(writer.acquire(), ros::Time(2, 0));
+    EXPECT_EQ(next->buffer.get(), first);
+}
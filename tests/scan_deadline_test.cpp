@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+
+#include "../src/scan_deadline.h"
+
+using namespace ouster_ros;
+
+namespace {
+
+constexpr uint64_t ms = 1000000;
+// the sensor clock is far behind the host clock
+constexpr uint64_t clock_offset = 1000000 * ms;
+constexpr uint64_t scan_period = 100 * ms;
+
+}  // namespace
+
+TEST(ScanDeadlineTest, LatenessIsRelativeToTheMostTimelyScan) {
+    ScanDeadline deadline(0.05, DeadlineAction::SKIP, {"PCL"});
+    uint64_t scan = 0;
+    // scans complete and get processed a scan period after they start
+    for (; scan < 5; ++scan) {
+        const uint64_t msg_ns = scan * scan_period + 1;
+        const uint64_t now_ns = msg_ns + clock_offset + scan_period;
+        EXPECT_FALSE(deadline.late(msg_ns, now_ns));
+    }
+
+    // the host stalls for 200 ms, the next scan is late for all processors
+    uint64_t msg_ns = scan++ * scan_period + 1;
+    uint64_t now_ns = msg_ns + clock_offset + scan_period + 200 * ms;
+    EXPECT_TRUE(deadline.late(msg_ns, now_ns));
+    EXPECT_TRUE(deadline.late(msg_ns, now_ns + ms));
+
+    // skipping the processing catches up with the sensor
+    msg_ns = scan++ * scan_period + 1;
+    now_ns = msg_ns + clock_offset + scan_period;
+    EXPECT_FALSE(deadline.late(msg_ns, now_ns));
+}
+
+TEST(ScanDeadlineTest, ProcessingTimeCountsAgainstTheDeadline) {
+    ScanDeadline deadline(0.05, DeadlineAction::DROP, {});
+    const uint64_t msg_ns = 1;
+    const uint64_t now_ns = msg_ns + clock_offset;
+    EXPECT_FALSE(deadline.late(msg_ns, now_ns));
+    // a slow processor makes the scan late for the ones that follow
+    EXPECT_FALSE(deadline.late(msg_ns, now_ns + 40 * ms));
+    EXPECT_TRUE(deadline.late(msg_ns, now_ns + 60 * ms));
+    EXPECT_THROW(ScanDeadline(0.0, DeadlineAction::SKIP, {}),
+                 std::runtime_error);
+}
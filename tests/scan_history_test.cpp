@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <ouster/lidar_scan.h>
+
+#include <cstring>
+
+#include "../src/scan_history.h"
+
+using namespace ouster::sensor;
+using namespace ouster_ros;
+
+class ScanHistoryTest : public ::testing::Test {
+   protected:
+    static constexpr size_t W = 64;
+    static constexpr size_t H = 8;
+    static constexpr uint64_t col_spacing = 1000;
+    static constexpr uint64_t scan_period = W * col_spacing;
+
+    void SetUp() override {
+        info.format.columns_per_frame = W;
+        info.format.pixels_per_column = H;
+        info.format.columns_per_packet = 16;
+        info.format.udp_profile_lidar = UDPProfileLidar::PROFILE_LIDAR_LEGACY;
+        scan = std::make_unique<ouster::LidarScan>(
+            W, H, info.format.udp_profile_lidar);
+    }
+
+    // fills in the column timestamps of scan n, columns [0, 4) are missing
+    void make_scan(uint64_t n) {
+        auto ts = scan->timestamp();
+        for (size_t i = 0; i < W; ++i)
+            ts[i] = i < 4 ? 0 : 1000000 + n * scan_period + i * col_spacing;
+    }
+
+    sensor_info info;
+    std::unique_ptr<ouster::LidarScan> scan;
+};
+
+TEST_F(ScanHistoryTest, FindsTheScanAndColumnsCoveringATimestamp) {
+    ScanHistory history(info, 3);
+    // messages are stamped 500 ns behind the column clock
+    for (uint64_t n = 0; n < 5; ++n) {
+        make_scan(n);
+        const uint64_t col_scan_ts = 1000000 + n * scan_period;
+        ASSERT_TRUE(history.add(*scan, col_scan_ts - 500, col_scan_ts));
+    }
+    EXPECT_EQ(history.size(), 3u);
+
+    // column 10 of scan 3
+    const uint64_t ts = 1000000 + 3 * scan_period + 10 * col_spacing - 500;
+    auto match = history.find(ts + 100);
+    ASSERT_TRUE(match.scan);
+    EXPECT_EQ(match.scan_ts, 1000000 + 3 * scan_period - 500);
+    EXPECT_EQ(match.first_col, 10);
+    EXPECT_EQ(match.last_col, 10);
+    EXPECT_EQ(match.first_col_ts, ts);
+
+    match = history.find(ts - 200, ts + 2 * col_spacing);
+    EXPECT_EQ(match.first_col, 10);
+    EXPECT_EQ(match.last_col, 12);
+    EXPECT_EQ(match.last_col_ts, ts + 2 * col_spacing);
+
+    // scans 0 and 1 were evicted, the closest one left is scan 2
+    match = history.find(1000000);
+    ASSERT_TRUE(match.scan);
+    EXPECT_EQ(match.scan_ts, 1000000 + 2 * scan_period - 500);
+    EXPECT_EQ(match.first_col, 4);
+}
+
+TEST_F(ScanHistoryTest, ScansHeldByCallersAreNotOverwritten) {
+    ScanHistory history(info, 2, 1);
+    make_scan(0);
+    history.add(*scan, 1, 1);
+    auto held = history.find(1).scan;
+    const uint64_t held_first_ts = held->timestamp()[4];
+
+    // the two regular buffers and the spare one cycle around the held scan
+    for (uint64_t n = 1; n < 4; ++n) {
+        make_scan(n);
+        EXPECT_TRUE(history.add(*scan, 1, 1));
+    }
+    EXPECT_EQ(held->timestamp()[4], held_first_ts);
+    EXPECT_EQ(history.dropped_count(), 0u);
+
+    // with two held scans and the history full there is no buffer left
+    auto held2 = history.find(UINT64_MAX).scan;
+    make_scan(4);
+    EXPECT_TRUE(history.add(*scan, 1, 1));
+    make_scan(5);
+    EXPECT_FALSE(history.add(*scan, 1, 1));
+    EXPECT_EQ(history.dropped_count(), 1u);
+    // the dropped scan doesn't cost the history its oldest scan
+    EXPECT_EQ(history.size(), 2u);
+    EXPECT_EQ(history.find(0).scan, held2);
+
+    held.reset();
+    held2.reset();
+    make_scan(6);
+    EXPECT_TRUE(history.add(*scan, 1, 1));
+}
+
+TEST_F(ScanHistoryTest, ReturnsThePointsOfTheMatchedColumns) {
+    ScanHistory history(info, 2);
+    make_scan(0);
+    auto range = scan->field<uint32_t>(ChanField::RANGE);
+    range(2, 10) = 5000;
+    range(0, 11) = 2000;
+    const uint64_t col_scan_ts = 1000000;
+    ASSERT_TRUE(history.add(*scan, col_scan_ts - 500, col_scan_ts));
+
+    // every beam looks along x, row r sits r meters above the origin
+    Eigen::Array<float, Eigen::Dynamic, 3> direction =
+        Eigen::Array<float, Eigen::Dynamic, 3>::Zero(W * H, 3);
+    Eigen::Array<float, Eigen::Dynamic, 3> offset = direction;
+    for (size_t i = 0; i < W * H; ++i) {
+        direction(i, 0) = 0.001f;
+        offset(i, 2) = static_cast<float>(i / W);
+    }
+
+    const uint64_t col10_ts = col_scan_ts + 10 * col_spacing - 500;
+    auto match = history.find(col10_ts, col10_ts + 2 * col_spacing);
+    ASSERT_EQ(match.first_col, 10);
+    ASSERT_EQ(match.last_col, 12);
+
+    sensor_msgs::PointCloud2 cloud;
+    scan_columns_to_cloud(match, direction, offset, cloud);
+    ASSERT_EQ(cloud.height, H);
+    ASSERT_EQ(cloud.width, 3u);
+    ASSERT_EQ(cloud.fields.size(), 6u);
+    EXPECT_EQ(cloud.fields[4].name, "range");
+    ASSERT_EQ(cloud.data.size(), H * cloud.row_step);
+
+    auto point = [&](size_t row, size_t col) {
+        return cloud.data.data() + row * cloud.row_step +
+               col * cloud.point_step;
+    };
+    float xyz[3];
+    uint32_t t, rng;
+    uint16_t ring;
+    std::memcpy(xyz, point(2, 0), sizeof(xyz));
+    std::memcpy(&t, point(2, 0) + 12, sizeof(t));
+    std::memcpy(&rng, point(2, 0) + 16, sizeof(rng));
+    EXPECT_FLOAT_EQ(xyz[0], 5.0f);
+    EXPECT_FLOAT_EQ(xyz[2], 2.0f);
+    EXPECT_EQ(t, 10 * col_spacing);
+    EXPECT_EQ(rng, 5000u);
+
+    std::memcpy(xyz, point(0, 1), sizeof(xyz));
+    std::memcpy(&t, point(0, 1) + 12, sizeof(t));
+    EXPECT_FLOAT_EQ(xyz[0], 2.0f);
+    EXPECT_EQ(t, 11 * col_spacing);
+
+    // no return, only the ring is set
+    std::memcpy(xyz, point(1, 2), sizeof(xyz));
+    std::memcpy(&ring, point(1, 2) + 20, sizeof(ring));
+    EXPECT_FLOAT_EQ(xyz[0], 0.0f);
+    EXPECT_EQ(ring, 1);
+
+    scan_columns_to_cloud(ScanHistoryMatch{}, direction, offset, cloud);
+    EXPECT_EQ(cloud.width, 0u);
+    EXPECT_TRUE(cloud.data.empty());
+}
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <ouster/lidar_scan.h>
+
+#include <future>
+#include <string>
+
+#include "../src/scan_processing_stage.h"
+
+using namespace ouster::sensor;
+using namespace ouster_ros;
+
+class ScanProcessingStageTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        info.format.columns_per_frame = 16;
+        info.format.pixels_per_column = 4;
+        info.format.columns_per_packet = 16;
+        info.format.udp_profile_lidar = UDPProfileLidar::PROFILE_LIDAR_LEGACY;
+        scan = std::make_unique<ouster::LidarScan>(
+            16, 4, info.format.udp_profile_lidar);
+    }
+
+    // a processor recording the scans it sees, that holds on to the first
+    // scan until released
+    LidarScanProcessor recorder() {
+        return [this](const ouster::LidarScan&, uint64_t scan_ts,
+                      const ros::Time&) {
+            if (scan_ts == 0) {
+                started.set_value();
+                release.get_future().wait();
+            }
+            processed.push_back(scan_ts);
+        };
+    }
+
+    sensor_info info;
+    std::unique_ptr<ouster::LidarScan> scan;
+    std::promise<void> started;
+    std::promise<void> release;
+    std::vector<uint64_t> processed;
+};
+
+TEST_F(ScanProcessingStageTest, DropNewestKeepsQueuedScans) {
+    ScanProcessingStage stage(info, {recorder()}, 2, QueuePolicy::DROP_NEWEST);
+    stage.submit(*scan, 0, ros::Time{});
+    started.get_future().wait();
+    for (uint64_t ts = 1; ts < 6; ++ts) stage.submit(*scan, ts, ros::Time{});
+    release.set_value();
+    stage.flush();
+
+    EXPECT_EQ(processed, (std::vector<uint64_t>{0, 1, 2}));
+    EXPECT_EQ(stage.dropped_count(), 3U);
+}
+
+TEST_F(ScanProcessingStageTest, DropOldestKeepsLatestScans) {
+    ScanProcessingStage stage(info, {recorder()}, 2, QueuePolicy::DROP_OLDEST);
+    stage.submit(*scan, 0, ros::Time{});
+    started.get_future().wait();
+    for (uint64_t ts = 1; ts < 6; ++ts) stage.submit(*scan, ts, ros::Time{});
+    release.set_value();
+    stage.flush();
+
+    EXPECT_EQ(processed, (std::vector<uint64_t>{0, 4, 5}));
+    EXPECT_EQ(stage.dropped_count(), 3U);
+}
+
+TEST_F(ScanProcessingStageTest, WorkersTakeTurnsInScanOrder) {
+    // the first worker holds on to scan 0 while the second gets ahead
+    std::promise<uint64_t> first_finished;
+    auto worker = [&](const ouster::LidarScan&, uint64_t scan_ts,
+                      const ros::Time&) {
+        if (scan_ts == 0) {
+            started.set_value();
+            release.get_future().wait();
+        }
+        if (scan_ts == 1) first_finished.set_value(scan_ts);
+    };
+    auto ordered = [this](const ouster::LidarScan&, uint64_t scan_ts,
+                          const ros::Time&) { processed.push_back(scan_ts); };
+    ScanProcessingStage stage(info, {{worker}, {worker}}, {ordered}, 4,
+                              QueuePolicy::BLOCK);
+    stage.submit(*scan, 0, ros::Time{});
+    started.get_future().wait();
+    for (uint64_t ts = 1; ts < 4; ++ts) stage.submit(*scan, ts, ros::Time{});
+    EXPECT_EQ(first_finished.get_future().get(), 1U);
+    release.set_value();
+    stage.flush();
+
+    EXPECT_EQ(processed, (std::vector<uint64_t>{0, 1, 2, 3}));
+}
+
+namespace {
+
+// stands in for a ros::Publisher, records the messages it publishes
+struct RecordingPublisher {
+    std::string getTopic() const { return "points"; }
+    void publish(const boost::shared_ptr<const uint64_t>& msg) const {
+        received->push_back(*msg);
+    }
+    std::vector<uint64_t>* received;
+};
+
+}  // namespace
+
+TEST_F(ScanProcessingStageTest, WorkersPublishInScanOrder) {
+    std::vector<uint64_t> received;
+    RecordingPublisher pub{&received};
+    PublishingStage publishing_stage(1, 8, QueuePolicy::BLOCK, 0.0);
+
+    // scan 0 is published only after scan 1 was processed and published
+    std::promise<void> second_published;
+    auto worker = [&](const ouster::LidarScan&, uint64_t scan_ts,
+                      const ros::Time&) {
+        if (scan_ts == 0) second_published.get_future().wait();
+        publishing_stage.publish(
+            pub, boost::shared_ptr<const uint64_t>(new uint64_t{scan_ts}));
+        if (scan_ts == 1) second_published.set_value();
+    };
+    {
+        ScanProcessingStage stage(info, {{worker}, {worker}}, {}, 4,
+                                  QueuePolicy::BLOCK);
+        for (uint64_t ts = 0; ts < 4; ++ts)
+            stage.submit(*scan, ts, ros::Time{});
+        stage.flush();
+    }
+    publishing_stage.flush();
+
+    EXPECT_EQ(received, (std::vector<uint64_t>{0, 1, 2, 3}));
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "../src/sector_ranges.h"
+
+using namespace ouster_ros;
+
+class SectorRangesTest : public ::testing::Test {
+   protected:
+    static constexpr size_t W = 16;
+    static constexpr size_t H = 2;
+
+    // beam 0 is level and beam 1 looks down by 45 degrees, column m points
+    // at azimuth 2 pi m / W counted from -pi; ranges are in mm
+    void SetUp() override {
+        direction = SectorRanges::PointsF(W * H, 3);
+        offset = SectorRanges::PointsF::Zero(W * H, 3);
+        for (size_t b = 0; b < H; ++b) {
+            for (size_t m = 0; m < W; ++m) {
+                const double azimuth = -M_PI + (m + 0.5) * 2 * M_PI / W;
+                const double elevation = b == 0 ? 0.0 : -M_PI / 4;
+                direction.row(b * W + m)
+                    << 0.001 * std::cos(elevation) * std::cos(azimuth),
+                    0.001 * std::cos(elevation) * std::sin(azimuth),
+                    0.001 * std::sin(elevation);
+            }
+        }
+    }
+
+    SectorRanges::PointsF direction;
+    SectorRanges::PointsF offset;
+};
+
+TEST_F(SectorRangesTest, SectorsCompleteWithTheirLastColumn) {
+    SectorRangesConfig config;
+    config.sectors = 4;
+    SectorRanges sectors(direction, offset, W, H, config);
+
+    std::vector<float> ranges;
+    const uint32_t far[H] = {9000, 0};
+    const uint32_t near[H] = {2000, 0};
+    // sector 0 spans columns [0, 4)
+    EXPECT_FALSE(sectors.add_column(0, far));
+    EXPECT_FALSE(sectors.add_column(1, near));
+    sectors.ranges(ranges);
+    EXPECT_FLOAT_EQ(ranges[0], 2.0f);  // reported before the sector completes
+    EXPECT_TRUE(std::isinf(ranges[1]));
+    EXPECT_FALSE(sectors.add_column(2, far));
+    EXPECT_TRUE(sectors.add_column(3, far));
+
+    // the next sweep of sector 0 starts over but keeps the completed value
+    EXPECT_FALSE(sectors.add_column(0, far));
+    sectors.ranges(ranges);
+    EXPECT_FLOAT_EQ(ranges[0], 2.0f);
+    for (size_t m = 1; m < 4; ++m) sectors.add_column(m, far);
+    sectors.ranges(ranges);
+    EXPECT_FLOAT_EQ(ranges[0], 9.0f);
+}
+
+TEST_F(SectorRangesTest, HeightBandAndRangeMinFilterReturns) {
+    SectorRangesConfig config;
+    config.sectors = 2;
+    config.height_min = -0.5;
+    config.height_max = 0.5;
+    config.range_min = 0.3;
+    SectorRanges sectors(direction, offset, W, H, config);
+
+    std::vector<float> ranges;
+    // the downward beam hits 1 m below the sensor, outside of the band
+    const uint32_t ground[H] = {0, 1414};
+    sectors.add_column(0, ground);
+    // a return nearer than range_min is ignored
+    const uint32_t self_hit[H] = {200, 0};
+    sectors.add_column(1, self_hit);
+    // within the band the downward beam reports its horizontal distance
+    const uint32_t low[H] = {0, 600};
+    sectors.add_column(W - 1, low);
+    sectors.ranges(ranges);
+    ASSERT_EQ(ranges.size(), 2u);
+    EXPECT_TRUE(std::isinf(ranges[0]));
+    EXPECT_NEAR(ranges[1], 0.6f * std::cos(M_PI / 4), 1e-3);
+}
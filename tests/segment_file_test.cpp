@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <numeric>
+
+#include "../src/segment_reader.h"
+#include "../src/segment_writer.h"
+
+using namespace ouster_ros;
+
+class SegmentFileTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        config.prefix = testing::TempDir() + "segment_file_test";
+        config.segment_size = 64 * 1024;
+        config.index_interval = 4;
+        packet.resize(1000);
+        std::iota(packet.begin(), packet.end(), 0);
+    }
+
+    void TearDown() override {
+        for (int i = 0; i < 10; ++i) {
+            char name[16];
+            std::snprintf(name, sizeof(name), "_%05d.oseg", i);
+            std::remove((config.prefix + name).c_str());
+        }
+    }
+
+    void write_packets(SegmentWriter& writer, int count) {
+        for (int i = 0; i < count; ++i) {
+            packet[0] = static_cast<uint8_t>(i);
+            auto type = i % 10 ? segment::LIDAR_PACKET : segment::IMU_PACKET;
+            size_t size = type == segment::LIDAR_PACKET ? packet.size() : 48;
+            writer.write(type, 1000 + i * 10, packet.data(), size);
+        }
+    }
+
+    SegmentWriterConfig config;
+    std::vector<uint8_t> packet;
+};
+
+TEST_F(SegmentFileTest, RoundTripsPacketsAcrossRotatedSegments) {
+    const std::string metadata = R"({"sensor_info": {}})";
+    std::vector<std::string> segments;
+    {
+        SegmentWriter writer(config, metadata);
+        write_packets(writer, 200);
+        segments = writer.segments();
+    }
+    ASSERT_GT(segments.size(), 1u);
+
+    int count = 0;
+    for (const auto& path : segments) {
+        SegmentReader reader(path);
+        EXPECT_TRUE(reader.complete());
+        EXPECT_EQ(reader.metadata(), metadata);
+        SegmentRecord record;
+        while (reader.next(record)) {
+            EXPECT_EQ(record.timestamp, 1000u + count * 10);
+            EXPECT_EQ(record.data[0], static_cast<uint8_t>(count));
+            if (count % 10) {
+                EXPECT_EQ(record.type, segment::LIDAR_PACKET);
+                ASSERT_EQ(record.size, packet.size());
+                EXPECT_TRUE(std::equal(record.data + 1,
+                                       record.data + record.size,
+                                       packet.begin() + 1));
+            } else {
+                EXPECT_EQ(record.type, segment::IMU_PACKET);
+                EXPECT_EQ(record.size, 48u);
+            }
+            ++count;
+        }
+    }
+    EXPECT_EQ(count, 200);
+}
+
+TEST_F(SegmentFileTest, RotatesByDurationAndSeeksByTimestamp) {
+    config.segment_duration = 300;
+    SegmentWriter writer(config, "{}");
+    write_packets(writer, 50);
+    writer.close();
+    // 30 packets of 10 ns each per segment
+    ASSERT_EQ(writer.segments().size(), 2u);
+
+    SegmentReader reader(writer.segments()[0]);
+    SegmentRecord record;
+    reader.seek(1105);
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(record.timestamp, 1110u);
+    reader.seek(0);
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(record.timestamp, 1000u);
+    reader.seek(5000);
+    EXPECT_FALSE(reader.next(record));
+}
+
+TEST_F(SegmentFileTest, ReadsSegmentsThatWereNotClosed) {
+    SegmentWriter writer(config, "{}");
+    write_packets(writer, 20);
+
+    // the segment is still open, as it would be after a crash
+    SegmentReader reader(writer.segments()[0]);
+    EXPECT_FALSE(reader.complete());
+    SegmentRecord record;
+    int count = 0;
+    while (reader.next(record)) ++count;
+    EXPECT_EQ(count, 20);
+    reader.seek(1100);
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(record.timestamp, 1100u);
+}
+
+TEST_F(SegmentFileTest, KeepsTheSegmentsOfAPreviousWriter) {
+    // the first writer is left open, as it would be after a crash
+    SegmentWriter first(config, "{}");
+    write_packets(first, 20);
+    SegmentWriter second(config, "{}");
+    write_packets(second, 5);
+    second.close();
+    ASSERT_EQ(first.segments().size(), 1u);
+    ASSERT_EQ(second.segments().size(), 1u);
+    EXPECT_NE(second.segments()[0], first.segments()[0]);
+
+    SegmentReader reader(first.segments()[0]);
+    EXPECT_FALSE(reader.complete());
+    SegmentRecord record;
+    int count = 0;
+    while (reader.next(record)) ++count;
+    EXPECT_EQ(count, 20);
+}
+
+TEST_F(SegmentFileTest, RejectsPacketsLargerThanASegment) {
+    config.segment_size = 512;
+    SegmentWriter writer(config, "{}");
+    EXPECT_THROW(writer.write(segment::LIDAR_PACKET, 0, packet.data(),
+                              packet.size()),
+                 std::runtime_error);
+}